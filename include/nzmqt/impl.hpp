@@ -29,11 +29,35 @@
 
 #include "nzmqt/nzmqt.hpp"
 
+#include <QCoreApplication>
 #include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QMutexLocker>
+#include <QPointer>
+#include <QSettings>
 #include <QSocketNotifier>
+#include <QThread>
 #include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <chrono>
 #include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+#if defined(Q_OS_LINUX)
+ #include <pthread.h>
+ #include <sched.h>
+#endif
 
 #if defined(NZMQT_LIB)
 // #pragma message("nzmqt is built as library")
@@ -90,575 +114,4641 @@ NZMQT_INLINE QByteArray ZMQMessage::toByteArray()
 
 
 /*
- * ZMQSocket
+ * ZMQMetrics
  */
 
-NZMQT_INLINE ZMQSocket::ZMQSocket(ZMQContext* context_, Type type_)
-    : qsuper(nullptr)
-    , zmqsuper(*context_, type_)
-    , m_context(context_)
+NZMQT_INLINE ZMQMetrics::ZMQMetrics()
+    : messagesSent(0)
+    , bytesSent(0)
+    , framesSent(0)
+    , sendFailures(0)
+    , messagesReceived(0)
+    , bytesReceived(0)
+    , framesReceived(0)
+    , handlerCalls(0)
+    , handlerNsecs(0)
 {
 }
 
-NZMQT_INLINE ZMQSocket::~ZMQSocket()
+NZMQT_INLINE ZMQMetrics& ZMQMetrics::operator+=(const ZMQMetrics& other_)
 {
-//    qDebug() << Q_FUNC_INFO << "Context:" << m_context;
-    close();
+    messagesSent += other_.messagesSent;
+    bytesSent += other_.bytesSent;
+    framesSent += other_.framesSent;
+    sendFailures += other_.sendFailures;
+    messagesReceived += other_.messagesReceived;
+    bytesReceived += other_.bytesReceived;
+    framesReceived += other_.framesReceived;
+    handlerCalls += other_.handlerCalls;
+    handlerNsecs += other_.handlerNsecs;
+    return *this;
 }
 
-NZMQT_INLINE void ZMQSocket::close()
+NZMQT_INLINE double ZMQMetrics::framesPerMessageSent() const
 {
-//    qDebug() << Q_FUNC_INFO << "Context:" << m_context;
-    if (m_context)
-    {
-        m_context->unregisterSocket(this);
-        m_context = nullptr;
-    }
-    zmqsuper::close();
+    return messagesSent > 0 ? double(framesSent) / messagesSent : 0.0;
 }
 
-NZMQT_INLINE void ZMQSocket::setOption(Option optName_, const void *optionVal_, size_t optionValLen_)
+NZMQT_INLINE double ZMQMetrics::framesPerMessageReceived() const
 {
-    setsockopt(optName_, optionVal_, optionValLen_);
+    return messagesReceived > 0 ? double(framesReceived) / messagesReceived : 0.0;
 }
 
-NZMQT_INLINE void ZMQSocket::setOption(Option optName_, const char* str_)
+
+
+/*
+ * ZMQDispatchStatistics
+ */
+
+NZMQT_INLINE ZMQDispatchStatistics::ZMQDispatchStatistics()
+    : dispatches(0)
+    , stalls(0)
+    , totalNsecs(0)
+    , maxNsecs(0)
 {
-    setOption(optName_, str_, strlen(str_));
 }
 
-NZMQT_INLINE void ZMQSocket::setOption(Option optName_, const QByteArray& bytes_)
+
+
+/*
+ * ZMQTraceFrame
+ */
+
+NZMQT_INLINE ZMQTraceFrame::ZMQTraceFrame()
+    : m_traceId(0)
+    , m_valid(false)
 {
-    setOption(optName_, bytes_.constData(), bytes_.size());
 }
 
-NZMQT_INLINE void ZMQSocket::getOption(Option option_, void *optval_, size_t *optvallen_) const
+NZMQT_INLINE ZMQTraceFrame ZMQTraceFrame::create()
 {
-    const_cast<ZMQSocket*>(this)->getsockopt(option_, optval_, optvallen_);
+    static QAtomicInteger<quint64> counter(0);
+
+    ZMQTraceFrame frame;
+    frame.m_traceId = (quint64(QCoreApplication::applicationPid()) << 40)
+                      ^ quint64(currentNsecs())
+                      ^ (counter.fetchAndAddRelaxed(1) * Q_UINT64_C(0x9E3779B97F4A7C15));
+    frame.m_valid = true;
+    return frame;
 }
 
-NZMQT_INLINE void ZMQSocket::bindTo(const QString& addr_)
+NZMQT_INLINE bool ZMQTraceFrame::isValid() const
 {
-    bind(addr_.toLocal8Bit());
+    return m_valid;
 }
 
-NZMQT_INLINE void ZMQSocket::bindTo(const char *addr_)
+NZMQT_INLINE quint64 ZMQTraceFrame::traceId() const
 {
-    bind(addr_);
+    return m_traceId;
 }
 
-NZMQT_INLINE void ZMQSocket::unbindFrom(const QString& addr_)
+NZMQT_INLINE QVector<ZMQTraceFrame::Stamp> ZMQTraceFrame::stamps() const
 {
-    unbind(addr_.toLocal8Bit());
+    return m_stamps;
 }
 
-NZMQT_INLINE void ZMQSocket::unbindFrom(const char *addr_)
+NZMQT_INLINE void ZMQTraceFrame::addStamp(StampKind kind_, qint64 nsecs_)
 {
-    unbind(addr_);
+    if (m_stamps.size() >= 255)
+        return;
+
+    const Stamp stamp = { kind_, nsecs_ };
+    m_stamps.append(stamp);
 }
 
-NZMQT_INLINE void ZMQSocket::connectTo(const QString& addr_)
+NZMQT_INLINE QVector<qint64> ZMQTraceFrame::hopLatencies() const
 {
-    zmqsuper::connect(addr_.toLocal8Bit());
+    QVector<qint64> latencies;
+    for (int i = 1; i < m_stamps.size(); ++i)
+        latencies.append(m_stamps[i].nsecs - m_stamps[i - 1].nsecs);
+    return latencies;
 }
 
-NZMQT_INLINE void ZMQSocket::connectTo(const char* addr_)
+NZMQT_INLINE qint64 ZMQTraceFrame::totalLatency() const
 {
-    zmqsuper::connect(addr_);
+    return m_stamps.isEmpty() ? 0 : m_stamps.last().nsecs - m_stamps.first().nsecs;
 }
 
-NZMQT_INLINE void ZMQSocket::disconnectFrom(const QString& addr_)
+NZMQT_INLINE QByteArray ZMQTraceFrame::toByteArray() const
 {
-    zmqsuper::disconnect(addr_.toLocal8Bit());
+    QByteArray bytes(HEADER_SIZE + m_stamps.size() * STAMP_SIZE, Qt::Uninitialized);
+    uchar* data = reinterpret_cast<uchar*>(bytes.data());
+
+    memcpy(data, "NZTR", 4);
+    data[4] = VERSION;
+    qToBigEndian(m_traceId, data + 5);
+    data[13] = quint8(m_stamps.size());
+    data += HEADER_SIZE;
+
+    for (const Stamp& stamp : m_stamps)
+    {
+        data[0] = quint8(stamp.kind);
+        qToBigEndian(stamp.nsecs, data + 1);
+        data += STAMP_SIZE;
+    }
+
+    return bytes;
 }
 
-NZMQT_INLINE void ZMQSocket::disconnectFrom(const char* addr_)
+NZMQT_INLINE bool ZMQTraceFrame::isTraceFrame(const QByteArray& bytes_)
 {
-    zmqsuper::disconnect(addr_);
+    return bytes_.size() >= HEADER_SIZE
+            && bytes_.startsWith("NZTR")
+            && quint8(bytes_[4]) == VERSION
+            && bytes_.size() == HEADER_SIZE + quint8(bytes_[13]) * STAMP_SIZE;
 }
 
-NZMQT_INLINE bool ZMQSocket::sendMessage(ZMQMessage& msg_, SendFlags flags_)
+NZMQT_INLINE ZMQTraceFrame ZMQTraceFrame::fromByteArray(const QByteArray& bytes_)
 {
-    return send(msg_, flags_);
+    ZMQTraceFrame frame;
+    if (!isTraceFrame(bytes_))
+        return frame;
+
+    const uchar* data = reinterpret_cast<const uchar*>(bytes_.constData());
+    frame.m_traceId = qFromBigEndian<quint64>(data + 5);
+    const int count = data[13];
+    data += HEADER_SIZE;
+
+    frame.m_stamps.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        frame.addStamp(StampKind(data[0]), qFromBigEndian<qint64>(data + 1));
+        data += STAMP_SIZE;
+    }
+
+    frame.m_valid = true;
+    return frame;
 }
 
-NZMQT_INLINE bool ZMQSocket::sendMessage(const QByteArray& bytes_, SendFlags flags_)
+NZMQT_INLINE ZMQTraceFrame ZMQTraceFrame::current()
 {
-    ZMQMessage msg(bytes_);
-    return send(msg, flags_);
+    const ZMQTraceFrame* frame = currentFrame();
+    return frame ? *frame : ZMQTraceFrame();
 }
 
-NZMQT_INLINE bool ZMQSocket::sendMessage(const QList<QByteArray>& msg_, SendFlags flags_)
+NZMQT_INLINE qint64 ZMQTraceFrame::currentNsecs()
 {
-    int i;
-    for (i = 0; i < msg_.size() - 1; i++)
-    {
-        if (!sendMessage(msg_[i], flags_ | SND_MORE))
-            return false;
-    }
-    if (i < msg_.size())
-        return sendMessage(msg_[i], flags_);
-
-    return true;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
-NZMQT_INLINE bool ZMQSocket::receiveMessage(ZMQMessage* msg_, ReceiveFlags flags_)
+NZMQT_INLINE ZMQTraceFrame*& ZMQTraceFrame::currentFrame()
 {
-    return recv(msg_, flags_);
+    static thread_local ZMQTraceFrame* frame = nullptr;
+    return frame;
 }
 
-NZMQT_INLINE QList<QByteArray> ZMQSocket::receiveMessage(ReceiveFlags flags_)
+
+
+#ifdef NZMQT_TRACE
+
+/*
+ * ZMQTrace
+ */
+
+// Single producer ring buffer. The owning thread appends, any thread may take a snapshot.
+class ZMQTrace::Buffer
 {
-    QList<QByteArray> parts;
+public:
+    static_assert((NZMQT_TRACE_DEFAULT_BUFFERSIZE & (NZMQT_TRACE_DEFAULT_BUFFERSIZE - 1)) == 0,
+                  "NZMQT_TRACE_DEFAULT_BUFFERSIZE must be a power of 2");
 
-    ZMQMessage msg;
-    while (receiveMessage(&msg, flags_))
+    Buffer(int threadId_, const QString& threadName_)
+        : m_threadId(threadId_)
+        , m_threadName(threadName_)
+        , m_slots()
+        , m_head(0)
+        , m_tail(0)
     {
-        parts += msg.toByteArray();
-        msg.rebuild();
+    }
 
-        if (!hasMoreMessageParts())
-            break;
+    void append(const Event& event_)
+    {
+        const quint64 head = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[head & (NZMQT_TRACE_DEFAULT_BUFFERSIZE - 1)];
+        slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.nsecs.store(event_.nsecs, std::memory_order_relaxed);
+        slot.name.store(event_.name, std::memory_order_relaxed);
+        slot.object.store(event_.object, std::memory_order_relaxed);
+        slot.phase.store(event_.phase, std::memory_order_relaxed);
+        slot.sequence.store(2 * head + 2, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_release);
     }
 
-    return parts;
-}
+    QVector<Event> snapshot() const
+    {
+        const quint64 head = m_head.load(std::memory_order_acquire);
+        quint64 first = m_tail.load(std::memory_order_relaxed);
+        if (head - first > NZMQT_TRACE_DEFAULT_BUFFERSIZE)
+            first = head - NZMQT_TRACE_DEFAULT_BUFFERSIZE;
 
-NZMQT_INLINE QList< QList<QByteArray> > ZMQSocket::receiveMessages(ReceiveFlags flags_)
-{
-    QList< QList<QByteArray> > ret;
+        QVector<Event> events;
+        events.reserve(int(head - first));
+        for (quint64 i = first; i < head; ++i)
+        {
+            // Skip slots the owner is overwriting or has overwritten meanwhile.
+            const Slot& slot = m_slots[i & (NZMQT_TRACE_DEFAULT_BUFFERSIZE - 1)];
+            const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence != 2 * i + 2)
+                continue;
 
-    QList<QByteArray> parts = receiveMessage(flags_);
-    while (!parts.isEmpty())
+            const Event event = {
+                slot.nsecs.load(std::memory_order_relaxed),
+                slot.name.load(std::memory_order_relaxed),
+                slot.object.load(std::memory_order_relaxed),
+                slot.phase.load(std::memory_order_relaxed)
+            };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+                continue;
+
+            events.append(event);
+        }
+
+        return events;
+    }
+
+    void clear()
     {
-        ret += std::move(parts);
+        m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
 
-        parts = receiveMessage(flags_);
+    int threadId() const
+    {
+        return m_threadId;
     }
 
-    return ret;
-}
+    QString threadName() const
+    {
+        return m_threadName;
+    }
 
-NZMQT_INLINE qintptr ZMQSocket::fileDescriptor() const
-{
-    qintptr value;
-    size_t size = sizeof(value);
-    getOption(OPT_FD, &value, &size);
-    return value;
-}
+    static QMutex& registryMutex()
+    {
+        static QMutex mutex;
+        return mutex;
+    }
 
-NZMQT_INLINE ZMQSocket::Events ZMQSocket::events() const
+    static QList<Buffer*>& registry()
+    {
+        static QList<Buffer*> buffers;
+        return buffers;
+    }
+
+private:
+    const int m_threadId;
+    const QString m_threadName;
+
+    // An event guarded by a sequence number, which is odd while the owner writes the slot
+    // and 2 * (index + 1) once the event of that index is complete.
+    struct Slot
+    {
+        std::atomic<quint64> sequence;
+        std::atomic<qint64> nsecs;
+        std::atomic<const char*> name;
+        std::atomic<const void*> object;
+        std::atomic<char> phase;
+    };
+
+    Slot m_slots[NZMQT_TRACE_DEFAULT_BUFFERSIZE];
+    std::atomic<quint64> m_head;
+    std::atomic<quint64> m_tail;
+};
+
+NZMQT_INLINE void ZMQTrace::record(const char* name_, char phase_, const void* object_)
 {
-    qint32 value;
-    size_t size = sizeof(value);
-    getOption(OPT_EVENTS, &value, &size);
-    return static_cast<Events>(value);
+    const Event event = { now(), name_, object_, phase_ };
+    threadBuffer()->append(event);
 }
 
-// Returns true if there are more parts of a multi-part message
-// to be received.
-NZMQT_INLINE bool ZMQSocket::hasMoreMessageParts() const
+NZMQT_INLINE QVector<ZMQTrace::Event> ZMQTrace::threadEvents()
 {
-    qint32 value;
-    size_t size = sizeof(value);
-    getOption(OPT_RCVMORE, &value, &size);
-    return value;
+    return threadBuffer()->snapshot();
 }
 
-NZMQT_INLINE void ZMQSocket::setIdentity(const char* nameStr_)
+NZMQT_INLINE bool ZMQTrace::writeChromeTrace(QIODevice* device_)
 {
-    setOption(OPT_IDENTITY, nameStr_);
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+
+    QByteArray json = "{\"traceEvents\":[";
+    bool first = true;
+    for (Buffer* buffer : buffers())
+    {
+        const QByteArray tid = QByteArray::number(buffer->threadId());
+
+        json += first ? "\n" : ",\n";
+        first = false;
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+                + ",\"args\":{\"name\":\"" + buffer->threadName().toUtf8().replace('\\', "\\\\").replace('"', "\\\"") + "\"}}";
+
+        for (const Event& event : buffer->snapshot())
+        {
+            json += ",\n{\"name\":\"";
+            json += event.name;
+            json += "\",\"ph\":\"";
+            json += event.phase;
+            json += "\",\"ts\":" + QByteArray::number(double(event.nsecs) / 1000.0, 'f', 3)
+                    + ",\"pid\":" + pid + ",\"tid\":" + tid;
+            if ('i' == event.phase)
+                json += ",\"s\":\"t\"";
+            if (event.object)
+                json += ",\"args\":{\"object\":\"0x" + QByteArray::number(qulonglong(quintptr(event.object)), 16) + "\"}";
+            json += "}";
+        }
+    }
+    json += "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    return device_->write(json) == json.size();
 }
 
-NZMQT_INLINE void ZMQSocket::setIdentity(const QString& name_)
+NZMQT_INLINE bool ZMQTrace::writeChromeTrace(const QString& fileName_)
 {
-    setOption(OPT_IDENTITY, name_.toLocal8Bit());
+    QFile file(fileName_);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("Cannot write trace file: %s", qPrintable(file.errorString()));
+        return false;
+    }
+    return writeChromeTrace(&file);
 }
 
-NZMQT_INLINE void ZMQSocket::setIdentity(const QByteArray& name_)
+NZMQT_INLINE void ZMQTrace::clear()
 {
-    setOption(OPT_IDENTITY, const_cast<char*>(name_.constData()), name_.size());
+    for (Buffer* buffer : buffers())
+        buffer->clear();
 }
 
-NZMQT_INLINE QByteArray ZMQSocket::identity() const
+NZMQT_INLINE ZMQTrace::Buffer* ZMQTrace::threadBuffer()
 {
-    char idbuf[256];
-    size_t size = sizeof(idbuf);
-    getOption(OPT_IDENTITY, idbuf, &size);
-    return QByteArray(idbuf, int(size));
+    static thread_local Buffer* buffer = nullptr;
+    if (!buffer)
+    {
+        QMutexLocker lock(&Buffer::registryMutex());
+
+        QString threadName = QThread::currentThread()->objectName();
+        const int threadId = Buffer::registry().size() + 1;
+        if (threadName.isEmpty())
+            threadName = QString("Thread %1").arg(threadId);
+
+        buffer = new Buffer(threadId, threadName);
+        Buffer::registry().append(buffer);
+    }
+    return buffer;
 }
 
-NZMQT_INLINE void ZMQSocket::setLinger(int msec_)
+NZMQT_INLINE QList<ZMQTrace::Buffer*> ZMQTrace::buffers()
 {
-    setOption(OPT_LINGER, msec_);
+    QMutexLocker lock(&Buffer::registryMutex());
+    return Buffer::registry();
 }
 
-NZMQT_INLINE qint32 ZMQSocket::linger() const
+NZMQT_INLINE qint64 ZMQTrace::now()
 {
-    qint32 msec=-1;
-    size_t size = sizeof(msec);
-    getOption(OPT_LINGER, &msec, &size);
-    return msec;
+    static const QElapsedTimer clock = [] { QElapsedTimer timer; timer.start(); return timer; }();
+    return clock.nsecsElapsed();
 }
 
-NZMQT_INLINE void ZMQSocket::subscribeTo(const char* filterStr_)
+#endif
+
+
+
+/*
+ * ZMQZlibCodec
+ */
+
+NZMQT_INLINE ZMQZlibCodec::ZMQZlibCodec(int compressionLevel_)
+    : m_compressionLevel(compressionLevel_)
 {
-    setOption(OPT_SUBSCRIBE, filterStr_);
 }
 
-NZMQT_INLINE void ZMQSocket::subscribeTo(const QString& filter_)
+NZMQT_INLINE quint8 ZMQZlibCodec::id() const
 {
-    setOption(OPT_SUBSCRIBE, filter_.toLocal8Bit());
+    return ID;
 }
 
-NZMQT_INLINE void ZMQSocket::subscribeTo(const QByteArray& filter_)
+NZMQT_INLINE QByteArray ZMQZlibCodec::encode(const QByteArray& data_) const
 {
-    setOption(OPT_SUBSCRIBE, filter_);
+    return qCompress(data_, m_compressionLevel);
 }
 
-NZMQT_INLINE void ZMQSocket::unsubscribeFrom(const char* filterStr_)
+NZMQT_INLINE QByteArray ZMQZlibCodec::decode(const QByteArray& data_) const
 {
-    setOption(OPT_UNSUBSCRIBE, filterStr_);
+    return qUncompress(data_);
 }
 
-NZMQT_INLINE void ZMQSocket::unsubscribeFrom(const QString& filter_)
+
+
+/*
+ * ZMQSharedMemoryCodec
+ */
+
+NZMQT_INLINE ZMQSharedMemoryCodec::ZMQSharedMemoryCodec(int leaseTime_, int readers_)
+    : m_leaseTime(leaseTime_)
+    , m_readers(qMax(readers_, 1))
+    , m_segmentCounter(0)
 {
-    setOption(OPT_UNSUBSCRIBE, filter_.toLocal8Bit());
+    m_clock.start();
 }
 
-NZMQT_INLINE void ZMQSocket::unsubscribeFrom(const QByteArray& filter_)
+NZMQT_INLINE ZMQSharedMemoryCodec::~ZMQSharedMemoryCodec()
 {
-    setOption(OPT_UNSUBSCRIBE, filter_);
 }
 
-NZMQT_INLINE void ZMQSocket::setSendHighWaterMark(int value_)
+NZMQT_INLINE quint8 ZMQSharedMemoryCodec::id() const
 {
-    setOption(OPT_SNDHWM, value_);
+    return ID;
 }
 
-NZMQT_INLINE void ZMQSocket::setReceiveHighWaterMark(int value_)
+NZMQT_INLINE QByteArray ZMQSharedMemoryCodec::encode(const QByteArray& data_) const
 {
-    setOption(OPT_RCVHWM, value_);
+    releaseSegments();
+
+    QMutexLocker lock(&m_leasesMutex);
+
+    const QString key = QString("nzmqt-%1-%2-%3")
+            .arg(QCoreApplication::applicationPid())
+            .arg(qulonglong(quintptr(this)))
+            .arg(++m_segmentCounter);
+    QSharedPointer<QSharedMemory> segment(new QSharedMemory(key));
+    if (!segment->create(SEGMENT_HEADER_SIZE + data_.size()))
+    {
+        qWarning("Cannot create shared memory segment: %s", qPrintable(segment->errorString()));
+        return QByteArray();
+    }
+    memcpy(static_cast<char*>(segment->data()) + SEGMENT_HEADER_SIZE, data_.constData(), data_.size());
+    pendingReaders(segment.data())->storeRelease(m_readers);
+
+    Lease lease = { segment, m_clock.elapsed() + m_leaseTime };
+    m_leases.enqueue(lease);
+
+    lock.unlock();
+
+    // Descriptor layout: offset (8 bytes), length (8 bytes), segment key (UTF-8).
+    QByteArray descriptor(int(2 * sizeof(quint64)), Qt::Uninitialized);
+    uchar* header = reinterpret_cast<uchar*>(descriptor.data());
+    qToBigEndian<quint64>(SEGMENT_HEADER_SIZE, header);
+    qToBigEndian<quint64>(quint64(data_.size()), header + sizeof(quint64));
+    descriptor += key.toUtf8();
+    return descriptor;
 }
 
-NZMQT_INLINE bool ZMQSocket::isConnected()
+NZMQT_INLINE QByteArray ZMQSharedMemoryCodec::decode(const QByteArray& data_) const
 {
-    return const_cast<ZMQSocket*>(this)->connected();
-}
+    const char* data;
+    int size;
+    QSharedPointer<QSharedMemory> segment = attachDescriptor(data_, &data, &size);
+    if (!segment)
+        return QByteArray();
 
-/*
- * ZMQContext
- */
+    return QByteArray(data, size);
+}
 
-NZMQT_INLINE ZMQContext::ZMQContext(QObject* parent_, int io_threads_)
-    : qsuper(parent_)
-    , zmqsuper(io_threads_)
+NZMQT_INLINE bool ZMQSharedMemoryCodec::supportsEndpoint(const QString& endpoint_) const
 {
+    return isLocalEndpoint(endpoint_);
 }
 
-NZMQT_INLINE ZMQContext::~ZMQContext()
+NZMQT_INLINE void ZMQSharedMemoryCodec::releaseSegments() const
 {
-//    qDebug() << Q_FUNC_INFO << "Sockets:" << m_sockets;
-    for(ZMQSocket* socket : registeredSockets())
+    QMutexLocker lock(&m_leasesMutex);
+
+    const qint64 now = m_clock.elapsed();
+    for (int i = 0; i < m_leases.size(); )
     {
-        socket->m_context = nullptr;
-        // As stated by 0MQ, close() must ONLY be called from the thread
-        // owning the socket. So we use 'invokeMethod' which (hopefully)
-        // results in a 'close' call from within the socket's thread.
-        QMetaObject::invokeMethod(socket, "close");
+        const Lease& lease = m_leases.at(i);
+        if (lease.expiry <= now || pendingReaders(lease.segment.data())->loadAcquire() <= 0)
+            m_leases.removeAt(i);
+        else
+            ++i;
     }
 }
 
-NZMQT_INLINE ZMQSocket* ZMQContext::createSocket(ZMQSocket::Type type_, QObject* parent_)
+NZMQT_INLINE int ZMQSharedMemoryCodec::leasedSegments() const
 {
-    ZMQSocket* socket = createSocketInternal(type_);
-    registerSocket(socket);
-    socket->setParent(parent_);
-    return socket;
+    QMutexLocker lock(&m_leasesMutex);
+
+    return m_leases.size();
 }
 
-NZMQT_INLINE void ZMQContext::registerSocket(ZMQSocket* socket_)
+NZMQT_INLINE QSharedPointer<QSharedMemory> ZMQSharedMemoryCodec::attach(const QByteArray& frame_, const char** data_, int* size_)
 {
-    m_sockets.push_back(socket_);
+    if (frame_.isEmpty() || quint8(frame_.at(0)) != ID)
+        return QSharedPointer<QSharedMemory>();
+
+    return attachDescriptor(QByteArray::fromRawData(frame_.constData() + 1, frame_.size() - 1), data_, size_);
 }
 
-NZMQT_INLINE void ZMQContext::unregisterSocket(ZMQSocket* socket_)
+NZMQT_INLINE QSharedPointer<QSharedMemory> ZMQSharedMemoryCodec::attachDescriptor(const QByteArray& descriptor_, const char** data_, int* size_)
 {
-    for(Sockets::iterator soIt = m_sockets.begin(); soIt != m_sockets.end(); ++soIt)
+    const int headerSize = int(2 * sizeof(quint64));
+    if (descriptor_.size() <= headerSize)
     {
-        if (*soIt == socket_)
-        {
-            m_sockets.erase(soIt);
-            break;
-        }
+        qWarning("Cannot attach to shared memory segment: malformed descriptor");
+        return QSharedPointer<QSharedMemory>();
     }
-}
 
-NZMQT_INLINE const ZMQContext::Sockets& ZMQContext::registeredSockets() const
-{
-    return m_sockets;
-}
+    const uchar* header = reinterpret_cast<const uchar*>(descriptor_.constData());
+    const quint64 offset = qFromBigEndian<quint64>(header);
+    const quint64 length = qFromBigEndian<quint64>(header + sizeof(quint64));
+    const QString key = QString::fromUtf8(descriptor_.constData() + headerSize, descriptor_.size() - headerSize);
+
+    // The reader count in the segment header is written, so attach read-write.
+    QScopedPointer<QSharedMemory> segment(new QSharedMemory(key));
+    if (!segment->attach())
+    {
+        qWarning("Cannot attach to shared memory segment %s: %s", qPrintable(key), qPrintable(segment->errorString()));
+        return QSharedPointer<QSharedMemory>();
+    }
+
+    if (offset < quint64(SEGMENT_HEADER_SIZE) || offset + length > quint64(segment->size()))
+    {
+        qWarning("Cannot attach to shared memory segment %s: payload out of range", qPrintable(key));
+        return QSharedPointer<QSharedMemory>();
+    }
+
+    *data_ = static_cast<const char*>(segment->constData()) + offset;
+    *size_ = int(length);
+    return QSharedPointer<QSharedMemory>(segment.take(), &ZMQSharedMemoryCodec::releaseReader);
+}
+
+NZMQT_INLINE QBasicAtomicInt* ZMQSharedMemoryCodec::pendingReaders(QSharedMemory* segment_)
+{
+    return static_cast<QBasicAtomicInt*>(segment_->data());
+}
+
+NZMQT_INLINE void ZMQSharedMemoryCodec::releaseReader(QSharedMemory* segment_)
+{
+    pendingReaders(segment_)->fetchAndAddOrdered(-1);
+    delete segment_;
+}
+
+NZMQT_INLINE bool ZMQSharedMemoryCodec::isLocalEndpoint(const QString& endpoint_)
+{
+    if (endpoint_.startsWith("inproc://") || endpoint_.startsWith("ipc://"))
+        return true;
+
+    if (!endpoint_.startsWith("tcp://"))
+        return false;
+
+    // Strip the optional source address ("tcp://source;destination") and the port.
+    QString host = endpoint_.mid(6);
+    host = host.mid(host.lastIndexOf(';') + 1);
+    host = host.left(host.lastIndexOf(':'));
+    if (host.startsWith('['))
+        host = host.mid(1, host.size() - 2);
+
+    return "localhost" == host || "lo" == host || "::1" == host || host.startsWith("127.");
+}
+
+
+
+/*
+ * ZMQSocket
+ */
+
+NZMQT_INLINE ZMQSocket::ZMQSocket(ZMQContext* context_, Type type_)
+    : qsuper(nullptr)
+    , zmqsuper(*context_, type_)
+    , m_context(context_)
+    , m_monitor(nullptr)
+    , m_registryIndex(-1)
+    , m_traceFrameEnabled(false)
+    , m_codecThreshold(NZMQT_CODEC_DEFAULT_THRESHOLD)
+    , m_codecSkipParts(0)
+    , m_codecSupportsEndpoints(true)
+    , m_sendPart(0)
+{
+    for (std::atomic<quint64>& counter : m_counters)
+        counter.store(0, std::memory_order_relaxed);
+}
+
+NZMQT_INLINE ZMQSocket::~ZMQSocket()
+{
+//    qDebug() << Q_FUNC_INFO << "Context:" << m_context;
+    close();
+}
+
+NZMQT_INLINE void ZMQSocket::close()
+{
+//    qDebug() << Q_FUNC_INFO << "Context:" << m_context;
+    stopMonitor();
+    if (m_context)
+    {
+        m_context->unregisterSocket(this);
+        m_context = nullptr;
+    }
+    zmqsuper::close();
+}
+
+NZMQT_INLINE void ZMQSocket::setOption(Option optName_, const void *optionVal_, size_t optionValLen_)
+{
+    setsockopt(optName_, optionVal_, optionValLen_);
+}
+
+NZMQT_INLINE void ZMQSocket::setOption(Option optName_, const char* str_)
+{
+    setOption(optName_, str_, strlen(str_));
+}
+
+NZMQT_INLINE void ZMQSocket::setOption(Option optName_, const QByteArray& bytes_)
+{
+    setOption(optName_, bytes_.constData(), bytes_.size());
+}
+
+NZMQT_INLINE void ZMQSocket::getOption(Option option_, void *optval_, size_t *optvallen_) const
+{
+    const_cast<ZMQSocket*>(this)->getsockopt(option_, optval_, optvallen_);
+}
+
+NZMQT_INLINE void ZMQSocket::setIoThreads(const QList<int>& ioThreads_)
+{
+    quint64 affinity = 0;
+    for (int ioThread : ioThreads_)
+    {
+        if (ioThread < 0 || ioThread >= 64)
+        {
+            errno = EINVAL;
+            throw ZMQException();
+        }
+        affinity |= quint64(1) << ioThread;
+    }
+    setOption(OPT_AFFINITY, affinity);
+}
+
+NZMQT_INLINE QList<int> ZMQSocket::ioThreads() const
+{
+    quint64 affinity = 0;
+    size_t size = sizeof(affinity);
+    getOption(OPT_AFFINITY, &affinity, &size);
+
+    QList<int> ioThreads;
+    for (int ioThread = 0; ioThread < 64; ++ioThread)
+    {
+        if (affinity & (quint64(1) << ioThread))
+            ioThreads << ioThread;
+    }
+    return ioThreads;
+}
+
+NZMQT_INLINE void ZMQSocket::bindTo(const QString& addr_)
+{
+    applyEndpointProfile(addr_);
+    bind(addr_.toLocal8Bit());
+    addEndpoint(addr_);
+}
+
+NZMQT_INLINE void ZMQSocket::bindTo(const char *addr_)
+{
+    applyEndpointProfile(QString::fromLocal8Bit(addr_));
+    bind(addr_);
+    addEndpoint(QString::fromLocal8Bit(addr_));
+}
+
+NZMQT_INLINE void ZMQSocket::unbindFrom(const QString& addr_)
+{
+    unbind(addr_.toLocal8Bit());
+    removeEndpoint(addr_);
+}
+
+NZMQT_INLINE void ZMQSocket::unbindFrom(const char *addr_)
+{
+    unbind(addr_);
+    removeEndpoint(QString::fromLocal8Bit(addr_));
+}
+
+NZMQT_INLINE void ZMQSocket::connectTo(const QString& addr_)
+{
+    applyEndpointProfile(addr_);
+    zmqsuper::connect(addr_.toLocal8Bit());
+    addEndpoint(addr_);
+}
+
+NZMQT_INLINE void ZMQSocket::connectTo(const char* addr_)
+{
+    applyEndpointProfile(QString::fromLocal8Bit(addr_));
+    zmqsuper::connect(addr_);
+    addEndpoint(QString::fromLocal8Bit(addr_));
+}
+
+NZMQT_INLINE void ZMQSocket::disconnectFrom(const QString& addr_)
+{
+    zmqsuper::disconnect(addr_.toLocal8Bit());
+    removeEndpoint(addr_);
+}
+
+NZMQT_INLINE void ZMQSocket::disconnectFrom(const char* addr_)
+{
+    zmqsuper::disconnect(addr_);
+    removeEndpoint(QString::fromLocal8Bit(addr_));
+}
+
+NZMQT_INLINE bool ZMQSocket::sendMessage(ZMQMessage& msg_, SendFlags flags_)
+{
+    NZMQT_TRACE_EVENT(send, i, this);
+
+#ifdef NZMQT_METRICS
+    const size_t size = msg_.size();
+    if (!send(msg_, flags_))
+    {
+        count(CNT_SENDFAILURES);
+        return false;
+    }
+
+    count(CNT_FRAMESSENT);
+    count(CNT_BYTESSENT, size);
+    if (!(flags_ & SND_MORE))
+        count(CNT_MESSAGESSENT);
+
+    return true;
+#else
+    return send(msg_, flags_);
+#endif
+}
+
+NZMQT_INLINE bool ZMQSocket::sendMessage(const QByteArray& bytes_, SendFlags flags_)
+{
+    // The trace frame follows the last part of each message.
+    if (m_traceFrameEnabled && !(flags_ & SND_MORE))
+        return sendPart(bytes_, flags_ | SND_MORE) && sendTraceFrame(flags_);
+
+    return sendPart(bytes_, flags_);
+}
+
+NZMQT_INLINE bool ZMQSocket::sendPart(const QByteArray& bytes_, SendFlags flags_)
+{
+    if (m_codec)
+        return sendEncodedMessage(bytes_, flags_);
+
+    ZMQMessage msg(bytes_);
+    return sendMessage(msg, flags_);
+}
+
+NZMQT_INLINE bool ZMQSocket::sendTraceFrame(SendFlags flags_)
+{
+    ZMQTraceFrame frame = ZMQTraceFrame::current();
+    if (!frame.isValid())
+        frame = ZMQTraceFrame::create();
+    frame.addStamp(ZMQTraceFrame::STAMP_SENT);
+
+    // The trace frame bypasses the codec stage.
+    ZMQMessage msg(frame.toByteArray());
+    const bool sent = sendMessage(msg, flags_);
+    if (sent)
+        m_sendPart = 0;
+    return sent;
+}
+
+NZMQT_INLINE bool ZMQSocket::sendEncodedMessage(const QByteArray& bytes_, SendFlags flags_)
+{
+    bool sent;
+    if (m_sendPart < m_codecSkipParts)
+    {
+        ZMQMessage msg(bytes_);
+        sent = sendMessage(msg, flags_);
+    }
+    else
+    {
+        quint8 header = 0;
+        QByteArray payload = bytes_;
+        if (bytes_.size() >= m_codecThreshold && m_codecSupportsEndpoints)
+        {
+            QByteArray encoded = m_codec->encode(bytes_);
+            if (!encoded.isEmpty() && encoded.size() < bytes_.size())
+            {
+                payload = encoded;
+                header = m_codec->id();
+            }
+        }
+
+        ZMQMessage msg(size_t(payload.size()) + 1);
+        *msg.data<quint8>() = header;
+        memcpy(msg.data<char>() + 1, payload.constData(), payload.size());
+        sent = sendMessage(msg, flags_);
+    }
+
+    if (sent)
+        m_sendPart = (flags_ & SND_MORE) ? m_sendPart + 1 : 0;
+
+    return sent;
+}
+
+NZMQT_INLINE bool ZMQSocket::sendMessage(const QList<QByteArray>& msg_, SendFlags flags_)
+{
+    int i;
+    for (i = 0; i < msg_.size() - 1; i++)
+    {
+        if (!sendMessage(msg_[i], flags_ | SND_MORE))
+            return false;
+    }
+    if (i < msg_.size())
+        return sendMessage(msg_[i], flags_);
+
+    return true;
+}
+
+NZMQT_INLINE bool ZMQSocket::receiveMessage(ZMQMessage* msg_, ReceiveFlags flags_)
+{
+#ifdef NZMQT_METRICS
+    if (!recv(msg_, flags_))
+        return false;
+
+    count(CNT_FRAMESRECEIVED);
+    count(CNT_BYTESRECEIVED, msg_->size());
+    if (!msg_->more())
+        count(CNT_MESSAGESRECEIVED);
+
+    return true;
+#else
+    return recv(msg_, flags_);
+#endif
+}
+
+NZMQT_INLINE QList<QByteArray> ZMQSocket::receiveMessage(ReceiveFlags flags_)
+{
+    QList<QByteArray> parts;
+
+    ZMQMessage msg;
+    while (receiveMessage(&msg, flags_))
+    {
+        parts += msg.toByteArray();
+        msg.rebuild();
+
+        if (!hasMoreMessageParts())
+            break;
+    }
+
+    if (m_traceFrameEnabled)
+    {
+        m_receivedTraceFrame = ZMQTraceFrame();
+        if (parts.size() > 1 && ZMQTraceFrame::isTraceFrame(parts.last()))
+        {
+            m_receivedTraceFrame = ZMQTraceFrame::fromByteArray(parts.takeLast());
+            m_receivedTraceFrame.addStamp(ZMQTraceFrame::STAMP_RECEIVED);
+        }
+    }
+
+    if (m_codec)
+        decodeMessage(parts);
+
+    return parts;
+}
+
+NZMQT_INLINE void ZMQSocket::decodeMessage(QList<QByteArray>& parts_) const
+{
+    for (int i = m_codecSkipParts; i < parts_.size(); ++i)
+    {
+        QByteArray& part = parts_[i];
+        if (part.isEmpty())
+            continue;
+
+        const quint8 header = quint8(part.at(0));
+        if (0 == header)
+        {
+            part.remove(0, 1);
+        }
+        else if (header == m_codec->id())
+        {
+            part = m_codec->decode(QByteArray::fromRawData(part.constData() + 1, part.size() - 1));
+        }
+        else
+        {
+            qWarning("Cannot decode message part: unknown codec %d", int(header));
+            part.clear();
+        }
+    }
+}
+
+NZMQT_INLINE void ZMQSocket::applyEndpointProfile(const QString& addr_)
+{
+    if (m_context)
+        m_context->endpointProfile(addr_).applyTo(this);
+}
+
+NZMQT_INLINE void ZMQSocket::addEndpoint(const QString& addr_)
+{
+    m_endpoints << addr_;
+    updateCodecSupport();
+}
+
+NZMQT_INLINE void ZMQSocket::removeEndpoint(const QString& addr_)
+{
+    m_endpoints.removeOne(addr_);
+    updateCodecSupport();
+}
+
+NZMQT_INLINE void ZMQSocket::updateCodecSupport()
+{
+    m_codecSupportsEndpoints = true;
+    if (!m_codec)
+        return;
+
+    for (const QString& endpoint : m_endpoints)
+    {
+        if (!m_codec->supportsEndpoint(endpoint))
+        {
+            m_codecSupportsEndpoints = false;
+            break;
+        }
+    }
+}
+
+NZMQT_INLINE QList< QList<QByteArray> > ZMQSocket::receiveMessages(ReceiveFlags flags_)
+{
+    QList< QList<QByteArray> > ret;
+
+    QList<QByteArray> parts = receiveMessage(flags_);
+    while (!parts.isEmpty())
+    {
+        ret += std::move(parts);
+
+        parts = receiveMessage(flags_);
+    }
+
+    return ret;
+}
+
+NZMQT_INLINE qintptr ZMQSocket::fileDescriptor() const
+{
+    qintptr value;
+    size_t size = sizeof(value);
+    getOption(OPT_FD, &value, &size);
+    return value;
+}
+
+NZMQT_INLINE ZMQSocket::Events ZMQSocket::events() const
+{
+    qint32 value;
+    size_t size = sizeof(value);
+    getOption(OPT_EVENTS, &value, &size);
+    return static_cast<Events>(value);
+}
+
+// Returns true if there are more parts of a multi-part message
+// to be received.
+NZMQT_INLINE bool ZMQSocket::hasMoreMessageParts() const
+{
+    qint32 value;
+    size_t size = sizeof(value);
+    getOption(OPT_RCVMORE, &value, &size);
+    return value;
+}
+
+NZMQT_INLINE void ZMQSocket::setIdentity(const char* nameStr_)
+{
+    setOption(OPT_IDENTITY, nameStr_);
+}
+
+NZMQT_INLINE void ZMQSocket::setIdentity(const QString& name_)
+{
+    setOption(OPT_IDENTITY, name_.toLocal8Bit());
+}
+
+NZMQT_INLINE void ZMQSocket::setIdentity(const QByteArray& name_)
+{
+    setOption(OPT_IDENTITY, const_cast<char*>(name_.constData()), name_.size());
+}
+
+NZMQT_INLINE QByteArray ZMQSocket::identity() const
+{
+    char idbuf[256];
+    size_t size = sizeof(idbuf);
+    getOption(OPT_IDENTITY, idbuf, &size);
+    return QByteArray(idbuf, int(size));
+}
+
+NZMQT_INLINE void ZMQSocket::setLinger(int msec_)
+{
+    setOption(OPT_LINGER, msec_);
+}
+
+NZMQT_INLINE qint32 ZMQSocket::linger() const
+{
+    qint32 msec=-1;
+    size_t size = sizeof(msec);
+    getOption(OPT_LINGER, &msec, &size);
+    return msec;
+}
+
+NZMQT_INLINE void ZMQSocket::subscribeTo(const char* filterStr_)
+{
+    setOption(OPT_SUBSCRIBE, filterStr_);
+}
+
+NZMQT_INLINE void ZMQSocket::subscribeTo(const QString& filter_)
+{
+    setOption(OPT_SUBSCRIBE, filter_.toLocal8Bit());
+}
+
+NZMQT_INLINE void ZMQSocket::subscribeTo(const QByteArray& filter_)
+{
+    setOption(OPT_SUBSCRIBE, filter_);
+}
+
+NZMQT_INLINE void ZMQSocket::unsubscribeFrom(const char* filterStr_)
+{
+    setOption(OPT_UNSUBSCRIBE, filterStr_);
+}
+
+NZMQT_INLINE void ZMQSocket::unsubscribeFrom(const QString& filter_)
+{
+    setOption(OPT_UNSUBSCRIBE, filter_.toLocal8Bit());
+}
+
+NZMQT_INLINE void ZMQSocket::unsubscribeFrom(const QByteArray& filter_)
+{
+    setOption(OPT_UNSUBSCRIBE, filter_);
+}
+
+NZMQT_INLINE void ZMQSocket::setSendHighWaterMark(int value_)
+{
+    setOption(OPT_SNDHWM, value_);
+}
+
+NZMQT_INLINE void ZMQSocket::setReceiveHighWaterMark(int value_)
+{
+    setOption(OPT_RCVHWM, value_);
+}
+
+NZMQT_INLINE bool ZMQSocket::isConnected()
+{
+    return const_cast<ZMQSocket*>(this)->zmqsuper::connected();
+}
+
+NZMQT_INLINE void ZMQSocket::setCodec(const QSharedPointer<ZMQCodec>& codec_, int threshold_, int skipParts_)
+{
+    m_codec = codec_;
+    m_codecThreshold = threshold_;
+    m_codecSkipParts = skipParts_;
+    updateCodecSupport();
+}
+
+NZMQT_INLINE QSharedPointer<ZMQCodec> ZMQSocket::codec() const
+{
+    return m_codec;
+}
+
+NZMQT_INLINE ZMQMetrics ZMQSocket::metrics() const
+{
+    ZMQMetrics metrics;
+    metrics.messagesSent = m_counters[CNT_MESSAGESSENT].load(std::memory_order_relaxed);
+    metrics.bytesSent = m_counters[CNT_BYTESSENT].load(std::memory_order_relaxed);
+    metrics.framesSent = m_counters[CNT_FRAMESSENT].load(std::memory_order_relaxed);
+    metrics.sendFailures = m_counters[CNT_SENDFAILURES].load(std::memory_order_relaxed);
+    metrics.messagesReceived = m_counters[CNT_MESSAGESRECEIVED].load(std::memory_order_relaxed);
+    metrics.bytesReceived = m_counters[CNT_BYTESRECEIVED].load(std::memory_order_relaxed);
+    metrics.framesReceived = m_counters[CNT_FRAMESRECEIVED].load(std::memory_order_relaxed);
+    metrics.handlerCalls = m_counters[CNT_HANDLERCALLS].load(std::memory_order_relaxed);
+    metrics.handlerNsecs = m_counters[CNT_HANDLERNSECS].load(std::memory_order_relaxed);
+    return metrics;
+}
+
+NZMQT_INLINE void ZMQSocket::emitMessageReceived(const QList<QByteArray>& message_, qint64* dispatchStart_)
+{
+    NZMQT_TRACE_EVENT(dispatch, B, this);
+
+    // Messages sent from within the slots continue the received trace. A copy is used,
+    // since a slot may delete this socket.
+    ZMQTraceFrame*& currentTraceFrame = ZMQTraceFrame::currentFrame();
+    ZMQTraceFrame* previousTraceFrame = currentTraceFrame;
+    ZMQTraceFrame traceFrame;
+    if (m_traceFrameEnabled && m_receivedTraceFrame.isValid())
+    {
+        traceFrame = m_receivedTraceFrame;
+        currentTraceFrame = &traceFrame;
+    }
+
+    // A slot may delete this socket, e.g. a DEALER once its reply has arrived.
+    const QPointer<ZMQSocket> self(this);
+    ZMQContext* const context = m_context;
+
+#ifdef NZMQT_METRICS
+    QElapsedTimer handlerTimer;
+    handlerTimer.start();
+    if (m_messageHandler)
+        m_messageHandler(message_);
+    else
+        emit messageReceived(message_);
+    if (self)
+    {
+        count(CNT_HANDLERCALLS);
+        count(CNT_HANDLERNSECS, quint64(handlerTimer.nsecsElapsed()));
+    }
+#else
+    if (m_messageHandler)
+        m_messageHandler(message_);
+    else
+        emit messageReceived(message_);
+#endif
+
+    currentTraceFrame = previousTraceFrame;
+    NZMQT_TRACE_EVENT(dispatch, E, this);
+
+    if (!dispatchStart_ || *dispatchStart_ < 0)
+        return;
+
+    // The socket may have been deleted or closed by a connected slot. Its dispatch is
+    // not recorded then, but must not be blamed on the next socket either.
+    if (!self || !m_context)
+    {
+        *dispatchStart_ = context && context->stallThreshold() > 0 ? context->m_dispatchClock.nsecsElapsed() : -1;
+        return;
+    }
+
+    const qint64 threshold = m_context->stallThreshold();
+    if (threshold <= 0)
+    {
+        *dispatchStart_ = -1;
+        return;
+    }
+
+    const qint64 dispatchEnd = m_context->m_dispatchClock.nsecsElapsed();
+    const qint64 nsecs = dispatchEnd - *dispatchStart_;
+    *dispatchStart_ = dispatchEnd;
+
+    ++m_dispatchStatistics.dispatches;
+    m_dispatchStatistics.totalNsecs += nsecs;
+    if (nsecs > m_dispatchStatistics.maxNsecs)
+        m_dispatchStatistics.maxNsecs = nsecs;
+
+    if (nsecs >= threshold)
+    {
+        ++m_dispatchStatistics.stalls;
+        emit m_context->dispatchStall(this, nsecs);
+    }
+}
+
+NZMQT_INLINE void ZMQSocket::setTraceFrameEnabled(bool enabled_)
+{
+    m_traceFrameEnabled = enabled_;
+}
+
+NZMQT_INLINE bool ZMQSocket::isTraceFrameEnabled() const
+{
+    return m_traceFrameEnabled;
+}
+
+NZMQT_INLINE ZMQTraceFrame ZMQSocket::receivedTraceFrame() const
+{
+    return m_receivedTraceFrame;
+}
+
+NZMQT_INLINE void ZMQSocket::setMessageHandler(const MessageHandler& handler_)
+{
+    if (handler_ && receivers(SIGNAL(messageReceived(const QList<QByteArray>&))) > 0)
+        qWarning("Message handler of socket '%s' replaces the receivers of messageReceived()", qPrintable(objectName()));
+    m_messageHandler = handler_;
+}
+
+NZMQT_INLINE bool ZMQSocket::hasMessageHandler() const
+{
+    return bool(m_messageHandler);
+}
+
+NZMQT_INLINE qint64 ZMQSocket::dispatchClock() const
+{
+    return m_context ? m_context->dispatchClock() : -1;
+}
+
+NZMQT_INLINE ZMQDispatchStatistics ZMQSocket::dispatchStatistics() const
+{
+    return m_dispatchStatistics;
+}
+
+NZMQT_INLINE void ZMQSocket::resetDispatchStatistics()
+{
+    m_dispatchStatistics = ZMQDispatchStatistics();
+}
+
+NZMQT_INLINE void ZMQSocket::startMonitor(int events_)
+{
+    if (m_monitor || !m_context)
+        return;
+
+    const QByteArray address = "inproc://nzmqt-monitor-" + QByteArray::number(qulonglong(quintptr(this)));
+    if (0 != zmq_socket_monitor(static_cast<void*>(*this), address.constData(), events_))
+        throw ZMQException();
+
+    m_monitor = m_context->createSocket(TYP_PAIR, this);
+    m_monitor->setObjectName(objectName() + ".monitor");
+    m_monitor->connectTo(address.constData());
+    QObject::connect(m_monitor, &ZMQSocket::messageReceived, this, &ZMQSocket::receiveMonitorEvent);
+}
+
+NZMQT_INLINE void ZMQSocket::stopMonitor()
+{
+    if (!m_monitor)
+        return;
+
+    zmq_socket_monitor(static_cast<void*>(*this), nullptr, 0);
+
+    // The monitor socket might be dispatching the event which led to this call.
+    QObject::disconnect(m_monitor, nullptr, this, nullptr);
+    m_monitor->deleteLater();
+    m_monitor = nullptr;
+}
+
+NZMQT_INLINE bool ZMQSocket::isMonitored() const
+{
+    return nullptr != m_monitor;
+}
+
+NZMQT_INLINE void ZMQSocket::receiveMonitorEvent(const QList<QByteArray>& event_)
+{
+    // The first frame contains the event (16 bits) and its value (32 bits) in native
+    // byte order, the second one the endpoint.
+    if (event_.size() < 2 || event_[0].size() < int(sizeof(quint16) + sizeof(qint32)))
+        return;
+
+    quint16 event;
+    qint32 value;
+    memcpy(&event, event_[0].constData(), sizeof(event));
+    memcpy(&value, event_[0].constData() + sizeof(event), sizeof(value));
+    const QString endpoint = QString::fromUtf8(event_[1]);
+
+    emit monitorEvent(event, value, endpoint);
+
+    switch (event)
+    {
+    case ZMQ_EVENT_CONNECTED:
+        emit connected(endpoint);
+        break;
+    case ZMQ_EVENT_CONNECT_RETRIED:
+        emit connectRetried(endpoint, value);
+        break;
+    case ZMQ_EVENT_ACCEPTED:
+        emit accepted(endpoint);
+        break;
+    case ZMQ_EVENT_DISCONNECTED:
+        emit disconnected(endpoint);
+        break;
+#ifdef ZMQ_EVENT_HANDSHAKE_SUCCEEDED
+    case ZMQ_EVENT_HANDSHAKE_SUCCEEDED:
+        emit handshakeSucceeded(endpoint);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+NZMQT_INLINE void ZMQSocket::count(Counter counter_, quint64 value_)
+{
+    // A socket must only be used by one thread at a time, so there are no concurrent
+    // writers. A relaxed load and store avoids a locked read-modify-write instruction
+    // while readers on other threads still see consistent values.
+    std::atomic<quint64>& counter = m_counters[counter_];
+    counter.store(counter.load(std::memory_order_relaxed) + value_, std::memory_order_relaxed);
+}
+
+/*
+ * ZMQSocketProfile
+ */
+
+NZMQT_INLINE ZMQSocketProfile::ZMQSocketProfile(const QString& name_)
+    : m_name(name_)
+{
+}
+
+NZMQT_INLINE QString ZMQSocketProfile::name() const
+{
+    return m_name;
+}
+
+NZMQT_INLINE bool ZMQSocketProfile::isEmpty() const
+{
+    return m_values.isEmpty();
+}
+
+NZMQT_INLINE bool ZMQSocketProfile::contains(ZMQSocket::Option option_) const
+{
+    for (const auto& value : m_values)
+    {
+        if (value.first == option_)
+            return true;
+    }
+    return false;
+}
+
+NZMQT_INLINE qint64 ZMQSocketProfile::value(ZMQSocket::Option option_, qint64 defaultValue_) const
+{
+    for (const auto& value : m_values)
+    {
+        if (value.first == option_)
+            return value.second;
+    }
+    return defaultValue_;
+}
+
+NZMQT_INLINE ZMQSocketProfile& ZMQSocketProfile::setValue(ZMQSocket::Option option_, qint64 value_)
+{
+    for (auto& value : m_values)
+    {
+        if (value.first == option_)
+        {
+            value.second = value_;
+            return *this;
+        }
+    }
+    m_values.append(qMakePair(option_, value_));
+    return *this;
+}
+
+NZMQT_INLINE void ZMQSocketProfile::removeValue(ZMQSocket::Option option_)
+{
+    for (int i = 0; i < m_values.size(); ++i)
+    {
+        if (m_values[i].first == option_)
+        {
+            m_values.removeAt(i);
+            return;
+        }
+    }
+}
+
+NZMQT_INLINE QList<ZMQSocket::Option> ZMQSocketProfile::options() const
+{
+    QList<ZMQSocket::Option> options;
+    for (const auto& value : m_values)
+        options << value.first;
+    return options;
+}
+
+NZMQT_INLINE ZMQSocketProfile& ZMQSocketProfile::operator+=(const ZMQSocketProfile& other_)
+{
+    for (const auto& value : other_.m_values)
+        setValue(value.first, value.second);
+    if (m_name.isEmpty())
+        m_name = other_.m_name;
+    return *this;
+}
+
+NZMQT_INLINE ZMQSocketProfile ZMQSocketProfile::operator+(const ZMQSocketProfile& other_) const
+{
+    ZMQSocketProfile result(*this);
+    result += other_;
+    return result;
+}
+
+NZMQT_INLINE void ZMQSocketProfile::applyTo(ZMQSocket* socket_) const
+{
+    for (const auto& value : m_values)
+    {
+        try
+        {
+            // Options have the size 0MQ expects, which is not int for all of them.
+            switch (value.first)
+            {
+            case ZMQSocket::OPT_AFFINITY:
+                socket_->setOption(value.first, quint64(value.second));
+                break;
+            case ZMQSocket::OPT_MAXMSGSIZE:
+                socket_->setOption(value.first, qint64(value.second));
+                break;
+            default:
+                socket_->setOption(value.first, int(value.second));
+                break;
+            }
+        }
+        catch (const ZMQException& ex)
+        {
+            qWarning("Cannot apply option %d of socket profile '%s': %s",
+                     int(value.first), qPrintable(m_name), ex.what());
+        }
+    }
+}
+
+NZMQT_INLINE ZMQSocketProfile ZMQSocketProfile::lowLatency()
+{
+    ZMQSocketProfile profile("low-latency");
+    profile.setValue(ZMQSocket::OPT_SNDHWM, 100);
+    profile.setValue(ZMQSocket::OPT_RCVHWM, 100);
+#ifdef ZMQ_IMMEDIATE
+    profile.setValue(ZMQSocket::OPT_IMMEDIATE, 1);
+#endif
+    profile.setValue(ZMQSocket::OPT_LINGER, 0);
+    return profile;
+}
+
+NZMQT_INLINE ZMQSocketProfile ZMQSocketProfile::bulkThroughput()
+{
+    ZMQSocketProfile profile("bulk-throughput");
+    profile.setValue(ZMQSocket::OPT_SNDHWM, 100000);
+    profile.setValue(ZMQSocket::OPT_RCVHWM, 100000);
+    profile.setValue(ZMQSocket::OPT_SNDBUF, 4 * 1024 * 1024);
+    profile.setValue(ZMQSocket::OPT_RCVBUF, 4 * 1024 * 1024);
+    return profile;
+}
+
+NZMQT_INLINE ZMQSocketProfile ZMQSocketProfile::manyIdlePeers()
+{
+    ZMQSocketProfile profile("many-idle-peers");
+    profile.setValue(ZMQSocket::OPT_SNDHWM, 100);
+    profile.setValue(ZMQSocket::OPT_RCVHWM, 100);
+    profile.setValue(ZMQSocket::OPT_SNDBUF, 64 * 1024);
+    profile.setValue(ZMQSocket::OPT_RCVBUF, 64 * 1024);
+    profile.setValue(ZMQSocket::OPT_BACKLOG, 1024);
+    profile.setValue(ZMQSocket::OPT_RECONNECT_IVL, 1000);
+    profile.setValue(ZMQSocket::OPT_RECONNECT_IVL_MAX, 30000);
+    profile.setValue(ZMQSocket::OPT_LINGER, 0);
+    return profile;
+}
+
+NZMQT_INLINE ZMQSocketProfile ZMQSocketProfile::preset(const QString& name_)
+{
+    if (name_ == QLatin1String("low-latency"))
+        return lowLatency();
+    if (name_ == QLatin1String("bulk-throughput"))
+        return bulkThroughput();
+    if (name_ == QLatin1String("many-idle-peers"))
+        return manyIdlePeers();
+    return ZMQSocketProfile();
+}
+
+NZMQT_INLINE int ZMQSocketProfile::optionFromName(const QString& name_)
+{
+    struct SocketProfileOption
+    {
+        const char* name;
+        ZMQSocket::Option option;
+    };
+
+    static const SocketProfileOption socketProfileOptions[] =
+    {
+        { "affinity", ZMQSocket::OPT_AFFINITY },
+        { "rate", ZMQSocket::OPT_RATE },
+        { "recovery_ivl", ZMQSocket::OPT_RECOVERY_IVL },
+        { "sndbuf", ZMQSocket::OPT_SNDBUF },
+        { "rcvbuf", ZMQSocket::OPT_RCVBUF },
+        { "linger", ZMQSocket::OPT_LINGER },
+        { "reconnect_ivl", ZMQSocket::OPT_RECONNECT_IVL },
+        { "reconnect_ivl_max", ZMQSocket::OPT_RECONNECT_IVL_MAX },
+        { "backlog", ZMQSocket::OPT_BACKLOG },
+        { "maxmsgsize", ZMQSocket::OPT_MAXMSGSIZE },
+        { "sndhwm", ZMQSocket::OPT_SNDHWM },
+        { "rcvhwm", ZMQSocket::OPT_RCVHWM },
+        { "sndtimeo", ZMQSocket::OPT_SNDTIMEO },
+        { "rcvtimeo", ZMQSocket::OPT_RCVTIMEO },
+#ifdef ZMQ_IMMEDIATE
+        { "immediate", ZMQSocket::OPT_IMMEDIATE },
+#endif
+#ifdef ZMQ_IPV6
+        { "ipv6", ZMQSocket::OPT_IPV6 },
+#endif
+#ifdef ZMQ_CONFLATE
+        { "conflate", ZMQSocket::OPT_CONFLATE },
+#endif
+#ifdef ZMQ_TOS
+        { "tos", ZMQSocket::OPT_TOS },
+#endif
+    };
+
+    for (const SocketProfileOption& option : socketProfileOptions)
+    {
+        if (name_ == QLatin1String(option.name))
+            return option.option;
+    }
+    return -1;
+}
+
+NZMQT_INLINE bool ZMQSocketProfile::load(const QString& fileName_, QList<ZMQSocketProfile>* profiles_,
+                                         QMap<QString, ZMQSocketProfile>* endpointProfiles_)
+{
+    QSettings settings(fileName_, QSettings::IniFormat);
+    if (!QFileInfo(fileName_).isReadable() || settings.status() != QSettings::NoError)
+    {
+        qWarning("Cannot read socket profiles '%s'", qPrintable(fileName_));
+        return false;
+    }
+
+    const QStringList groups = settings.childGroups();
+    QMap<QString, ZMQSocketProfile> loaded;
+    QStringList resolving;
+    bool ok = true;
+
+    // Profiles may be based on profiles of the file defined further down, so they
+    // are resolved recursively.
+    std::function<ZMQSocketProfile(const QString&)> resolve = [&](const QString& name_) -> ZMQSocketProfile
+    {
+        if (loaded.contains(name_))
+            return loaded.value(name_);
+
+        if (!groups.contains(name_))
+        {
+            ZMQSocketProfile profile = preset(name_);
+            if (profile.isEmpty())
+            {
+                qWarning("Unknown socket profile '%s' in '%s'", qPrintable(name_), qPrintable(fileName_));
+                ok = false;
+            }
+            return profile;
+        }
+
+        if (resolving.contains(name_))
+        {
+            qWarning("Socket profile '%s' in '%s' is based on itself", qPrintable(name_), qPrintable(fileName_));
+            ok = false;
+            return ZMQSocketProfile(name_);
+        }
+        resolving << name_;
+
+        ZMQSocketProfile profile(name_);
+        const QStringList bases = settings.value(name_ + "/base").toStringList();
+        for (const QString& base : bases)
+            profile += resolve(base.trimmed());
+
+        settings.beginGroup(name_);
+        for (const QString& key : settings.childKeys())
+        {
+            if (key == QLatin1String("base") || key == QLatin1String("endpoints"))
+                continue;
+
+            const int option = optionFromName(key);
+            bool valid = false;
+            const qint64 value = settings.value(key).toLongLong(&valid);
+            if (option < 0 || !valid)
+            {
+                qWarning("Invalid socket profile entry '%s/%s' in '%s'",
+                         qPrintable(name_), qPrintable(key), qPrintable(fileName_));
+                ok = false;
+                continue;
+            }
+            profile.setValue(ZMQSocket::Option(option), value);
+        }
+        settings.endGroup();
+
+        resolving.removeLast();
+        loaded.insert(name_, profile);
+        return profile;
+    };
+
+    QList<ZMQSocketProfile> profiles;
+    QMap<QString, ZMQSocketProfile> endpointProfiles;
+    for (const QString& group : groups)
+    {
+        const ZMQSocketProfile profile = resolve(group);
+        profiles << profile;
+        for (const QString& endpoint : settings.value(group + "/endpoints").toStringList())
+            endpointProfiles.insert(endpoint.trimmed(), profile);
+    }
+
+    if (!ok)
+        return false;
+
+    if (profiles_)
+        *profiles_ = profiles;
+    if (endpointProfiles_)
+        *endpointProfiles_ = endpointProfiles;
+    return true;
+}
+
+
+
+/*
+ * ZMQContext
+ */
+
+NZMQT_INLINE ZMQContext::ZMQContext(QObject* parent_, int io_threads_)
+    : qsuper(parent_)
+    , zmqsuper(io_threads_)
+    , m_stallThreshold(0)
+    , m_socketsCreated(0)
+{
+    m_dispatchClock.start();
+}
+
+NZMQT_INLINE ZMQContext::~ZMQContext()
+{
+//    qDebug() << Q_FUNC_INFO << "Sockets:" << m_sockets;
+    for(ZMQSocket* socket : registeredSockets())
+    {
+        socket->m_context = nullptr;
+        // As stated by 0MQ, close() must ONLY be called from the thread
+        // owning the socket. So we use 'invokeMethod' which (hopefully)
+        // results in a 'close' call from within the socket's thread.
+        // Sockets of the current thread are closed directly.
+        if (socket->thread() == QThread::currentThread())
+            socket->close();
+        else
+            QMetaObject::invokeMethod(socket, "close");
+    }
+}
+
+NZMQT_INLINE void ZMQContext::setOption(Option option_, int value_)
+{
+    if (m_socketsCreated.loadAcquire())
+        qWarning("Context option %d has no effect once sockets have been created", int(option_));
+
+    if (zmq_ctx_set(static_cast<void*>(*this), option_, value_) != 0)
+        throw ZMQException();
+}
+
+NZMQT_INLINE int ZMQContext::option(Option option_) const
+{
+    const int value = zmq_ctx_get(const_cast<void*>(static_cast<const void*>(*this)), option_);
+    if (value < 0)
+        throw ZMQException();
+    return value;
+}
+
+NZMQT_INLINE void ZMQContext::setIoThreadCpus(const QList<int>& cpus_)
+{
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+    for (int cpu : cpus_)
+        setOption(OPT_THREAD_AFFINITY_CPU_ADD, cpu);
+#else
+    Q_UNUSED(cpus_);
+    errno = ENOTSUP;
+    throw ZMQException();
+#endif
+}
+
+NZMQT_INLINE void ZMQContext::setIoThreadPriority(int schedPolicy_, int priority_)
+{
+#if defined(ZMQ_THREAD_SCHED_POLICY) && defined(ZMQ_THREAD_PRIORITY)
+    setOption(OPT_THREAD_SCHED_POLICY, schedPolicy_);
+    setOption(OPT_THREAD_PRIORITY, priority_);
+#else
+    Q_UNUSED(schedPolicy_);
+    Q_UNUSED(priority_);
+    errno = ENOTSUP;
+    throw ZMQException();
+#endif
+}
+
+NZMQT_INLINE int ZMQContext::ioThreads() const
+{
+    return option(OPT_IO_THREADS);
+}
+
+NZMQT_INLINE int ZMQContext::socketLimit() const
+{
+#ifdef ZMQ_SOCKET_LIMIT
+    return option(OPT_SOCKET_LIMIT);
+#else
+    return -1;
+#endif
+}
+
+NZMQT_INLINE void ZMQContext::setStallThreshold(qint64 nsecs_)
+{
+    m_stallThreshold.store(qMax(nsecs_, qint64(0)));
+}
+
+NZMQT_INLINE qint64 ZMQContext::stallThreshold() const
+{
+    return m_stallThreshold.load();
+}
+
+NZMQT_INLINE void ZMQContext::setSocketProfile(const ZMQSocketProfile& profile_)
+{
+    QMutexLocker lock(&m_profilesMutex);
+
+    m_socketProfile = profile_;
+}
+
+NZMQT_INLINE ZMQSocketProfile ZMQContext::socketProfile() const
+{
+    QMutexLocker lock(&m_profilesMutex);
+
+    return m_socketProfile;
+}
+
+NZMQT_INLINE void ZMQContext::setEndpointProfile(const QString& endpointPrefix_, const ZMQSocketProfile& profile_)
+{
+    QMutexLocker lock(&m_profilesMutex);
+
+    if (profile_.isEmpty())
+        m_endpointProfiles.remove(endpointPrefix_);
+    else
+        m_endpointProfiles.insert(endpointPrefix_, profile_);
+}
+
+NZMQT_INLINE ZMQSocketProfile ZMQContext::endpointProfile(const QString& addr_) const
+{
+    QMutexLocker lock(&m_profilesMutex);
+
+    ZMQSocketProfile profile;
+    int prefixLength = -1;
+    for (auto it = m_endpointProfiles.constBegin(); it != m_endpointProfiles.constEnd(); ++it)
+    {
+        if (it.key().size() > prefixLength && addr_.startsWith(it.key()))
+        {
+            profile = it.value();
+            prefixLength = it.key().size();
+        }
+    }
+    return profile;
+}
+
+NZMQT_INLINE bool ZMQContext::loadSocketProfiles(const QString& fileName_)
+{
+    QList<ZMQSocketProfile> profiles;
+    QMap<QString, ZMQSocketProfile> endpointProfiles;
+    if (!ZMQSocketProfile::load(fileName_, &profiles, &endpointProfiles))
+        return false;
+
+    QMutexLocker lock(&m_profilesMutex);
+
+    for (const ZMQSocketProfile& profile : profiles)
+    {
+        if (profile.name() == QLatin1String("default"))
+            m_socketProfile = profile;
+    }
+    for (auto it = endpointProfiles.constBegin(); it != endpointProfiles.constEnd(); ++it)
+        m_endpointProfiles.insert(it.key(), it.value());
+    return true;
+}
+
+NZMQT_INLINE qint64 ZMQContext::dispatchClock() const
+{
+    return stallThreshold() > 0 ? m_dispatchClock.nsecsElapsed() : -1;
+}
+
+NZMQT_INLINE ZMQSocket* ZMQContext::createSocket(ZMQSocket::Type type_, QObject* parent_)
+{
+    ZMQSocket* socket = createSocketInternal(type_);
+    m_socketsCreated.storeRelease(1);
+    socketProfile().applyTo(socket);
+    registerSocket(socket);
+    socket->setParent(parent_);
+    return socket;
+}
+
+NZMQT_INLINE ZMQMetrics ZMQContext::metrics() const
+{
+    QMutexLocker lock(&m_socketsMutex);
+
+    ZMQMetrics metrics = m_closedSocketMetrics;
+    for (const ZMQSocket* socket : m_sockets)
+        metrics += socket->metrics();
+    return metrics;
+}
+
+NZMQT_INLINE void ZMQContext::registerSocket(ZMQSocket* socket_)
+{
+    QMutexLocker lock(&m_socketsMutex);
+
+    socket_->m_registryIndex = m_sockets.size();
+    m_sockets.push_back(socket_);
+}
+
+NZMQT_INLINE void ZMQContext::unregisterSocket(ZMQSocket* socket_)
+{
+    QMutexLocker lock(&m_socketsMutex);
+
+    // Each socket knows its index, so it is removed in constant time
+    // by moving the last socket into its place.
+    const int index = socket_->m_registryIndex;
+    if (index < 0 || index >= m_sockets.size() || m_sockets[index] != socket_)
+        return;
+
+    m_closedSocketMetrics += socket_->metrics();
+    ZMQSocket* last = m_sockets.last();
+    m_sockets[index] = last;
+    last->m_registryIndex = index;
+    m_sockets.removeLast();
+    socket_->m_registryIndex = -1;
+}
+
+NZMQT_INLINE const ZMQContext::Sockets& ZMQContext::registeredSockets() const
+{
+    return m_sockets;
+}
+
+
+
+/*
+ * ZMQDevice
+ */
+/*
+NZMQT_INLINE ZMQDevice::ZMQDevice(Type type, ZMQSocket* frontend, ZMQSocket* backend)
+    : type_(type)
+    , frontend_(frontend)
+    , backend_(backend)
+{
+}
+
+NZMQT_INLINE void ZMQDevice::run()
+{
+    zmq::device(type_, *frontend_, *backend_);
+}
+*/
+
+
+/*
+ * PollingZMQSocket
+ */
+
+NZMQT_INLINE PollingZMQSocket::PollingZMQSocket(PollingZMQContext* context_, Type type_)
+    : super(context_, type_)
+{
+}
+
+
+/*
+ * PollingZMQContext
+ */
+
+NZMQT_INLINE PollingZMQContext::PollingZMQContext(QObject* parent_, int io_threads_)
+    : super(parent_, io_threads_)
+    , m_pollItemsMutex(QMutex::Recursive)
+    , m_interval(NZMQT_POLLINGZMQCONTEXT_DEFAULT_POLLINTERVAL)
+    , m_stopped(false)
+{
+    setAutoDelete(false);
+}
+
+NZMQT_INLINE void PollingZMQContext::setInterval(int interval_)
+{
+    m_interval = interval_;
+}
+
+NZMQT_INLINE int PollingZMQContext::getInterval() const
+{
+    return m_interval;
+}
+
+NZMQT_INLINE void PollingZMQContext::start()
+{
+    m_stopped = false;
+    QTimer::singleShot(0, this, &PollingZMQContext::run);
+}
+
+NZMQT_INLINE void PollingZMQContext::stop()
+{
+    m_stopped = true;
+}
+
+NZMQT_INLINE bool PollingZMQContext::isStopped() const
+{
+    return m_stopped;
+}
+
+NZMQT_INLINE void PollingZMQContext::run()
+{
+    if (m_stopped)
+        return;
+
+    try
+    {
+        poll();
+    }
+    catch (const ZMQException& ex)
+    {
+        qWarning("Exception during poll: %s", ex.what());
+        emit pollError(ex.num(), ex.what());
+    }
+
+    if (!m_stopped)
+        QTimer::singleShot(m_interval, this, &PollingZMQContext::run);
+}
+
+NZMQT_INLINE void PollingZMQContext::poll(long timeout_)
+{
+    int cnt;
+    do {
+        QMutexLocker lock(&m_pollItemsMutex);
+
+        if (m_pollItems.empty())
+            return;
+
+        NZMQT_TRACE_EVENT(poll, B, this);
+        cnt = zmq::poll(&m_pollItems[0], m_pollItems.size(), timeout_);
+        NZMQT_TRACE_EVENT(poll, E, this);
+        Q_ASSERT_X(cnt >= 0, Q_FUNC_INFO, "A value < 0 should be reflected by an exception.");
+        if (0 == cnt)
+            return;
+
+        // Each dispatch starts where the previous one ended.
+        qint64 dispatchStart = dispatchClock();
+        // Slots may create or close sockets, which changes the poll-items, so they are
+        // accessed by index. A socket moved to an index already visited is polled again
+        // in the next round.
+        int i = 0;
+        for (int index = 0; i < cnt && index < m_pollItems.size(); ++index)
+        {
+            if (m_pollItems[index].revents & ZMQSocket::EVT_POLLIN)
+            {
+                m_pollItems[index].revents = 0;
+                PollingZMQSocket* socket = static_cast<PollingZMQSocket*>(registeredSockets()[index]);
+                const QList<QByteArray> & message = socket->receiveMessage();
+                NZMQT_TRACE_EVENT(dequeue, i, socket);
+                socket->emitMessageReceived(message, &dispatchStart);
+                i++;
+            }
+        }
+    } while (cnt > 0);
+}
+
+NZMQT_INLINE PollingZMQSocket* PollingZMQContext::createSocketInternal(ZMQSocket::Type type_)
+{
+    return new PollingZMQSocket(this, type_);
+}
+
+NZMQT_INLINE void PollingZMQContext::registerSocket(ZMQSocket* socket_)
+{
+    pollitem_t pollItem = { *socket_, 0, ZMQSocket::EVT_POLLIN, 0 };
+
+    QMutexLocker lock(&m_pollItemsMutex);
+
+    m_pollItems.push_back(pollItem);
+
+    super::registerSocket(socket_);
+}
+
+NZMQT_INLINE void PollingZMQContext::unregisterSocket(ZMQSocket* socket_)
+{
+    QMutexLocker lock(&m_pollItemsMutex);
+
+    // Mirror the removal done by the base class, which moves the last socket into the gap.
+    const int index = socket_->m_registryIndex;
+    if (index >= 0 && index < m_pollItems.size() && registeredSockets()[index] == socket_)
+    {
+        m_pollItems[index] = m_pollItems.last();
+        m_pollItems.removeLast();
+    }
+
+    super::unregisterSocket(socket_);
+}
+
+
+
+/*
+ * SocketNotifierZMQSocket
+ */
+
+NZMQT_INLINE SocketNotifierZMQSocket::SocketNotifierZMQSocket(ZMQContext* context_, Type type_)
+    : super(context_, type_)
+    , socketNotifyRead_(0)
+    , socketNotifyWrite_(0)
+{
+    qintptr fd = fileDescriptor();
+
+    socketNotifyRead_ = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    QObject::connect(socketNotifyRead_, &QSocketNotifier::activated, this, &SocketNotifierZMQSocket::socketReadActivity);
+
+    socketNotifyWrite_ = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+    QObject::connect(socketNotifyWrite_, &QSocketNotifier::activated, this, &SocketNotifierZMQSocket::socketWriteActivity);
+}
+
+NZMQT_INLINE SocketNotifierZMQSocket::~SocketNotifierZMQSocket()
+{
+    close();
+}
+
+NZMQT_INLINE void SocketNotifierZMQSocket::close()
+{
+    socketNotifyRead_->deleteLater();
+    socketNotifyWrite_->deleteLater();
+    super::close();
+}
+
+NZMQT_INLINE void SocketNotifierZMQSocket::socketReadActivity()
+{
+    socketNotifyRead_->setEnabled(false);
+    NZMQT_TRACE_EVENT(activity, B, this);
+
+    try
+    {
+        qint64 dispatchStart = dispatchClock();
+        while(isConnected() && (events() & EVT_POLLIN))
+        {
+            const QList<QByteArray> & message = receiveMessage();
+            NZMQT_TRACE_EVENT(dequeue, i, this);
+            emitMessageReceived(message, &dispatchStart);
+        }
+    }
+    catch (const ZMQException& ex)
+    {
+        qWarning("Exception during read: %s", ex.what());
+        emit notifierError(ex.num(), ex.what());
+    }
+
+    NZMQT_TRACE_EVENT(activity, E, this);
+    socketNotifyRead_->setEnabled(true);
+}
+
+NZMQT_INLINE void SocketNotifierZMQSocket::socketWriteActivity()
+{
+    socketNotifyWrite_->setEnabled(false);
+    NZMQT_TRACE_EVENT(activity, B, this);
+
+    try
+    {
+        qint64 dispatchStart = dispatchClock();
+        while (isConnected() && (events() & EVT_POLLIN))
+        {
+            const QList<QByteArray> & message = receiveMessage();
+            NZMQT_TRACE_EVENT(dequeue, i, this);
+            emitMessageReceived(message, &dispatchStart);
+        }
+    }
+    catch (const ZMQException& ex)
+    {
+        qWarning("Exception during write: %s", ex.what());
+        emit notifierError(ex.num(), ex.what());
+    }
+
+    NZMQT_TRACE_EVENT(activity, E, this);
+    socketNotifyWrite_->setEnabled(true);
+}
+
+
+
+/*
+ * SocketNotifierZMQContext
+ */
+
+NZMQT_INLINE SocketNotifierZMQContext::SocketNotifierZMQContext(QObject* parent_, int io_threads_)
+    : super(parent_, io_threads_)
+{
+}
+
+NZMQT_INLINE void SocketNotifierZMQContext::start()
+{
+}
+
+NZMQT_INLINE void SocketNotifierZMQContext::stop()
+{
+}
+
+NZMQT_INLINE bool SocketNotifierZMQContext::isStopped() const
+{
+    return false;
+}
+
+NZMQT_INLINE SocketNotifierZMQSocket* SocketNotifierZMQContext::createSocketInternal(ZMQSocket::Type type_)
+{
+    SocketNotifierZMQSocket *socket = new SocketNotifierZMQSocket(this, type_);
+    connect(socket, &SocketNotifierZMQSocket::notifierError,
+            this, &SocketNotifierZMQContext::notifierError);
+    return socket;
+}
+
+
+
+
+/*
+ * BusyPollingZMQSocket
+ */
+
+NZMQT_INLINE BusyPollingZMQSocket::BusyPollingZMQSocket(BusyPollingZMQContext* context_, Type type_)
+    : super(context_, type_)
+{
+}
+
+
+
+/*
+ * BusyPollingZMQContext
+ */
+
+NZMQT_INLINE BusyPollingZMQContext::PollThread::PollThread(BusyPollingZMQContext* context_)
+    : m_context(context_)
+{
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::PollThread::run()
+{
+    m_context->pollLoop();
+}
+
+NZMQT_INLINE BusyPollingZMQContext::BusyPollingZMQContext(QObject* parent_, int io_threads_)
+    : super(parent_, io_threads_)
+    , m_pollItemsMutex(QMutex::Recursive)
+    , m_wakeSender(nullptr)
+    , m_wakeReceiver(nullptr)
+    , m_pollItemsWaiters(0)
+    , m_spinBudget(NZMQT_BUSYPOLLINGZMQCONTEXT_DEFAULT_SPINBUDGET)
+    , m_cpu(-1)
+    , m_stopped(1)
+    , m_thread(nullptr)
+{
+    const QByteArray address = "inproc://nzmqt-busy-polling-wake-" + QByteArray::number(qulonglong(quintptr(this)));
+    const int linger = 0;
+    m_wakeReceiver = zmq_socket(static_cast<void*>(*this), ZMQ_PAIR);
+    m_wakeSender = zmq_socket(static_cast<void*>(*this), ZMQ_PAIR);
+    if (!m_wakeReceiver || !m_wakeSender
+        || 0 != zmq_setsockopt(m_wakeSender, ZMQ_LINGER, &linger, sizeof(linger))
+        || 0 != zmq_bind(m_wakeReceiver, address.constData())
+        || 0 != zmq_connect(m_wakeSender, address.constData()))
+    {
+        const ZMQException ex;
+        if (m_wakeSender)
+            zmq_close(m_wakeSender);
+        if (m_wakeReceiver)
+            zmq_close(m_wakeReceiver);
+        throw ex;
+    }
+
+    pollitem_t pollItem = { m_wakeReceiver, 0, ZMQSocket::EVT_POLLIN, 0 };
+    m_pollItems.push_back(pollItem);
+}
+
+NZMQT_INLINE BusyPollingZMQContext::~BusyPollingZMQContext()
+{
+    stop();
+    delete m_thread;
+    // 0MQ's context cannot be terminated before all of its sockets are closed.
+    zmq_close(m_wakeSender);
+    zmq_close(m_wakeReceiver);
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::setSpinBudget(qint64 nsecs_)
+{
+    m_spinBudget.store(qMax(nsecs_, qint64(0)));
+}
+
+NZMQT_INLINE qint64 BusyPollingZMQContext::spinBudget() const
+{
+    return m_spinBudget.load();
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::setCpu(int cpu_)
+{
+    m_cpu = cpu_;
+}
+
+NZMQT_INLINE int BusyPollingZMQContext::cpu() const
+{
+    return m_cpu;
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::setMessageHandler(const MessageHandler& handler_)
+{
+    Q_ASSERT_X(isStopped(), Q_FUNC_INFO, "The message handler must not be changed while polling.");
+    m_messageHandler = handler_;
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::start()
+{
+    if (m_thread && m_thread->isRunning())
+        return;
+
+    if (!m_thread)
+        m_thread = new PollThread(this);
+    m_stopped.storeRelease(0);
+    m_thread->start();
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::stop()
+{
+    m_stopped.storeRelease(1);
+    if (m_thread && QThread::currentThread() != m_thread)
+        m_thread->wait();
+}
+
+NZMQT_INLINE bool BusyPollingZMQContext::isStopped() const
+{
+    return m_stopped.loadAcquire();
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::pollLoop()
+{
+#ifdef Q_OS_LINUX
+    if (m_cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_cpu, &cpus);
+        const int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (rc != 0)
+            qWarning("Cannot pin polling thread to CPU %d: %s", m_cpu, strerror(rc));
+    }
+#else
+    if (m_cpu >= 0)
+        qWarning("Cannot pin polling thread to CPU %d: not supported", m_cpu);
+#endif
+
+    QElapsedTimer idleTimer;
+    idleTimer.start();
+    int errors = 0;
+    while (!m_stopped.loadAcquire())
+    {
+        const bool spinning = idleTimer.nsecsElapsed() < spinBudget();
+        try
+        {
+            if (poll(spinning ? 0 : NZMQT_BUSYPOLLINGZMQCONTEXT_BLOCKTIMEOUT))
+                idleTimer.start();
+            errors = 0;
+        }
+        catch (const ZMQException& ex)
+        {
+            qWarning("Exception during poll: %s", ex.what());
+            emit pollError(ex.num(), ex.what());
+
+            // Polling a terminated context fails for good.
+            if (ETERM == ex.num())
+            {
+                m_stopped.storeRelease(1);
+                break;
+            }
+            // Errors persisting from one poll to the next are retried less and less often,
+            // up to once per second.
+            errors = qMin(errors + 1, 100);
+            QThread::msleep(errors * NZMQT_BUSYPOLLINGZMQCONTEXT_BLOCKTIMEOUT);
+        }
+    }
+}
+
+NZMQT_INLINE bool BusyPollingZMQContext::poll(long timeout_)
+{
+    // Let threads which have woken this one up take their turn.
+    if (m_pollItemsWaiters.loadAcquire() > 0)
+    {
+        QThread::yieldCurrentThread();
+        return false;
+    }
+
+    QMutexLocker lock(&m_pollItemsMutex);
+
+    // 0MQ's poll blocks on the wake-up socket even if there are no other sockets.
+    NZMQT_TRACE_EVENT(poll, B, this);
+    const int cnt = zmq::poll(&m_pollItems[0], m_pollItems.size(), timeout_);
+    NZMQT_TRACE_EVENT(poll, E, this);
+    if (0 == cnt)
+        return false;
+
+    if (m_pollItems[0].revents & ZMQSocket::EVT_POLLIN)
+    {
+        m_pollItems[0].revents = 0;
+        zmq_msg_t wakeUp;
+        zmq_msg_init(&wakeUp);
+        while (zmq_msg_recv(&wakeUp, m_wakeReceiver, ZMQ_DONTWAIT) >= 0)
+            ;
+        zmq_msg_close(&wakeUp);
+        if (1 == cnt)
+            return false;
+    }
+
+    qint64 dispatchStart = dispatchClock();
+    for (int index = 1; index < m_pollItems.size(); ++index)
+    {
+        if (!(m_pollItems[index].revents & ZMQSocket::EVT_POLLIN))
+            continue;
+        m_pollItems[index].revents = 0;
+
+        // Drain the socket, as long as the handler neither closes nor moves it.
+        ZMQSocket* socket = registeredSockets()[index - 1];
+        while (index - 1 < registeredSockets().size() && registeredSockets()[index - 1] == socket)
+        {
+            const QList<QByteArray> message = socket->receiveMessage();
+            if (message.isEmpty())
+                break;
+            NZMQT_TRACE_EVENT(dequeue, i, socket);
+            if (m_messageHandler)
+                m_messageHandler(socket, message);
+            else
+                socket->emitMessageReceived(message, &dispatchStart);
+        }
+    }
+    return true;
+}
+
+NZMQT_INLINE BusyPollingZMQSocket* BusyPollingZMQContext::createSocketInternal(ZMQSocket::Type type_)
+{
+    return new BusyPollingZMQSocket(this, type_);
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::wakePollThread()
+{
+    QMutexLocker lock(&m_wakeSenderMutex);
+
+    // A pending wake-up is good enough, so a full queue is ignored.
+    zmq_send(m_wakeSender, "", 0, ZMQ_DONTWAIT);
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::registerSocket(ZMQSocket* socket_)
+{
+    pollitem_t pollItem = { *socket_, 0, ZMQSocket::EVT_POLLIN, 0 };
+
+    const bool waiting = QThread::currentThread() != m_thread;
+    if (waiting)
+    {
+        m_pollItemsWaiters.fetchAndAddOrdered(1);
+        wakePollThread();
+    }
+    {
+        QMutexLocker lock(&m_pollItemsMutex);
+
+        m_pollItems.push_back(pollItem);
+
+        super::registerSocket(socket_);
+    }
+    if (waiting)
+        m_pollItemsWaiters.fetchAndAddOrdered(-1);
+}
+
+NZMQT_INLINE void BusyPollingZMQContext::unregisterSocket(ZMQSocket* socket_)
+{
+    const bool waiting = QThread::currentThread() != m_thread;
+    if (waiting)
+    {
+        m_pollItemsWaiters.fetchAndAddOrdered(1);
+        wakePollThread();
+    }
+    {
+        QMutexLocker lock(&m_pollItemsMutex);
+
+        // Mirror the removal done by the base class, which moves the last socket into the
+        // gap, behind the wake-up socket's item.
+        const int index = socket_->m_registryIndex;
+        if (index >= 0 && index + 1 < m_pollItems.size() && registeredSockets()[index] == socket_)
+        {
+            m_pollItems[index + 1] = m_pollItems.last();
+            m_pollItems.removeLast();
+        }
+
+        super::unregisterSocket(socket_);
+    }
+    if (waiting)
+        m_pollItemsWaiters.fetchAndAddOrdered(-1);
+}
+
+
+
+/*
+ * ZMQTopicDispatcher
+ */
+
+NZMQT_INLINE ZMQTopicDispatcher::ZMQTopicDispatcher(ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_socket(socket_)
+    , m_nodes(1)
+    , m_nextId(0)
+    , m_dispatchDepth(0)
+{
+    connect(m_socket, &ZMQSocket::messageReceived, this, &ZMQTopicDispatcher::dispatch);
+}
+
+NZMQT_INLINE ZMQSocket* ZMQTopicDispatcher::socket() const
+{
+    return m_socket;
+}
+
+NZMQT_INLINE ZMQTopicDispatcher::HandlerId ZMQTopicDispatcher::addHandler(const QByteArray& prefix_, const Handler& handler_)
+{
+    Registration registration = { m_nextId++, handler_, false };
+    m_prefixes.insert(registration.id, prefix_);
+
+    if (m_dispatchDepth > 0)
+    {
+        // Inserting now could reallocate the handler being executed.
+        PendingHandler pending = { prefix_, registration };
+        m_pendingHandlers.push_back(pending);
+    }
+    else
+    {
+        insertHandler(prefix_, registration);
+    }
+
+    return registration.id;
+}
+
+NZMQT_INLINE bool ZMQTopicDispatcher::removeHandler(HandlerId id_)
+{
+    QHash<HandlerId, QByteArray>::iterator prIt = m_prefixes.find(id_);
+    if (prIt == m_prefixes.end())
+        return false;
+
+    const QByteArray prefix = prIt.value();
+    m_prefixes.erase(prIt);
+
+    for (int i = 0; i < m_pendingHandlers.size(); ++i)
+    {
+        if (m_pendingHandlers[i].registration.id == id_)
+        {
+            m_pendingHandlers.remove(i);
+            return true;
+        }
+    }
+
+    int nodeIdx = findNode(prefix);
+    Q_ASSERT_X(nodeIdx >= 0, Q_FUNC_INFO, "A registered prefix must have a node.");
+    Node& node = m_nodes[nodeIdx];
+
+    for (int i = 0; i < node.handlers.size(); ++i)
+    {
+        Registration& registration = node.handlers[i];
+        if (registration.id != id_ || registration.removed)
+            continue;
+
+        if (m_dispatchDepth > 0)
+        {
+            // The handler might currently be executing, so only mark it as removed
+            // and erase it after dispatching has finished.
+            registration.removed = true;
+            m_dirtyNodes.push_back(nodeIdx);
+        }
+        else
+        {
+            node.handlers.remove(i);
+        }
+
+        if (0 == --node.activeHandlers)
+            m_socket->unsubscribeFrom(prefix);
+
+        return true;
+    }
+
+    return false;
+}
+
+NZMQT_INLINE int ZMQTopicDispatcher::handlerCount() const
+{
+    return m_prefixes.size();
+}
+
+NZMQT_INLINE void ZMQTopicDispatcher::dispatch(const QList<QByteArray>& message_)
+{
+    if (message_.isEmpty())
+        return;
+
+    // Makes sure changes deferred during dispatching are applied even
+    // if a handler throws.
+    struct DispatchGuard
+    {
+        DispatchGuard(ZMQTopicDispatcher* dispatcher_) : dispatcher(dispatcher_) { ++dispatcher->m_dispatchDepth; }
+        ~DispatchGuard()
+        {
+            if (0 == --dispatcher->m_dispatchDepth)
+                dispatcher->applyPendingChanges();
+        }
+        ZMQTopicDispatcher* dispatcher;
+    } guard(this);
+
+    const QByteArray& topic = message_.first();
+    const char* key = topic.constData();
+    const int keyLen = topic.size();
+
+    int nodeIdx = 0;
+    int pos = 0;
+    while (nodeIdx >= 0)
+    {
+        const Node& node = m_nodes.at(nodeIdx);
+        for (const Registration& registration : node.handlers)
+        {
+            if (!registration.removed)
+                registration.handler(message_);
+        }
+
+        if (pos == keyLen)
+            break;
+
+        nodeIdx = findChild(nodeIdx, key[pos++]);
+    }
+}
+
+NZMQT_INLINE int ZMQTopicDispatcher::findChild(int node_, char key_) const
+{
+    const Node& node = m_nodes.at(node_);
+    const uchar* begin = reinterpret_cast<const uchar*>(node.keys.constData());
+    const uchar* end = begin + node.keys.size();
+    const uchar* it = std::lower_bound(begin, end, uchar(key_));
+    if (it == end || *it != uchar(key_))
+        return -1;
+    return node.children.at(int(it - begin));
+}
+
+NZMQT_INLINE int ZMQTopicDispatcher::findNode(const QByteArray& prefix_) const
+{
+    int nodeIdx = 0;
+    for (int pos = 0; nodeIdx >= 0 && pos < prefix_.size(); ++pos)
+        nodeIdx = findChild(nodeIdx, prefix_[pos]);
+    return nodeIdx;
+}
+
+NZMQT_INLINE int ZMQTopicDispatcher::insertNode(const QByteArray& prefix_)
+{
+    int nodeIdx = 0;
+    for (int pos = 0; pos < prefix_.size(); ++pos)
+    {
+        const uchar key = uchar(prefix_[pos]);
+        const Node& node = m_nodes.at(nodeIdx);
+        const uchar* begin = reinterpret_cast<const uchar*>(node.keys.constData());
+        const uchar* end = begin + node.keys.size();
+        const int slot = int(std::lower_bound(begin, end, key) - begin);
+
+        if (slot < node.keys.size() && uchar(node.keys[slot]) == key)
+        {
+            nodeIdx = node.children.at(slot);
+            continue;
+        }
+
+        const int childIdx = m_nodes.size();
+        m_nodes.push_back(Node());
+        Node& parent = m_nodes[nodeIdx];
+        parent.keys.insert(slot, char(key));
+        parent.children.insert(slot, childIdx);
+        nodeIdx = childIdx;
+    }
+    return nodeIdx;
+}
+
+NZMQT_INLINE void ZMQTopicDispatcher::insertHandler(const QByteArray& prefix_, const Registration& registration_)
+{
+    Node& node = m_nodes[insertNode(prefix_)];
+    node.handlers.push_back(registration_);
+
+    if (1 == ++node.activeHandlers)
+        m_socket->subscribeTo(prefix_);
+}
+
+NZMQT_INLINE void ZMQTopicDispatcher::applyPendingChanges()
+{
+    for (int nodeIdx : m_dirtyNodes)
+    {
+        QVector<Registration>& handlers = m_nodes[nodeIdx].handlers;
+        handlers.erase(std::remove_if(handlers.begin(), handlers.end(),
+                                      [](const Registration& registration_) { return registration_.removed; }),
+                       handlers.end());
+    }
+    m_dirtyNodes.clear();
+
+    const QVector<PendingHandler> pendingHandlers = m_pendingHandlers;
+    m_pendingHandlers.clear();
+    for (const PendingHandler& pending : pendingHandlers)
+        insertHandler(pending.prefix, pending.registration);
+}
+
+
+
+
+/*
+ * ZMQLastValueCache
+ */
+
+NZMQT_INLINE double ZMQLastValueCache::Statistics::hitRate() const
+{
+    return subscriptions ? double(hits) / double(subscriptions) : 0.0;
+}
+
+NZMQT_INLINE ZMQLastValueCache::ZMQLastValueCache(ZMQSocket* upstream_, ZMQSocket* downstream_, int maxBytes_, QObject* parent_)
+    : super(parent_)
+    , m_upstream(upstream_)
+    , m_downstream(downstream_)
+    , m_cache(maxBytes_)
+    , m_statistics()
+{
+#ifdef ZMQ_XPUB_VERBOSE
+    m_downstream->setOption(ZMQSocket::OPT_XPUB_VERBOSE, 1);
+#endif
+    // An XSUB socket subscribes by sending a message consisting of byte 1
+    // followed by the topic prefix. An empty prefix matches all topics.
+    m_upstream->sendMessage(QByteArray(1, '\x01'));
+
+    connect(m_upstream, &ZMQSocket::messageReceived, this, &ZMQLastValueCache::upstreamMessageReceived);
+    connect(m_downstream, &ZMQSocket::messageReceived, this, &ZMQLastValueCache::downstreamMessageReceived);
+}
+
+NZMQT_INLINE void ZMQLastValueCache::setMaxBytes(int maxBytes_)
+{
+    m_cache.setMaxCost(maxBytes_);
+}
+
+NZMQT_INLINE int ZMQLastValueCache::maxBytes() const
+{
+    return m_cache.maxCost();
+}
+
+NZMQT_INLINE int ZMQLastValueCache::cachedBytes() const
+{
+    return m_cache.totalCost();
+}
+
+NZMQT_INLINE int ZMQLastValueCache::cachedTopics() const
+{
+    return m_cache.size();
+}
+
+NZMQT_INLINE ZMQLastValueCache::Statistics ZMQLastValueCache::statistics() const
+{
+    return m_statistics;
+}
+
+NZMQT_INLINE void ZMQLastValueCache::resetStatistics()
+{
+    m_statistics = Statistics();
+}
+
+NZMQT_INLINE void ZMQLastValueCache::clear()
+{
+    m_cache.clear();
+}
+
+NZMQT_INLINE void ZMQLastValueCache::upstreamMessageReceived(const QList<QByteArray>& message_)
+{
+    if (message_.isEmpty())
+        return;
+
+    m_downstream->sendMessage(message_);
+
+    // If the message alone exceeds the limit QCache drops it (and any older value
+    // for this topic), which is the right thing to do for a stale cache entry.
+    m_cache.insert(message_.first(), new QList<QByteArray>(message_), messageCost(message_));
+}
+
+NZMQT_INLINE void ZMQLastValueCache::downstreamMessageReceived(const QList<QByteArray>& message_)
+{
+    // An XPUB socket reports (un)subscriptions as a single part message consisting
+    // of byte 1 (subscribe) or 0 (unsubscribe) followed by the topic prefix.
+    if (message_.isEmpty() || message_.first().isEmpty() || message_.first().at(0) != 1)
+        return;
+
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+
+    const QByteArray prefix = message_.first().mid(1);
+    int replayed = 0;
+    for (const QByteArray& topic : m_cache.keys())
+    {
+        if (!topic.startsWith(prefix))
+            continue;
+
+        const QList<QByteArray>* cachedMessage = m_cache.object(topic);
+        if (cachedMessage && m_downstream->sendMessage(*cachedMessage))
+            ++replayed;
+    }
+
+    const qint64 nsecs = stopWatch.nsecsElapsed();
+
+    ++m_statistics.subscriptions;
+    if (replayed > 0)
+        ++m_statistics.hits;
+    else
+        ++m_statistics.misses;
+    m_statistics.replayedMessages += replayed;
+    m_statistics.lastSnapshotNsecs = nsecs;
+    m_statistics.totalSnapshotNsecs += nsecs;
+
+    if (replayed > 0)
+        emit snapshotSent(prefix, replayed, nsecs);
+}
+
+NZMQT_INLINE int ZMQLastValueCache::messageCost(const QList<QByteArray>& message_)
+{
+    // The topic is stored twice, as key and as first message part.
+    int cost = message_.first().size();
+    for (const QByteArray& part : message_)
+        cost += part.size();
+    return cost;
+}
+
+
+
+
+/*
+ * ZMQConflatingQueue
+ */
+
+NZMQT_INLINE ZMQConflatingQueue::ZMQConflatingQueue(ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_conflatedCount(0)
+{
+    if (socket_)
+        connect(socket_, &ZMQSocket::messageReceived, this, &ZMQConflatingQueue::enqueue);
+}
+
+NZMQT_INLINE void ZMQConflatingQueue::setKeyExtractor(const KeyExtractor& extractor_)
+{
+    m_keyExtractor = extractor_;
+}
+
+NZMQT_INLINE ZMQConflatingQueue::KeyExtractor ZMQConflatingQueue::keyUntil(char delimiter_)
+{
+    return [delimiter_](const QByteArray& topic_) {
+        const int pos = topic_.indexOf(delimiter_);
+        return pos < 0 ? topic_ : topic_.left(pos);
+    };
+}
+
+NZMQT_INLINE bool ZMQConflatingQueue::isEmpty() const
+{
+    return m_keys.isEmpty();
+}
+
+NZMQT_INLINE int ZMQConflatingQueue::size() const
+{
+    return m_keys.size();
+}
+
+NZMQT_INLINE QList<QByteArray> ZMQConflatingQueue::dequeue()
+{
+    return m_messages.take(m_keys.dequeue());
+}
+
+NZMQT_INLINE QList< QList<QByteArray> > ZMQConflatingQueue::dequeueAll(int max_)
+{
+    QList< QList<QByteArray> > ret;
+
+    int count = max_ < 0 ? m_keys.size() : qMin(max_, m_keys.size());
+    ret.reserve(count);
+    while (count-- > 0)
+        ret += dequeue();
+
+    return ret;
+}
+
+NZMQT_INLINE quint64 ZMQConflatingQueue::conflatedCount() const
+{
+    return m_conflatedCount;
+}
+
+NZMQT_INLINE void ZMQConflatingQueue::enqueue(const QList<QByteArray>& message_)
+{
+    if (message_.isEmpty())
+        return;
+
+    const QByteArray key = m_keyExtractor ? m_keyExtractor(message_.first()) : message_.first();
+
+    QHash<QByteArray, QList<QByteArray> >::iterator msIt = m_messages.find(key);
+    if (msIt != m_messages.end())
+    {
+        // Keep the key's position in the queue, only replace its message.
+        *msIt = message_;
+        ++m_conflatedCount;
+        return;
+    }
+
+    m_messages.insert(key, message_);
+    m_keys.enqueue(key);
+
+    if (1 == m_keys.size())
+        emit messagesAvailable();
+}
+
+NZMQT_INLINE void ZMQConflatingQueue::clear()
+{
+    m_messages.clear();
+    m_keys.clear();
+}
+
+
+
+
+/*
+ * ZMQSequencedSender
+ */
+
+NZMQT_INLINE ZMQSequencedSender::ZMQSequencedSender(ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_socket(socket_)
+    , m_epoch(nextEpoch())
+{
+}
+
+NZMQT_INLINE ZMQSocket* ZMQSequencedSender::socket() const
+{
+    return m_socket;
+}
+
+NZMQT_INLINE quint64 ZMQSequencedSender::epoch() const
+{
+    return m_epoch;
+}
+
+NZMQT_INLINE quint64 ZMQSequencedSender::lastSequence(const QByteArray& topic_) const
+{
+    return m_sequences.value(topic_, 0);
+}
+
+NZMQT_INLINE QByteArray ZMQSequencedSender::sequenceFrame(quint64 epoch_, quint64 sequence_)
+{
+    QByteArray frame(int(2 * sizeof(quint64)), Qt::Uninitialized);
+    qToBigEndian<quint64>(epoch_, reinterpret_cast<uchar*>(frame.data()));
+    qToBigEndian<quint64>(sequence_, reinterpret_cast<uchar*>(frame.data()) + sizeof(quint64));
+    return frame;
+}
+
+NZMQT_INLINE quint64 ZMQSequencedSender::nextEpoch()
+{
+    // Senders created within the same nanosecond still get different epochs.
+    static std::atomic<quint64> lastEpoch(0);
+    const quint64 now = quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::system_clock::now().time_since_epoch()).count());
+    quint64 last = lastEpoch.load();
+    quint64 epoch;
+    do {
+        epoch = qMax(now, last + 1);
+    } while (!lastEpoch.compare_exchange_weak(last, epoch));
+    return epoch;
+}
+
+NZMQT_INLINE bool ZMQSequencedSender::sendMessage(const QList<QByteArray>& msg_, ZMQSocket::SendFlags flags_)
+{
+    if (msg_.isEmpty())
+        return true;
+
+    quint64& sequence = m_sequences[msg_.first()];
+
+    QList<QByteArray> msg = msg_;
+    msg.insert(1, sequenceFrame(m_epoch, sequence + 1));
+    if (!m_socket->sendMessage(msg, flags_))
+        return false;
+
+    ++sequence;
+    return true;
+}
+
+
+
+/*
+ * ZMQSequencedReceiver
+ */
+
+NZMQT_INLINE ZMQSequencedReceiver::ZMQSequencedReceiver(ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_statistics()
+{
+    if (socket_)
+        connect(socket_, &ZMQSocket::messageReceived, this, &ZMQSequencedReceiver::receive);
+}
+
+NZMQT_INLINE quint64 ZMQSequencedReceiver::lastSequence(const QByteArray& topic_) const
+{
+    return m_topics.value(topic_, TopicState()).sequence;
+}
+
+NZMQT_INLINE ZMQSequencedReceiver::Statistics ZMQSequencedReceiver::statistics() const
+{
+    return m_statistics;
+}
+
+NZMQT_INLINE void ZMQSequencedReceiver::resetStatistics()
+{
+    m_statistics = Statistics();
+}
+
+NZMQT_INLINE bool ZMQSequencedReceiver::parseSequenceFrame(const QByteArray& frame_, quint64* epoch_, quint64* sequence_)
+{
+    if (frame_.size() != int(2 * sizeof(quint64)))
+        return false;
+
+    const uchar* data = reinterpret_cast<const uchar*>(frame_.constData());
+    *epoch_ = qFromBigEndian<quint64>(data);
+    *sequence_ = qFromBigEndian<quint64>(data + sizeof(quint64));
+    return true;
+}
+
+NZMQT_INLINE void ZMQSequencedReceiver::receive(const QList<QByteArray>& message_)
+{
+    quint64 epoch;
+    quint64 sequence;
+    if (message_.size() < 2 || !parseSequenceFrame(message_[1], &epoch, &sequence))
+    {
+        ++m_statistics.invalid;
+        return;
+    }
+
+    const QByteArray& topic = message_.first();
+    TopicState& state = m_topics[topic];
+    quint64 lastSequence = state.sequence;
+
+    // A new epoch starts the topic over, as if the subscriber had just joined.
+    const bool restarted = lastSequence && epoch != state.epoch;
+    if (restarted)
+        lastSequence = 0;
+
+    if (lastSequence && sequence <= lastSequence)
+    {
+        ++m_statistics.duplicates;
+        emit duplicateDetected(topic, sequence);
+        return;
+    }
+
+    // The state is updated first, since connected slots may call 'reset()'.
+    state.epoch = epoch;
+    state.sequence = sequence;
+    ++m_statistics.messages;
+
+    if (restarted)
+    {
+        ++m_statistics.restarts;
+        emit publisherRestarted(topic, epoch, sequence);
+    }
+
+    if (lastSequence && sequence > lastSequence + 1)
+    {
+        ++m_statistics.gaps;
+        m_statistics.lostMessages += sequence - lastSequence - 1;
+        emit gapDetected(topic, lastSequence + 1, sequence - 1);
+    }
+
+    QList<QByteArray> message = message_;
+    message.removeAt(1);
+    emit messageReceived(message);
+}
+
+NZMQT_INLINE void ZMQSequencedReceiver::reset()
+{
+    m_topics.clear();
+}
+
+
+
+
+/*
+ * ZMQCoalescingSender
+ */
+
+NZMQT_INLINE ZMQCoalescingSender::ZMQCoalescingSender(ZMQSocket* socket_, const QList<QByteArray>& envelope_, QObject* parent_)
+    : super(parent_)
+    , m_socket(socket_)
+    , m_envelope(envelope_)
+    , m_batchMessages(0)
+    , m_maxBatchBytes(NZMQT_COALESCINGSENDER_DEFAULT_MAXBATCHBYTES)
+    , m_messagesSent(0)
+    , m_batchesSent(0)
+{
+    m_batch.reserve(m_maxBatchBytes);
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setTimerType(Qt::PreciseTimer);
+    m_flushTimer.setInterval(NZMQT_COALESCINGSENDER_DEFAULT_FLUSHINTERVAL);
+    connect(&m_flushTimer, &QTimer::timeout, this, &ZMQCoalescingSender::flush);
+}
+
+NZMQT_INLINE ZMQSocket* ZMQCoalescingSender::socket() const
+{
+    return m_socket;
+}
+
+NZMQT_INLINE void ZMQCoalescingSender::setMaxBatchBytes(int bytes_)
+{
+    m_maxBatchBytes = bytes_;
+    m_batch.reserve(m_maxBatchBytes);
+}
+
+NZMQT_INLINE int ZMQCoalescingSender::maxBatchBytes() const
+{
+    return m_maxBatchBytes;
+}
+
+NZMQT_INLINE void ZMQCoalescingSender::setFlushInterval(int msec_)
+{
+    m_flushTimer.setInterval(msec_);
+}
+
+NZMQT_INLINE int ZMQCoalescingSender::flushInterval() const
+{
+    return m_flushTimer.interval();
+}
+
+NZMQT_INLINE int ZMQCoalescingSender::pendingMessages() const
+{
+    return m_batchMessages;
+}
+
+NZMQT_INLINE quint64 ZMQCoalescingSender::messagesSent() const
+{
+    return m_messagesSent;
+}
+
+NZMQT_INLINE quint64 ZMQCoalescingSender::batchesSent() const
+{
+    return m_batchesSent;
+}
+
+NZMQT_INLINE void ZMQCoalescingSender::appendMessage(QByteArray* batch_, const QByteArray& message_)
+{
+    uchar length[sizeof(quint32)];
+    qToBigEndian<quint32>(quint32(message_.size()), length);
+    batch_->append(reinterpret_cast<const char*>(length), int(sizeof(length)));
+    batch_->append(message_);
+}
+
+NZMQT_INLINE bool ZMQCoalescingSender::sendMessage(const QByteArray& message_)
+{
+    const int messageBytes = int(sizeof(quint32)) + message_.size();
+    if (m_batchMessages > 0 && m_batch.size() + messageBytes > m_maxBatchBytes && !flush())
+        return false;
+
+    appendMessage(&m_batch, message_);
+    ++m_batchMessages;
+
+    if (m_batch.size() >= m_maxBatchBytes)
+        flush();
+    else if (1 == m_batchMessages)
+        m_flushTimer.start();
+
+    return true;
+}
+
+NZMQT_INLINE bool ZMQCoalescingSender::flush()
+{
+    m_flushTimer.stop();
+
+    if (0 == m_batchMessages)
+        return true;
+
+    {
+        QList<QByteArray> msg = m_envelope;
+        msg += m_batch;
+        if (!m_socket->sendMessage(msg))
+        {
+            m_flushTimer.start();
+            return false;
+        }
+    }
+
+    m_messagesSent += m_batchMessages;
+    ++m_batchesSent;
+
+    // Keeps the allocated capacity for the next batch.
+    m_batch.resize(0);
+    m_batchMessages = 0;
+
+    return true;
+}
+
+
+
+/*
+ * ZMQCoalescedReceiver
+ */
+
+NZMQT_INLINE ZMQCoalescedReceiver::ZMQCoalescedReceiver(ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_messagesReceived(0)
+    , m_batchesReceived(0)
+    , m_invalidBatches(0)
+{
+    if (socket_)
+        connect(socket_, &ZMQSocket::messageReceived, this, &ZMQCoalescedReceiver::receive);
+}
+
+NZMQT_INLINE quint64 ZMQCoalescedReceiver::messagesReceived() const
+{
+    return m_messagesReceived;
+}
+
+NZMQT_INLINE quint64 ZMQCoalescedReceiver::batchesReceived() const
+{
+    return m_batchesReceived;
+}
+
+NZMQT_INLINE quint64 ZMQCoalescedReceiver::invalidBatches() const
+{
+    return m_invalidBatches;
+}
+
+NZMQT_INLINE bool ZMQCoalescedReceiver::split(const QByteArray& batch_, QList<QByteArray>* messages_)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(batch_.constData());
+    const int size = batch_.size();
+
+    int pos = 0;
+    while (pos < size)
+    {
+        if (size - pos < int(sizeof(quint32)))
+            return false;
+
+        const quint32 length = qFromBigEndian<quint32>(data + pos);
+        pos += int(sizeof(quint32));
+        if (length > quint32(size - pos))
+            return false;
+
+        messages_->append(batch_.mid(pos, int(length)));
+        pos += int(length);
+    }
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQCoalescedReceiver::receive(const QList<QByteArray>& batch_)
+{
+    if (batch_.isEmpty())
+        return;
+
+    QList<QByteArray> messages;
+    if (!split(batch_.last(), &messages))
+    {
+        ++m_invalidBatches;
+        return;
+    }
+
+    ++m_batchesReceived;
+    m_messagesReceived += messages.size();
+
+    // Reuse the envelope parts for all messages of the batch.
+    QList<QByteArray> message = batch_.mid(0, batch_.size() - 1);
+    for (const QByteArray& part : messages)
+    {
+        message.append(part);
+        emit messageReceived(message);
+        message.removeLast();
+    }
+}
+
+
+
+/*
+ * ZMQFileSender
+ */
+
+// The last reference to a mapping may be dropped by one of ZMQ's I/O threads, so it must
+// not own any QObject. Without mmap() the file is read into memory instead.
+struct ZMQFileSender::Mapping
+{
+    Mapping()
+        : data(nullptr)
+        , size(0)
+        , refs(1)
+    {
+    }
+
+    ~Mapping()
+    {
+#if defined(Q_OS_UNIX)
+        if (data)
+            ::munmap(data, size_t(size));
+#else
+        delete[] data;
+#endif
+    }
+
+    // Returns an error message, or an empty string on success.
+    QString open(const QString& fileName_)
+    {
+#if defined(Q_OS_UNIX)
+        const int fd = ::open(QFile::encodeName(fileName_).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return QString::fromLocal8Bit(strerror(errno));
+
+        struct stat info;
+        if (::fstat(fd, &info) < 0)
+        {
+            const QString error = QString::fromLocal8Bit(strerror(errno));
+            ::close(fd);
+            return error;
+        }
+
+        size = qint64(info.st_size);
+        if (size > 0)
+        {
+            void* addr = ::mmap(nullptr, size_t(size), PROT_READ, MAP_SHARED, fd, 0);
+            if (MAP_FAILED == addr)
+            {
+                const QString error = QString::fromLocal8Bit(strerror(errno));
+                ::close(fd);
+                return error;
+            }
+            data = static_cast<uchar*>(addr);
+        }
+
+        // The mapping stays valid after closing the file.
+        ::close(fd);
+        return QString();
+#else
+        QFile file(fileName_);
+        if (!file.open(QIODevice::ReadOnly))
+            return file.errorString();
+
+        size = file.size();
+        if (size > 0)
+        {
+            data = new uchar[size_t(size)];
+            if (file.read(reinterpret_cast<char*>(data), size) != size)
+                return file.errorString();
+        }
+        return QString();
+#endif
+    }
+
+    static void release(Mapping* mapping_)
+    {
+        if (mapping_ && !mapping_->refs.deref())
+            delete mapping_;
+    }
+
+    uchar* data;
+    qint64 size;
+    // Held by the sender while sending and by each chunk until ZMQ has freed it.
+    QAtomicInt refs;
+};
+
+NZMQT_INLINE ZMQFileSender::ZMQFileSender(ZMQSocket* socket_, const QList<QByteArray>& envelope_, QObject* parent_)
+    : super(parent_)
+    , m_socket(socket_)
+    , m_envelope(envelope_)
+    , m_mapping(nullptr)
+    , m_chunkSize(NZMQT_FILESENDER_DEFAULT_CHUNKSIZE)
+    , m_retryInterval(NZMQT_FILESENDER_DEFAULT_RETRYINTERVAL)
+    , m_fileSize(0)
+    , m_offset(0)
+{
+    m_sendTimer.setSingleShot(true);
+    connect(&m_sendTimer, &QTimer::timeout, this, &ZMQFileSender::sendChunks);
+}
+
+NZMQT_INLINE ZMQFileSender::~ZMQFileSender()
+{
+    Mapping::release(m_mapping);
+}
+
+NZMQT_INLINE ZMQSocket* ZMQFileSender::socket() const
+{
+    return m_socket;
+}
+
+NZMQT_INLINE void ZMQFileSender::setChunkSize(int bytes_)
+{
+    m_chunkSize = bytes_;
+}
+
+NZMQT_INLINE int ZMQFileSender::chunkSize() const
+{
+    return m_chunkSize;
+}
+
+NZMQT_INLINE void ZMQFileSender::setRetryInterval(int msec_)
+{
+    m_retryInterval = msec_;
+}
+
+NZMQT_INLINE int ZMQFileSender::retryInterval() const
+{
+    return m_retryInterval;
+}
+
+NZMQT_INLINE bool ZMQFileSender::isSending() const
+{
+    return m_mapping != nullptr;
+}
+
+NZMQT_INLINE QString ZMQFileSender::fileName() const
+{
+    return m_fileName;
+}
+
+NZMQT_INLINE qint64 ZMQFileSender::bytesSent() const
+{
+    return m_offset;
+}
+
+NZMQT_INLINE qint64 ZMQFileSender::fileSize() const
+{
+    return m_fileSize;
+}
+
+NZMQT_INLINE bool ZMQFileSender::sendFile(const QString& fileName_)
+{
+    if (isSending())
+        return false;
+
+    Mapping* mapping = new Mapping;
+    const QString error = mapping->open(fileName_);
+    if (!error.isEmpty())
+    {
+        qWarning("Cannot map file '%s': %s", qPrintable(fileName_), qPrintable(error));
+        Mapping::release(mapping);
+        return false;
+    }
+
+    m_mapping = mapping;
+    m_fileName = fileName_;
+    m_fileSize = mapping->size;
+    m_offset = 0;
+
+    m_sendTimer.start(0);
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQFileSender::cancel()
+{
+    m_sendTimer.stop();
+    Mapping::release(m_mapping);
+    m_mapping = nullptr;
+}
+
+NZMQT_INLINE void ZMQFileSender::sendChunks()
+{
+    // Returns to the event loop after a number of chunks in order to stay responsive.
+    for (int i = 0; i < 64; ++i)
+    {
+        if (!sendChunk())
+        {
+            m_sendTimer.start(m_retryInterval);
+            return;
+        }
+
+        const bool done = m_offset >= m_fileSize;
+        if (done)
+        {
+            Mapping::release(m_mapping);
+            m_mapping = nullptr;
+        }
+
+        emit progress(m_offset, m_fileSize);
+
+        if (done)
+        {
+            emit fileSent(m_fileName);
+            return;
+        }
+
+        if (!isSending())
+            return;
+    }
+
+    m_sendTimer.start(0);
+}
+
+NZMQT_INLINE bool ZMQFileSender::sendChunk()
+{
+    const qint64 length = qMin<qint64>(m_chunkSize, m_fileSize - m_offset);
+
+    uchar header[2 * sizeof(quint64)];
+    qToBigEndian<quint64>(quint64(m_offset), header);
+    qToBigEndian<quint64>(quint64(m_fileSize), header + sizeof(quint64));
+
+    // Only the first part of a message may fail due to the HWM. Once it has been
+    // queued, ZMQ guarantees that the remaining parts are queued as well.
+    const ZMQSocket::SendFlags flags = ZMQSocket::SND_DONTWAIT | ZMQSocket::SND_MORE;
+    for (const QByteArray& part : m_envelope)
+    {
+        ZMQMessage msg(part);
+        if (!m_socket->sendMessage(msg, flags))
+            return false;
+    }
+
+    {
+        ZMQMessage msg(sizeof(header));
+        memcpy(msg.data(), header, sizeof(header));
+        if (!m_socket->sendMessage(msg, flags))
+            return false;
+    }
+
+    if (length > 0)
+    {
+        // The hint keeps the mapping alive until ZMQ has sent the chunk.
+        ZMQMessage chunk(m_mapping->data + m_offset, size_t(length), &ZMQFileSender::releaseMapping, m_mapping);
+        m_mapping->refs.ref();
+        m_socket->sendMessage(chunk, ZMQSocket::SND_DONTWAIT);
+    }
+    else
+    {
+        ZMQMessage chunk;
+        m_socket->sendMessage(chunk, ZMQSocket::SND_DONTWAIT);
+    }
+
+    m_offset += length;
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQFileSender::releaseMapping(void* data_, void* hint_)
+{
+    Q_UNUSED(data_);
+
+    Mapping::release(static_cast<Mapping*>(hint_));
+}
+
+
+
+/*
+ * ZMQFileReceiver
+ */
+
+NZMQT_INLINE ZMQFileReceiver::ZMQFileReceiver(const QString& fileName_, ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_file(fileName_)
+    , m_fileSize(0)
+    , m_bytesReceived(0)
+    , m_complete(false)
+{
+    if (socket_)
+        connect(socket_, &ZMQSocket::messageReceived, this, &ZMQFileReceiver::receive);
+}
+
+NZMQT_INLINE QString ZMQFileReceiver::fileName() const
+{
+    return m_file.fileName();
+}
+
+NZMQT_INLINE qint64 ZMQFileReceiver::bytesReceived() const
+{
+    return m_bytesReceived;
+}
+
+NZMQT_INLINE qint64 ZMQFileReceiver::fileSize() const
+{
+    return m_fileSize;
+}
+
+NZMQT_INLINE bool ZMQFileReceiver::isComplete() const
+{
+    return m_complete;
+}
+
+NZMQT_INLINE void ZMQFileReceiver::receive(const QList<QByteArray>& message_)
+{
+    const int headerSize = int(2 * sizeof(quint64));
+    if (message_.size() < 2 || message_[message_.size() - 2].size() != headerSize)
+    {
+        if (m_file.isOpen())
+            fail("Malformed chunk");
+        return;
+    }
+
+    const uchar* header = reinterpret_cast<const uchar*>(message_[message_.size() - 2].constData());
+    const qint64 offset = qint64(qFromBigEndian<quint64>(header));
+    const qint64 fileSize = qint64(qFromBigEndian<quint64>(header + sizeof(quint64)));
+    const QByteArray& chunk = message_.last();
+
+    if (0 == offset)
+    {
+        // Starts a new transfer, dropping an incomplete one.
+        m_file.close();
+        m_fileSize = fileSize;
+        m_bytesReceived = 0;
+        m_complete = false;
+
+        // Writes go straight to the file instead of through QFile's buffer.
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered) || !m_file.resize(fileSize))
+        {
+            fail(m_file.errorString());
+            return;
+        }
+    }
+    else if (!m_file.isOpen())
+    {
+        // Remaining chunks of a failed transfer.
+        return;
+    }
+    else if (offset != m_bytesReceived || fileSize != m_fileSize)
+    {
+        fail(QString("Missing chunk at offset %1").arg(m_bytesReceived));
+        return;
+    }
+
+    if (chunk.size() > m_fileSize - offset)
+    {
+        fail("Chunk exceeds file size");
+        return;
+    }
+
+    if (!m_file.seek(offset) || m_file.write(chunk) != chunk.size())
+    {
+        fail(m_file.errorString());
+        return;
+    }
+
+    m_bytesReceived += chunk.size();
+    emit progress(m_bytesReceived, m_fileSize);
+
+    if (m_bytesReceived == m_fileSize)
+    {
+        m_file.close();
+        m_complete = true;
+        emit fileReceived(fileName());
+    }
+}
+
+NZMQT_INLINE void ZMQFileReceiver::fail(const QString& reason_)
+{
+    qWarning("Cannot receive file '%s': %s", qPrintable(fileName()), qPrintable(reason_));
+
+    m_file.close();
+    emit transferFailed(fileName(), reason_);
+}
+
+
+
+/*
+ * ZMQRecorder
+ */
+
+NZMQT_INLINE ZMQRecorder::ZMQRecorder(const QString& baseName_, ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_baseName(baseName_)
+    , m_segmentSize(NZMQT_RECORDER_DEFAULT_SEGMENTSIZE)
+    , m_indexInterval(NZMQT_RECORDER_DEFAULT_INDEXINTERVAL)
+    , m_segment(nullptr)
+    , m_data(nullptr)
+    , m_mappedSize(0)
+    , m_offset(0)
+    , m_segmentIndex(0)
+    , m_recordedMessages(0)
+{
+    if (socket_)
+        connect(socket_, &ZMQSocket::messageReceived, this, &ZMQRecorder::record);
+}
+
+NZMQT_INLINE ZMQRecorder::~ZMQRecorder()
+{
+    close();
+}
+
+NZMQT_INLINE QString ZMQRecorder::baseName() const
+{
+    return m_baseName;
+}
+
+NZMQT_INLINE void ZMQRecorder::setSegmentSize(qint64 bytes_)
+{
+    m_segmentSize = bytes_;
+}
+
+NZMQT_INLINE qint64 ZMQRecorder::segmentSize() const
+{
+    return m_segmentSize;
+}
+
+NZMQT_INLINE void ZMQRecorder::setIndexInterval(int records_)
+{
+    m_indexInterval = qMax(records_, 1);
+}
+
+NZMQT_INLINE int ZMQRecorder::indexInterval() const
+{
+    return m_indexInterval;
+}
+
+NZMQT_INLINE bool ZMQRecorder::open()
+{
+    close();
+
+    // Remove segments of a previous log, which would otherwise be replayed as well.
+    for (int i = 0; QFile::exists(segmentFileName(m_baseName, i)); ++i)
+        QFile::remove(segmentFileName(m_baseName, i));
+
+    m_index.setFileName(indexFileName(m_baseName));
+    if (!m_index.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("Cannot create log index '%s': %s", qPrintable(m_index.fileName()), qPrintable(m_index.errorString()));
+        return false;
+    }
+
+    m_recordedMessages = 0;
+    if (!openSegment(0))
+    {
+        m_index.close();
+        return false;
+    }
+
+    m_clock.start();
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQRecorder::close()
+{
+    discardNextSegment();
+    closeSegment();
+    m_index.close();
+}
+
+NZMQT_INLINE bool ZMQRecorder::isOpen() const
+{
+    return nullptr != m_data;
+}
+
+NZMQT_INLINE quint64 ZMQRecorder::recordedMessages() const
+{
+    return m_recordedMessages;
+}
+
+NZMQT_INLINE QString ZMQRecorder::segmentFileName(const QString& baseName_, int segment_)
+{
+    return QString("%1.%2.log").arg(baseName_).arg(segment_, 6, 10, QChar('0'));
+}
+
+NZMQT_INLINE QString ZMQRecorder::indexFileName(const QString& baseName_)
+{
+    return baseName_ + ".idx";
+}
+
+NZMQT_INLINE bool ZMQRecorder::record(const QList<QByteArray>& message_)
+{
+    if (!isOpen())
+        return false;
+
+    const qint64 timestamp = m_clock.nsecsElapsed();
+
+    qint64 size = 2 * sizeof(quint32) + sizeof(quint64);
+    for (const QByteArray& part : message_)
+        size += sizeof(quint32) + part.size();
+
+    if (size > m_segmentSize)
+    {
+        qWarning("Message of %lld bytes exceeds log segment size", size);
+        return false;
+    }
+
+    if (m_offset + size > m_mappedSize)
+    {
+        if (!openSegment(m_segmentIndex + 1))
+            return false;
+
+        // The segment size may have been changed in-between.
+        if (size > m_mappedSize)
+        {
+            qWarning("Message of %lld bytes exceeds log segment size", size);
+            return false;
+        }
+    }
+
+    if (0 == m_recordedMessages % m_indexInterval)
+        writeIndexEntry(timestamp);
+
+    uchar* pos = m_data + m_offset;
+    qToBigEndian<quint32>(quint32(size), pos);
+    pos += sizeof(quint32);
+    qToBigEndian<quint64>(quint64(timestamp), pos);
+    pos += sizeof(quint64);
+    qToBigEndian<quint32>(quint32(message_.size()), pos);
+    pos += sizeof(quint32);
+    for (const QByteArray& part : message_)
+    {
+        qToBigEndian<quint32>(quint32(part.size()), pos);
+        pos += sizeof(quint32);
+        memcpy(pos, part.constData(), part.size());
+        pos += part.size();
+    }
+
+    m_offset += size;
+    ++m_recordedMessages;
+
+    if (!m_nextSegment.valid() && m_offset >= m_mappedSize / 2)
+        m_nextSegment = std::async(std::launch::async, &ZMQRecorder::createSegment, segmentFileName(m_baseName, m_segmentIndex + 1), m_segmentSize, thread());
+
+    return true;
+}
+
+NZMQT_INLINE ZMQRecorder::Segment ZMQRecorder::createSegment(const QString& fileName_, qint64 size_, QThread* thread_)
+{
+    Segment segment = { new QFile(fileName_), nullptr, size_ };
+    if (!segment.file->open(QIODevice::ReadWrite | QIODevice::Truncate)
+            || !segment.file->resize(size_)
+            || !(segment.data = segment.file->map(0, size_)))
+    {
+        qWarning("Cannot create log segment '%s': %s", qPrintable(fileName_), qPrintable(segment.file->errorString()));
+        delete segment.file;
+        segment.file = nullptr;
+        return segment;
+    }
+
+    segment.file->moveToThread(thread_);
+    return segment;
+}
+
+NZMQT_INLINE bool ZMQRecorder::openSegment(int segment_)
+{
+    // The next segment has usually been prepared by now, otherwise it is created here.
+    const Segment segment = m_nextSegment.valid()
+            ? m_nextSegment.get()
+            : createSegment(segmentFileName(m_baseName, segment_), m_segmentSize, thread());
+
+    closeSegment();
+    if (!segment.file)
+        return false;
+
+    m_segment = segment.file;
+    m_data = segment.data;
+    m_mappedSize = segment.size;
+    m_segmentIndex = segment_;
+    m_offset = 0;
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQRecorder::closeSegment()
+{
+    if (!m_segment)
+        return;
+
+    if (m_data)
+        m_segment->unmap(m_data);
+    m_data = nullptr;
+
+    // Cut off the unused part of the preallocated segment.
+    m_segment->resize(m_offset);
+    delete m_segment;
+    m_segment = nullptr;
+}
+
+NZMQT_INLINE void ZMQRecorder::discardNextSegment()
+{
+    if (!m_nextSegment.valid())
+        return;
+
+    // The prepared segment holds no records, so it must not be left for the replayer.
+    const Segment segment = m_nextSegment.get();
+    if (!segment.file)
+        return;
+
+    segment.file->unmap(segment.data);
+    segment.file->remove();
+    delete segment.file;
+}
+
+NZMQT_INLINE void ZMQRecorder::writeIndexEntry(qint64 timestamp_)
+{
+    uchar entry[2 * sizeof(quint64) + sizeof(quint32)];
+    qToBigEndian<quint64>(quint64(timestamp_), entry);
+    qToBigEndian<quint32>(quint32(m_segmentIndex), entry + sizeof(quint64));
+    qToBigEndian<quint64>(quint64(m_offset), entry + sizeof(quint64) + sizeof(quint32));
+    m_index.write(reinterpret_cast<const char*>(entry), sizeof(entry));
+}
 
 
 
 /*
- * ZMQDevice
+ * ZMQReplayer
  */
+
+NZMQT_INLINE ZMQReplayer::ZMQReplayer(const QString& baseName_, ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_baseName(baseName_)
+    , m_socket(socket_)
+    , m_speed(1.0)
+    , m_data(nullptr)
+    , m_size(0)
+    , m_offset(0)
+    , m_segmentIndex(0)
+    , m_pendingTimestamp(0)
+    , m_hasPending(false)
+    , m_replaying(false)
+    , m_firstTimestamp(-1)
+    , m_replayedMessages(0)
+{
+    m_replayTimer.setSingleShot(true);
+    m_replayTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_replayTimer, &QTimer::timeout, this, &ZMQReplayer::replay);
+}
+
+NZMQT_INLINE QString ZMQReplayer::baseName() const
+{
+    return m_baseName;
+}
+
+NZMQT_INLINE ZMQSocket* ZMQReplayer::socket() const
+{
+    return m_socket;
+}
+
+NZMQT_INLINE void ZMQReplayer::setSpeed(double factor_)
+{
+    m_speed = factor_;
+}
+
+NZMQT_INLINE double ZMQReplayer::speed() const
+{
+    return m_speed;
+}
+
+NZMQT_INLINE bool ZMQReplayer::open()
+{
+    close();
+
+    // The index is optional. Without it seeking scans the log from its start.
+    QFile index(ZMQRecorder::indexFileName(m_baseName));
+    if (index.open(QIODevice::ReadOnly))
+    {
+        const QByteArray entries = index.readAll();
+        const int entrySize = int(2 * sizeof(quint64) + sizeof(quint32));
+        const uchar* entry = reinterpret_cast<const uchar*>(entries.constData());
+        for (int i = 0; i + entrySize <= entries.size(); i += entrySize)
+        {
+            IndexEntry indexEntry;
+            indexEntry.timestamp = qint64(qFromBigEndian<quint64>(entry + i));
+            indexEntry.segment = int(qFromBigEndian<quint32>(entry + i + sizeof(quint64)));
+            indexEntry.offset = qint64(qFromBigEndian<quint64>(entry + i + sizeof(quint64) + sizeof(quint32)));
+            m_index.append(indexEntry);
+        }
+    }
+
+    if (!openSegment(0))
+    {
+        qWarning("Cannot open log segment '%s': %s", qPrintable(m_segment.fileName()), qPrintable(m_segment.errorString()));
+        return false;
+    }
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQReplayer::close()
+{
+    stop();
+    closeSegment();
+    m_index.clear();
+    m_pending.clear();
+    m_hasPending = false;
+}
+
+NZMQT_INLINE bool ZMQReplayer::seek(qint64 nsecs_)
+{
+    m_pending.clear();
+    m_hasPending = false;
+    m_firstTimestamp = -1;
+
+    // Start scanning at the last indexed record before the requested time.
+    int segment = 0;
+    qint64 offset = 0;
+    QVector<IndexEntry>::const_iterator it = std::lower_bound(m_index.constBegin(), m_index.constEnd(), nsecs_,
+            [](const IndexEntry& entry_, qint64 timestamp_) { return entry_.timestamp < timestamp_; });
+    if (it != m_index.constBegin())
+    {
+        --it;
+        segment = it->segment;
+        offset = it->offset;
+    }
+
+    if (!openSegment(segment))
+        return false;
+    m_offset = offset;
+
+    while (readRecord(&m_pending, &m_pendingTimestamp))
+    {
+        if (m_pendingTimestamp >= nsecs_)
+        {
+            m_hasPending = true;
+            return true;
+        }
+    }
+
+    m_pending.clear();
+    return false;
+}
+
+NZMQT_INLINE bool ZMQReplayer::readMessage(QList<QByteArray>* message_, qint64* nsecs_)
+{
+    if (m_hasPending)
+    {
+        *message_ = m_pending;
+        *nsecs_ = m_pendingTimestamp;
+        m_pending.clear();
+        m_hasPending = false;
+        return true;
+    }
+
+    return readRecord(message_, nsecs_);
+}
+
+NZMQT_INLINE bool ZMQReplayer::isReplaying() const
+{
+    return m_replaying;
+}
+
+NZMQT_INLINE quint64 ZMQReplayer::replayedMessages() const
+{
+    return m_replayedMessages;
+}
+
+NZMQT_INLINE void ZMQReplayer::start()
+{
+    if (m_replaying || !m_socket)
+        return;
+
+    m_replaying = true;
+    m_firstTimestamp = -1;
+    m_replayTimer.start(0);
+}
+
+NZMQT_INLINE void ZMQReplayer::stop()
+{
+    m_replaying = false;
+    m_replayTimer.stop();
+}
+
+NZMQT_INLINE void ZMQReplayer::replay()
+{
+    // Returns to the event loop after a number of messages in order to stay responsive.
+    for (int i = 0; i < 1024 && m_replaying; ++i)
+    {
+        if (!m_hasPending)
+        {
+            if (!readRecord(&m_pending, &m_pendingTimestamp))
+            {
+                m_replaying = false;
+                emit finished();
+                return;
+            }
+            m_hasPending = true;
+        }
+
+        if (m_firstTimestamp < 0)
+        {
+            m_firstTimestamp = m_pendingTimestamp;
+            m_clock.start();
+        }
+
+        if (m_speed > 0)
+        {
+            const qint64 due = qint64((m_pendingTimestamp - m_firstTimestamp) / m_speed);
+            const qint64 wait = due - m_clock.nsecsElapsed();
+            if (wait > 0)
+            {
+                m_replayTimer.start(int(wait / 1000000));
+                return;
+            }
+        }
+
+        if (!m_socket->sendMessage(m_pending))
+        {
+            m_replayTimer.start(1);
+            return;
+        }
+
+        m_pending.clear();
+        m_hasPending = false;
+        ++m_replayedMessages;
+    }
+
+    if (m_replaying)
+        m_replayTimer.start(0);
+}
+
+NZMQT_INLINE bool ZMQReplayer::openSegment(int segment_)
+{
+    closeSegment();
+
+    m_segment.setFileName(ZMQRecorder::segmentFileName(m_baseName, segment_));
+    if (!m_segment.open(QIODevice::ReadOnly))
+        return false;
+
+    m_size = m_segment.size();
+    if (m_size > 0 && !(m_data = m_segment.map(0, m_size)))
+    {
+        qWarning("Cannot map log segment '%s': %s", qPrintable(m_segment.fileName()), qPrintable(m_segment.errorString()));
+        m_segment.close();
+        m_size = 0;
+        return false;
+    }
+
+    m_segmentIndex = segment_;
+    m_offset = 0;
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQReplayer::closeSegment()
+{
+    if (m_data)
+        m_segment.unmap(m_data);
+    m_data = nullptr;
+    m_size = 0;
+    m_offset = 0;
+    m_segment.close();
+}
+
+NZMQT_INLINE bool ZMQReplayer::readRecord(QList<QByteArray>* message_, qint64* nsecs_)
+{
+    const qint64 headerSize = 2 * sizeof(quint32) + sizeof(quint64);
+
+    // A record size of 0 marks the end of a segment which has not been closed properly.
+    while (m_size - m_offset < headerSize || 0 == qFromBigEndian<quint32>(m_data + m_offset))
+    {
+        if (!openSegment(m_segmentIndex + 1))
+            return false;
+    }
+
+    const uchar* pos = m_data + m_offset;
+    const quint32 size = qFromBigEndian<quint32>(pos);
+    if (size < headerSize || size > m_size - m_offset)
+    {
+        qWarning("Corrupted record in log segment '%s'", qPrintable(m_segment.fileName()));
+        m_offset = m_size;
+        return false;
+    }
+
+    const uchar* end = pos + size;
+    *nsecs_ = qint64(qFromBigEndian<quint64>(pos + sizeof(quint32)));
+    const quint32 parts = qFromBigEndian<quint32>(pos + sizeof(quint32) + sizeof(quint64));
+    pos += headerSize;
+
+    message_->clear();
+    for (quint32 i = 0; i < parts; ++i)
+    {
+        if (end - pos < qint64(sizeof(quint32)) || qFromBigEndian<quint32>(pos) > quint32(end - pos) - sizeof(quint32))
+        {
+            qWarning("Corrupted record in log segment '%s'", qPrintable(m_segment.fileName()));
+            m_offset = m_size;
+            return false;
+        }
+
+        const quint32 partSize = qFromBigEndian<quint32>(pos);
+        pos += sizeof(quint32);
+        message_->append(QByteArray(reinterpret_cast<const char*>(pos), int(partSize)));
+        pos += partSize;
+    }
+
+    m_offset += size;
+
+    return true;
+}
+
+
+
 /*
-NZMQT_INLINE ZMQDevice::ZMQDevice(Type type, ZMQSocket* frontend, ZMQSocket* backend)
-    : type_(type)
-    , frontend_(frontend)
-    , backend_(backend)
+ * ZMQSpool
+ */
+
+NZMQT_INLINE ZMQSpool::ZMQSpool(ZMQSocket* socket_, const QString& baseName_, QObject* parent_)
+    : super(parent_)
+    , m_socket(socket_)
+    , m_baseName(baseName_)
+    , m_segmentSize(NZMQT_SPOOL_DEFAULT_SEGMENTSIZE)
+    , m_maxBytes(NZMQT_SPOOL_DEFAULT_MAXBYTES)
+    , m_syncPolicy(SYNC_NEVER)
+    , m_readOffset(0)
+    , m_writeOffset(0)
+    , m_spooledMessages(0)
+    , m_spooledBytes(0)
+    , m_droppedMessages(0)
+    , m_open(false)
+    , m_unsynced(false)
+{
+    m_drainTimer.setInterval(NZMQT_SPOOL_DEFAULT_DRAININTERVAL);
+    connect(&m_drainTimer, &QTimer::timeout, this, &ZMQSpool::drain);
+}
+
+NZMQT_INLINE ZMQSpool::~ZMQSpool()
+{
+    close();
+}
+
+NZMQT_INLINE ZMQSocket* ZMQSpool::socket() const
+{
+    return m_socket;
+}
+
+NZMQT_INLINE QString ZMQSpool::baseName() const
+{
+    return m_baseName;
+}
+
+NZMQT_INLINE void ZMQSpool::setSegmentSize(qint64 bytes_)
+{
+    m_segmentSize = bytes_;
+}
+
+NZMQT_INLINE qint64 ZMQSpool::segmentSize() const
 {
+    return m_segmentSize;
 }
 
-NZMQT_INLINE void ZMQDevice::run()
+NZMQT_INLINE void ZMQSpool::setMaxBytes(qint64 bytes_)
 {
-    zmq::device(type_, *frontend_, *backend_);
+    m_maxBytes = bytes_;
 }
-*/
 
+NZMQT_INLINE qint64 ZMQSpool::maxBytes() const
+{
+    return m_maxBytes;
+}
 
-/*
- * PollingZMQSocket
- */
+NZMQT_INLINE void ZMQSpool::setSyncPolicy(SyncPolicy policy_)
+{
+    m_syncPolicy = policy_;
+}
 
-NZMQT_INLINE PollingZMQSocket::PollingZMQSocket(PollingZMQContext* context_, Type type_)
-    : super(context_, type_)
+NZMQT_INLINE ZMQSpool::SyncPolicy ZMQSpool::syncPolicy() const
 {
+    return m_syncPolicy;
 }
 
+NZMQT_INLINE void ZMQSpool::setDrainInterval(int msec_)
+{
+    m_drainTimer.setInterval(msec_);
+}
 
-/*
- * PollingZMQContext
- */
+NZMQT_INLINE int ZMQSpool::drainInterval() const
+{
+    return m_drainTimer.interval();
+}
 
-NZMQT_INLINE PollingZMQContext::PollingZMQContext(QObject* parent_, int io_threads_)
-    : super(parent_, io_threads_)
-    , m_pollItemsMutex(QMutex::Recursive)
-    , m_interval(NZMQT_POLLINGZMQCONTEXT_DEFAULT_POLLINTERVAL)
-    , m_stopped(false)
+NZMQT_INLINE bool ZMQSpool::open()
 {
-    setAutoDelete(false);
+    close();
+
+    // Zero padding keeps the segment files in order.
+    const QFileInfo baseInfo(m_baseName);
+    const QDir dir(baseInfo.path());
+    const QStringList fileNames = dir.entryList(QStringList() << baseInfo.fileName() + ".*.spool", QDir::Files, QDir::Name);
+    for (const QString& fileName : fileNames)
+    {
+        bool ok;
+        const int index = fileName.mid(baseInfo.fileName().size() + 1).section('.', 0, 0).toInt(&ok);
+        if (!ok)
+            continue;
+
+        Segment segment;
+        segment.index = index;
+        if (!openSegment(&segment, dir.filePath(fileName), QIODevice::ReadWrite))
+        {
+            close();
+            return false;
+        }
+        m_segments.append(segment);
+
+        // Count the records left to be drained.
+        qint64 offset = sizeof(quint64);
+        if (1 == m_segments.size())
+            offset = m_readOffset = qint64(qFromBigEndian<quint64>(segment.data));
+        for (qint64 size; (size = readRecord(segment, offset, nullptr)) > 0; offset += size)
+        {
+            ++m_spooledMessages;
+            m_spooledBytes += size;
+        }
+        m_writeOffset = offset;
+    }
+
+    m_open = true;
+
+    if (!isEmpty())
+        m_drainTimer.start();
+
+    return true;
 }
 
-NZMQT_INLINE void PollingZMQContext::setInterval(int interval_)
+NZMQT_INLINE void ZMQSpool::close()
 {
-    m_interval = interval_;
+    m_drainTimer.stop();
+
+    if (m_unsynced)
+        sync();
+
+    for (const Segment& segment : m_segments)
+    {
+        segment.file->unmap(segment.data);
+        segment.file->close();
+    }
+    m_segments.clear();
+
+    m_readOffset = 0;
+    m_writeOffset = 0;
+    m_spooledMessages = 0;
+    m_spooledBytes = 0;
+    m_open = false;
 }
 
-NZMQT_INLINE int PollingZMQContext::getInterval() const
+NZMQT_INLINE bool ZMQSpool::isOpen() const
 {
-    return m_interval;
+    return m_open;
 }
 
-NZMQT_INLINE void PollingZMQContext::start()
+NZMQT_INLINE bool ZMQSpool::isEmpty() const
 {
-    m_stopped = false;
-    QTimer::singleShot(0, this, &PollingZMQContext::run);
+    return 0 == m_spooledMessages;
 }
 
-NZMQT_INLINE void PollingZMQContext::stop()
+NZMQT_INLINE quint64 ZMQSpool::spooledMessages() const
 {
-    m_stopped = true;
+    return m_spooledMessages;
 }
 
-NZMQT_INLINE bool PollingZMQContext::isStopped() const
+NZMQT_INLINE qint64 ZMQSpool::spooledBytes() const
 {
-    return m_stopped;
+    return m_spooledBytes;
 }
 
-NZMQT_INLINE void PollingZMQContext::run()
+NZMQT_INLINE quint64 ZMQSpool::droppedMessages() const
 {
-    if (m_stopped)
+    return m_droppedMessages;
+}
+
+NZMQT_INLINE QString ZMQSpool::segmentFileName(const QString& baseName_, int segment_)
+{
+    return QString("%1.%2.spool").arg(baseName_).arg(segment_, 6, 10, QChar('0'));
+}
+
+NZMQT_INLINE bool ZMQSpool::sendMessage(const QList<QByteArray>& msg_)
+{
+    // Messages must not overtake spooled ones.
+    if (isEmpty() && m_socket->sendMessage(msg_))
+        return true;
+
+    return spool(msg_);
+}
+
+NZMQT_INLINE void ZMQSpool::drain()
+{
+    if (m_unsynced && SYNC_BATCH == m_syncPolicy)
+        sync();
+
+    if (isEmpty())
+    {
+        m_drainTimer.stop();
+        return;
+    }
+
+    if (!(m_socket->events() & ZMQSocket::EVT_POLLOUT))
         return;
 
-    try
+    QList<QByteArray> message;
+    for (int sent = 0; !isEmpty() && sent < NZMQT_SPOOL_DEFAULT_DRAINBATCHSIZE; ++sent)
     {
-        poll();
+        const qint64 size = readRecord(m_segments.first(), m_readOffset, &message);
+        if (0 == size)
+        {
+            if (1 == m_segments.size())
+            {
+                qWarning("Corrupted spool segment '%s', dropping %llu messages", qPrintable(m_segments.first().file->fileName()), m_spooledMessages);
+                m_droppedMessages += m_spooledMessages;
+                m_spooledMessages = 0;
+                m_spooledBytes = 0;
+                break;
+            }
+
+            removeHead();
+            continue;
+        }
+
+        if (!m_socket->sendMessage(message))
+            break;
+
+        m_readOffset += size;
+        m_spooledBytes -= size;
+        --m_spooledMessages;
     }
-    catch (const ZMQException& ex)
+
+    if (isEmpty())
     {
-        qWarning("Exception during poll: %s", ex.what());
-        emit pollError(ex.num(), ex.what());
+        while (!m_segments.isEmpty())
+            removeHead();
+        m_writeOffset = 0;
+        m_unsynced = false;
+        m_drainTimer.stop();
+
+        emit drained();
+        return;
     }
 
-    if (!m_stopped)
-        QTimer::singleShot(m_interval, this, &PollingZMQContext::run);
+    // Persist the drain position.
+    qToBigEndian<quint64>(quint64(m_readOffset), m_segments.first().data);
+    m_unsynced = true;
 }
 
-NZMQT_INLINE void PollingZMQContext::poll(long timeout_)
+NZMQT_INLINE bool ZMQSpool::spool(const QList<QByteArray>& msg_)
 {
-    int cnt;
-    do {
-        QMutexLocker lock(&m_pollItemsMutex);
+    if (!m_open)
+        return false;
 
-        if (m_pollItems.empty())
-            return;
+    qint64 size = 2 * sizeof(quint32);
+    for (const QByteArray& part : msg_)
+        size += sizeof(quint32) + part.size();
 
-        cnt = zmq::poll(&m_pollItems[0], m_pollItems.size(), timeout_);
-        Q_ASSERT_X(cnt >= 0, Q_FUNC_INFO, "A value < 0 should be reflected by an exception.");
-        if (0 == cnt)
-            return;
+    if (m_spooledBytes + size > m_maxBytes || qint64(sizeof(quint64)) + size > m_segmentSize)
+    {
+        ++m_droppedMessages;
+        return false;
+    }
 
-        PollItems::iterator poIt = m_pollItems.begin();
-        ZMQContext::Sockets::const_iterator soIt = registeredSockets().begin();
-        int i = 0;
-        while (i < cnt && poIt != m_pollItems.end())
-        {
-            if (poIt->revents & ZMQSocket::EVT_POLLIN)
-            {
-                PollingZMQSocket* socket = static_cast<PollingZMQSocket*>(*soIt);
-                QList<QByteArray> && message = socket->receiveMessage();
-                socket->messageReceived(std::move(message));
-                i++;
-            }
-            ++soIt;
-            ++poIt;
-        }
-    } while (cnt > 0);
+    if ((m_segments.isEmpty() || m_writeOffset + size > m_segments.last().size) && !appendSegment())
+    {
+        ++m_droppedMessages;
+        return false;
+    }
+
+    uchar* pos = m_segments.last().data + m_writeOffset;
+    qToBigEndian<quint32>(quint32(size), pos);
+    pos += sizeof(quint32);
+    qToBigEndian<quint32>(quint32(msg_.size()), pos);
+    pos += sizeof(quint32);
+    for (const QByteArray& part : msg_)
+    {
+        qToBigEndian<quint32>(quint32(part.size()), pos);
+        pos += sizeof(quint32);
+        memcpy(pos, part.constData(), part.size());
+        pos += part.size();
+    }
+
+    m_writeOffset += size;
+    m_spooledBytes += size;
+    ++m_spooledMessages;
+
+    m_unsynced = true;
+    if (SYNC_ALWAYS == m_syncPolicy)
+        sync();
+
+    if (!m_drainTimer.isActive())
+        m_drainTimer.start();
+
+    return true;
 }
 
-NZMQT_INLINE PollingZMQSocket* PollingZMQContext::createSocketInternal(ZMQSocket::Type type_)
+NZMQT_INLINE bool ZMQSpool::openSegment(Segment* segment_, const QString& fileName_, QIODevice::OpenMode mode_)
 {
-    return new PollingZMQSocket(this, type_);
+    segment_->file = QSharedPointer<QFile>(new QFile(fileName_));
+    segment_->data = nullptr;
+    segment_->size = 0;
+
+    QFile& file = *segment_->file;
+    if (!file.open(mode_)
+            || (mode_ & QIODevice::Truncate && !file.resize(m_segmentSize))
+            || (segment_->size = file.size()) < qint64(sizeof(quint64))
+            || !(segment_->data = file.map(0, segment_->size)))
+    {
+        qWarning("Cannot open spool segment '%s': %s", qPrintable(fileName_), qPrintable(file.errorString()));
+        return false;
+    }
+
+    return true;
 }
 
-NZMQT_INLINE void PollingZMQContext::registerSocket(ZMQSocket* socket_)
+NZMQT_INLINE bool ZMQSpool::appendSegment()
 {
-    pollitem_t pollItem = { *socket_, 0, ZMQSocket::EVT_POLLIN, 0 };
+    Segment segment;
+    segment.index = m_segments.isEmpty() ? 0 : m_segments.last().index + 1;
+    if (!openSegment(&segment, segmentFileName(m_baseName, segment.index), QIODevice::ReadWrite | QIODevice::Truncate))
+        return false;
 
-    QMutexLocker lock(&m_pollItemsMutex);
+    qToBigEndian<quint64>(sizeof(quint64), segment.data);
+    m_segments.append(segment);
 
-    m_pollItems.push_back(pollItem);
+    m_writeOffset = sizeof(quint64);
+    if (1 == m_segments.size())
+        m_readOffset = m_writeOffset;
 
-    super::registerSocket(socket_);
+    return true;
 }
 
-NZMQT_INLINE void PollingZMQContext::unregisterSocket(ZMQSocket* socket_)
+NZMQT_INLINE void ZMQSpool::removeHead()
 {
-    QMutexLocker lock(&m_pollItemsMutex);
+    const Segment head = m_segments.takeFirst();
+    head.file->unmap(head.data);
+    head.file->remove();
 
-    PollItems::iterator poIt = m_pollItems.begin();
-    ZMQContext::Sockets::const_iterator soIt = registeredSockets().begin();
-    while (soIt != registeredSockets().end())
+    m_readOffset = m_segments.isEmpty() ? 0 : qint64(qFromBigEndian<quint64>(m_segments.first().data));
+}
+
+NZMQT_INLINE qint64 ZMQSpool::readRecord(const Segment& segment_, qint64 offset_, QList<QByteArray>* message_)
+{
+    const qint64 headerSize = 2 * sizeof(quint32);
+    if (segment_.size - offset_ < headerSize)
+        return 0;
+
+    // A record size of 0 marks the end of the records in a segment.
+    const uchar* pos = segment_.data + offset_;
+    const quint32 size = qFromBigEndian<quint32>(pos);
+    if (size < headerSize || size > segment_.size - offset_)
+        return 0;
+
+    if (message_)
     {
-        if (*soIt == socket_)
+        const uchar* end = pos + size;
+        const quint32 parts = qFromBigEndian<quint32>(pos + sizeof(quint32));
+        pos += headerSize;
+
+        message_->clear();
+        for (quint32 i = 0; i < parts; ++i)
         {
-            m_pollItems.erase(poIt);
-            break;
+            if (end - pos < qint64(sizeof(quint32)) || qFromBigEndian<quint32>(pos) > quint32(end - pos) - sizeof(quint32))
+                return 0;
+
+            const quint32 partSize = qFromBigEndian<quint32>(pos);
+            pos += sizeof(quint32);
+            message_->append(QByteArray(reinterpret_cast<const char*>(pos), int(partSize)));
+            pos += partSize;
         }
-        ++soIt;
-        ++poIt;
     }
 
-    super::unregisterSocket(socket_);
+    return size;
+}
+
+NZMQT_INLINE void ZMQSpool::sync()
+{
+#if defined(Q_OS_UNIX)
+    for (const Segment& segment : m_segments)
+        ::msync(segment.data, size_t(segment.size), MS_SYNC);
+#endif
+    m_unsynced = false;
 }
 
 
 
 /*
- * SocketNotifierZMQSocket
+ * ZMQLatencyHistogram
  */
 
-NZMQT_INLINE SocketNotifierZMQSocket::SocketNotifierZMQSocket(ZMQContext* context_, Type type_)
-    : super(context_, type_)
-    , socketNotifyRead_(0)
-    , socketNotifyWrite_(0)
+NZMQT_INLINE ZMQLatencyHistogram::ZMQLatencyHistogram(int precisionBits_)
+    : m_precisionBits(precisionBits_)
+    , m_counts((1 << precisionBits_) + (64 - precisionBits_) * (1 << (precisionBits_ - 1)), 0)
+    , m_count(0)
+    , m_sum(0)
+    , m_min(0)
+    , m_max(0)
 {
-    qintptr fd = fileDescriptor();
-
-    socketNotifyRead_ = new QSocketNotifier(fd, QSocketNotifier::Read, this);
-    QObject::connect(socketNotifyRead_, &QSocketNotifier::activated, this, &SocketNotifierZMQSocket::socketReadActivity);
-
-    socketNotifyWrite_ = new QSocketNotifier(fd, QSocketNotifier::Write, this);
-    QObject::connect(socketNotifyWrite_, &QSocketNotifier::activated, this, &SocketNotifierZMQSocket::socketWriteActivity);
 }
 
-NZMQT_INLINE SocketNotifierZMQSocket::~SocketNotifierZMQSocket()
+NZMQT_INLINE int ZMQLatencyHistogram::precisionBits() const
 {
-    close();
+    return m_precisionBits;
 }
 
-NZMQT_INLINE void SocketNotifierZMQSocket::close()
+NZMQT_INLINE void ZMQLatencyHistogram::record(qint64 nsecs_)
 {
-    socketNotifyRead_->deleteLater();
-    socketNotifyWrite_->deleteLater();
-    super::close();
+    const qint64 value = qMax<qint64>(nsecs_, 0);
+
+    ++m_counts[bucketIndex(quint64(value))];
+    m_sum += quint64(value);
+    if (0 == m_count++ || value < m_min)
+        m_min = value;
+    if (value > m_max)
+        m_max = value;
 }
 
-NZMQT_INLINE void SocketNotifierZMQSocket::socketReadActivity()
+NZMQT_INLINE void ZMQLatencyHistogram::merge(const ZMQLatencyHistogram& other_)
 {
-    socketNotifyRead_->setEnabled(false);
+    if (0 == other_.m_count)
+        return;
 
-    try
+    if (other_.m_precisionBits == m_precisionBits)
     {
-        while(isConnected() && (events() & EVT_POLLIN))
-        {
-            const QList<QByteArray> & message = receiveMessage();
-            emit messageReceived(message);
-        }
+        for (int i = 0; i < m_counts.size(); ++i)
+            m_counts[i] += other_.m_counts[i];
     }
-    catch (const ZMQException& ex)
+    else
     {
-        qWarning("Exception during read: %s", ex.what());
-        emit notifierError(ex.num(), ex.what());
+        for (int i = 0; i < other_.m_counts.size(); ++i)
+            m_counts[bucketIndex(other_.bucketValue(i))] += other_.m_counts[i];
     }
 
-    socketNotifyRead_->setEnabled(true);
+    m_min = 0 == m_count ? other_.m_min : qMin(m_min, other_.m_min);
+    m_max = qMax(m_max, other_.m_max);
+    m_count += other_.m_count;
+    m_sum += other_.m_sum;
 }
 
-NZMQT_INLINE void SocketNotifierZMQSocket::socketWriteActivity()
+NZMQT_INLINE void ZMQLatencyHistogram::reset()
 {
-    socketNotifyWrite_->setEnabled(false);
+    m_counts.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
 
-    try
+NZMQT_INLINE quint64 ZMQLatencyHistogram::count() const
+{
+    return m_count;
+}
+
+NZMQT_INLINE qint64 ZMQLatencyHistogram::min() const
+{
+    return m_min;
+}
+
+NZMQT_INLINE qint64 ZMQLatencyHistogram::max() const
+{
+    return m_max;
+}
+
+NZMQT_INLINE double ZMQLatencyHistogram::mean() const
+{
+    return m_count > 0 ? double(m_sum) / m_count : 0.0;
+}
+
+NZMQT_INLINE qint64 ZMQLatencyHistogram::valueAtPercentile(double percentile_) const
+{
+    if (0 == m_count)
+        return 0;
+
+    const quint64 target = qMax<quint64>(1, quint64(std::ceil(qBound(0.0, percentile_, 100.0) / 100.0 * m_count)));
+    quint64 cumulated = 0;
+    for (int i = 0; i < m_counts.size(); ++i)
     {
-        while (isConnected() && (events() & EVT_POLLIN))
-        {
-            const QList<QByteArray> & message = receiveMessage();
-            emit messageReceived(message);
-        }
+        cumulated += m_counts[i];
+        if (cumulated >= target)
+            return qBound(m_min, qint64(bucketValue(i)), m_max);
     }
-    catch (const ZMQException& ex)
+
+    return m_max;
+}
+
+NZMQT_INLINE QByteArray ZMQLatencyHistogram::toPrometheus(const QByteArray& name_, const QByteArray& labels_) const
+{
+    const QByteArray separator = labels_.isEmpty() ? QByteArray() : QByteArray(",");
+    const QByteArray labels = labels_.isEmpty() ? QByteArray() : "{" + labels_ + "}";
+
+    QByteArray text = "# TYPE " + name_ + " summary\n";
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (double quantile : quantiles)
     {
-        qWarning("Exception during write: %s", ex.what());
-        emit notifierError(ex.num(), ex.what());
+        text += name_ + "{" + labels_ + separator + "quantile=\"" + QByteArray::number(quantile) + "\"} "
+                + QByteArray::number(valueAtPercentile(quantile * 100) / 1e9, 'g', 9) + "\n";
     }
+    text += name_ + "_sum" + labels + " " + QByteArray::number(m_sum / 1e9, 'g', 12) + "\n";
+    text += name_ + "_count" + labels + " " + QByteArray::number(m_count) + "\n";
 
-    socketNotifyWrite_->setEnabled(true);
+    return text;
+}
+
+NZMQT_INLINE int ZMQLatencyHistogram::bucketIndex(quint64 value_) const
+{
+    const int subBuckets = 1 << m_precisionBits;
+    if (value_ < quint64(subBuckets))
+        return int(value_);
+
+#if defined(__GNUC__)
+    const int msb = 63 - __builtin_clzll(value_);
+#else
+    int msb = 0;
+    for (quint64 value = value_; value >>= 1; )
+        ++msb;
+#endif
+
+    // Each power of two above the linear range is split into subBuckets / 2 buckets.
+    const int shift = msb - m_precisionBits + 1;
+    const int halfSubBuckets = subBuckets / 2;
+    return subBuckets + (shift - 1) * halfSubBuckets + int(value_ >> shift) - halfSubBuckets;
+}
+
+NZMQT_INLINE quint64 ZMQLatencyHistogram::bucketValue(int index_) const
+{
+    const int subBuckets = 1 << m_precisionBits;
+    if (index_ < subBuckets)
+        return quint64(index_);
+
+    const int halfSubBuckets = subBuckets / 2;
+    const int shift = (index_ - subBuckets) / halfSubBuckets + 1;
+    const quint64 mantissa = quint64((index_ - subBuckets) % halfSubBuckets + halfSubBuckets);
+    return (mantissa << shift) + ((quint64(1) << shift) - 1);
 }
 
 
 
 /*
- * SocketNotifierZMQContext
+ * ZMQLatencyTracker
  */
 
-NZMQT_INLINE SocketNotifierZMQContext::SocketNotifierZMQContext(QObject* parent_, int io_threads_)
-    : super(parent_, io_threads_)
+NZMQT_INLINE ZMQLatencyTracker::ZMQLatencyTracker(ZMQSocket* socket_, QObject* parent_)
+    : super(parent_)
+    , m_socket(socket_)
 {
+    m_clock.start();
+
+    connect(socket_, &ZMQSocket::messageReceived, this, &ZMQLatencyTracker::receiveReply);
 }
 
-NZMQT_INLINE void SocketNotifierZMQContext::start()
+NZMQT_INLINE ZMQSocket* ZMQLatencyTracker::socket() const
 {
+    return m_socket;
 }
 
-NZMQT_INLINE void SocketNotifierZMQContext::stop()
+NZMQT_INLINE void ZMQLatencyTracker::setIdExtractor(const IdExtractor& idExtractor_)
 {
+    m_idExtractor = idExtractor_;
 }
 
-NZMQT_INLINE bool SocketNotifierZMQContext::isStopped() const
+NZMQT_INLINE const ZMQLatencyHistogram& ZMQLatencyTracker::histogram() const
 {
-    return false;
+    return m_histogram;
 }
 
-NZMQT_INLINE SocketNotifierZMQSocket* SocketNotifierZMQContext::createSocketInternal(ZMQSocket::Type type_)
+NZMQT_INLINE int ZMQLatencyTracker::pendingRequests() const
 {
-    SocketNotifierZMQSocket *socket = new SocketNotifierZMQSocket(this, type_);
-    connect(socket, &SocketNotifierZMQSocket::notifierError,
-            this, &SocketNotifierZMQContext::notifierError);
-    return socket;
+    return m_pending.size() + m_pendingById.size();
+}
+
+NZMQT_INLINE bool ZMQLatencyTracker::sendRequest(const QList<QByteArray>& request_, ZMQSocket::SendFlags flags_)
+{
+    const qint64 sent = m_clock.nsecsElapsed();
+    if (!m_socket->sendMessage(request_, flags_))
+        return false;
+
+    if (m_idExtractor)
+        m_pendingById.insert(m_idExtractor(request_), sent);
+    else
+        m_pending.enqueue(sent);
+
+    return true;
+}
+
+NZMQT_INLINE void ZMQLatencyTracker::reset()
+{
+    m_histogram.reset();
+    m_pending.clear();
+    m_pendingById.clear();
+}
+
+NZMQT_INLINE void ZMQLatencyTracker::receiveReply(const QList<QByteArray>& reply_)
+{
+    const qint64 received = m_clock.nsecsElapsed();
+
+    qint64 sent;
+    if (m_idExtractor)
+    {
+        QHash<QByteArray, qint64>::iterator it = m_pendingById.find(m_idExtractor(reply_));
+        if (it == m_pendingById.end())
+            return;
+        sent = it.value();
+        m_pendingById.erase(it);
+    }
+    else
+    {
+        if (m_pending.isEmpty())
+            return;
+        sent = m_pending.dequeue();
+    }
+
+    const qint64 latency = received - sent;
+    m_histogram.record(latency);
+
+    emit replyReceived(reply_, latency);
 }
 
 }
@@ -31,17 +31,38 @@
 
 #include <zmq.hpp>
 
+#include <QAtomicInteger>
 #include <QByteArray>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFlag>
+#include <QHash>
 #include <QList>
 #include <QMetaType>
+#include <QMap>
 #include <QMutex>
 #include <QObject>
+#include <QPair>
+#include <QQueue>
 #include <QRunnable>
+#include <QSharedMemory>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
 #include <QVector>
 
+#include <functional>
+#include <future>
 #include <type_traits>
 
+#include <atomic>
+
+#if defined(NZMQT_TRACE) && defined(NZMQT_TRACE_USDT)
+ #include <sys/sdt.h>
+#endif
+
 // Define default context implementation to be used.
 #ifndef NZMQT_DEFAULT_ZMQCONTEXT_IMPLEMENTATION
     #define NZMQT_DEFAULT_ZMQCONTEXT_IMPLEMENTATION PollingZMQContext
@@ -58,6 +79,117 @@
     #define NZMQT_POLLINGZMQCONTEXT_DEFAULT_POLLINTERVAL 10 /* msec */
 #endif
 
+// Define default time the busy-polling implementation spins after a message before blocking.
+#ifndef NZMQT_BUSYPOLLINGZMQCONTEXT_DEFAULT_SPINBUDGET
+    #define NZMQT_BUSYPOLLINGZMQCONTEXT_DEFAULT_SPINBUDGET 1000000 /* nsec */
+#endif
+
+// Define maximum time the busy-polling implementation blocks before checking whether it has been stopped.
+#ifndef NZMQT_BUSYPOLLINGZMQCONTEXT_BLOCKTIMEOUT
+    #define NZMQT_BUSYPOLLINGZMQCONTEXT_BLOCKTIMEOUT 10 /* msec */
+#endif
+
+// Define default minimum size of frames to be encoded by a socket's codec stage.
+#ifndef NZMQT_CODEC_DEFAULT_THRESHOLD
+    #define NZMQT_CODEC_DEFAULT_THRESHOLD 1024 /* bytes */
+#endif
+
+// Define default time a shared memory segment is kept alive by its sender.
+#ifndef NZMQT_SHAREDMEMORYCODEC_DEFAULT_LEASETIME
+    #define NZMQT_SHAREDMEMORYCODEC_DEFAULT_LEASETIME 5000 /* msec */
+#endif
+
+// Define default batch size limit of the coalescing sender.
+#ifndef NZMQT_COALESCINGSENDER_DEFAULT_MAXBATCHBYTES
+    #define NZMQT_COALESCINGSENDER_DEFAULT_MAXBATCHBYTES 8192 /* bytes */
+#endif
+
+// Define default flush interval of the coalescing sender.
+#ifndef NZMQT_COALESCINGSENDER_DEFAULT_FLUSHINTERVAL
+    #define NZMQT_COALESCINGSENDER_DEFAULT_FLUSHINTERVAL 1 /* msec */
+#endif
+
+// Define default chunk size of the file sender.
+#ifndef NZMQT_FILESENDER_DEFAULT_CHUNKSIZE
+    #define NZMQT_FILESENDER_DEFAULT_CHUNKSIZE (1024 * 1024) /* bytes */
+#endif
+
+// Define default interval in which the file sender retries sending while the socket's HWM is reached.
+#ifndef NZMQT_FILESENDER_DEFAULT_RETRYINTERVAL
+    #define NZMQT_FILESENDER_DEFAULT_RETRYINTERVAL 1 /* msec */
+#endif
+
+// Define default size of the recorder's log segments.
+#ifndef NZMQT_RECORDER_DEFAULT_SEGMENTSIZE
+    #define NZMQT_RECORDER_DEFAULT_SEGMENTSIZE (64 * 1024 * 1024) /* bytes */
+#endif
+
+// Define default number of records in-between two entries of the recorder's index.
+#ifndef NZMQT_RECORDER_DEFAULT_INDEXINTERVAL
+    #define NZMQT_RECORDER_DEFAULT_INDEXINTERVAL 1024 /* records */
+#endif
+
+// Define default size of the spool's segments.
+#ifndef NZMQT_SPOOL_DEFAULT_SEGMENTSIZE
+    #define NZMQT_SPOOL_DEFAULT_SEGMENTSIZE (16 * 1024 * 1024) /* bytes */
+#endif
+
+// Define default size limit of the spool.
+#ifndef NZMQT_SPOOL_DEFAULT_MAXBYTES
+    #define NZMQT_SPOOL_DEFAULT_MAXBYTES (Q_INT64_C(1024) * 1024 * 1024) /* bytes */
+#endif
+
+// Define default interval in which the spool tries to drain spooled messages.
+#ifndef NZMQT_SPOOL_DEFAULT_DRAININTERVAL
+    #define NZMQT_SPOOL_DEFAULT_DRAININTERVAL 10 /* msec */
+#endif
+
+// Define default maximum number of messages sent per drain attempt.
+#ifndef NZMQT_SPOOL_DEFAULT_DRAINBATCHSIZE
+    #define NZMQT_SPOOL_DEFAULT_DRAINBATCHSIZE 1024 /* messages */
+#endif
+
+// Define NZMQT_METRICS in order to maintain per-socket traffic counters (see 'ZMQSocket::metrics()').
+// Without it the counters are never updated. The layout of sockets and contexts does not depend
+// on it, so applications may use an nzmqt library (NZMQT_LIB) built with or without it. When
+// nzmqt is used header-only, define it for all translation units or for none.
+
+// Define NZMQT_TRACE in order to record tracepoints of the messaging hot path (poll, dequeue,
+// dispatch and send) into per-thread ring buffers (see 'ZMQTrace'). Additionally define
+// NZMQT_TRACE_USDT in order to get USDT probes (provider 'nzmqt', e.g. 'dispatch_B') for perf.
+// Without it the tracepoints compile to nothing.
+#ifdef NZMQT_TRACE
+    #ifdef NZMQT_TRACE_USDT
+        #define NZMQT_TRACE_PROBE(name_, phase_, object_) DTRACE_PROBE1(nzmqt, name_##_##phase_, object_)
+    #else
+        #define NZMQT_TRACE_PROBE(name_, phase_, object_) do {} while (0)
+    #endif
+    // Phase is one of B (begin), E (end) or i (instant) as defined by the Chrome Trace Event format.
+    #define NZMQT_TRACE_EVENT(name_, phase_, object_) \
+        do { \
+            nzmqt::ZMQTrace::record(#name_, #phase_[0], object_); \
+            NZMQT_TRACE_PROBE(name_, phase_, object_); \
+        } while (0)
+#else
+    #define NZMQT_TRACE_EVENT(name_, phase_, object_) do {} while (0)
+#endif
+
+// Define default number of events kept per thread by the trace ring buffers (must be a power of 2).
+#ifndef NZMQT_TRACE_DEFAULT_BUFFERSIZE
+    #define NZMQT_TRACE_DEFAULT_BUFFERSIZE 65536 /* events */
+#endif
+
+// Define default number of bits used for the linear part of latency histogram buckets.
+// Recorded values are kept with a relative error of at most 2^-(bits-1).
+#ifndef NZMQT_LATENCYHISTOGRAM_DEFAULT_PRECISIONBITS
+    #define NZMQT_LATENCYHISTOGRAM_DEFAULT_PRECISIONBITS 7
+#endif
+
+// Define default memory limit of the last value cache.
+#ifndef NZMQT_LASTVALUECACHE_DEFAULT_MAXBYTES
+    #define NZMQT_LASTVALUECACHE_DEFAULT_MAXBYTES (64 * 1024 * 1024) /* bytes */
+#endif
+
 class QSocketNotifier;
 
 namespace nzmqt
@@ -103,6 +235,279 @@ namespace nzmqt
         QByteArray toByteArray();
     };
 
+    // Snapshot of traffic counters of a socket or of all sockets of a context.
+    struct NZMQT_API ZMQMetrics
+    {
+        ZMQMetrics();
+
+        ZMQMetrics& operator+=(const ZMQMetrics& other_);
+
+        double framesPerMessageSent() const;
+
+        double framesPerMessageReceived() const;
+
+        quint64 messagesSent;
+        quint64 bytesSent;
+        quint64 framesSent;
+        // Frames which could not be sent because the operation would have blocked.
+        quint64 sendFailures;
+        quint64 messagesReceived;
+        quint64 bytesReceived;
+        quint64 framesReceived;
+        // Number of 'messageReceived()' emissions and the time spent in connected slots.
+        quint64 handlerCalls;
+        quint64 handlerNsecs;
+    };
+
+    // Dispatch timing of a socket, maintained while the context's stall threshold is set
+    // (see 'ZMQContext::setStallThreshold()'). A dispatch covers receiving a message and
+    // running the slots connected to 'messageReceived()'.
+    struct NZMQT_API ZMQDispatchStatistics
+    {
+        ZMQDispatchStatistics();
+
+        quint64 dispatches;
+        // Dispatches which took at least the stall threshold.
+        quint64 stalls;
+        qint64 totalNsecs;
+        qint64 maxNsecs;
+    };
+
+    // Trailing metadata frame which sockets with trace frames enabled append to each message
+    // (see 'ZMQSocket::setTraceFrameEnabled()'). It carries a trace id and a wall clock
+    // timestamp for each hop a message passes: one when it is sent and one when it is received.
+    // Timestamps taken on different hosts are only comparable if their clocks are synchronized.
+    class NZMQT_API ZMQTraceFrame
+    {
+    public:
+        enum StampKind
+        {
+            STAMP_SENT = 'S',
+            STAMP_RECEIVED = 'R'
+        };
+
+        struct Stamp
+        {
+            StampKind kind;
+            qint64 nsecs;
+        };
+
+        // Creates an invalid frame.
+        ZMQTraceFrame();
+
+        // Creates a frame with a new trace id and no stamps.
+        static ZMQTraceFrame create();
+
+        bool isValid() const;
+
+        quint64 traceId() const;
+
+        QVector<Stamp> stamps() const;
+
+        // Stamps are dropped once the frame holds 255 of them.
+        void addStamp(StampKind kind_, qint64 nsecs_ = currentNsecs());
+
+        // Returns the time between consecutive stamps, i.e. alternately the time a message
+        // spent in transit to the next hop and the time it spent within that hop.
+        QVector<qint64> hopLatencies() const;
+
+        // Returns the time between the first and the last stamp.
+        qint64 totalLatency() const;
+
+        QByteArray toByteArray() const;
+
+        static bool isTraceFrame(const QByteArray& bytes_);
+
+        // Returns an invalid frame if the given bytes are not a trace frame.
+        static ZMQTraceFrame fromByteArray(const QByteArray& bytes_);
+
+        // Returns the trace frame of the message the current thread is dispatching, which
+        // is continued by messages sent from within the slots. Invalid outside of dispatching.
+        static ZMQTraceFrame current();
+
+        // Nanoseconds since the epoch.
+        static qint64 currentNsecs();
+
+    private:
+        friend class ZMQSocket;
+
+        enum
+        {
+            VERSION = 1,
+            // Magic "NZTR", version, trace id and number of stamps.
+            HEADER_SIZE = 4 + 1 + 8 + 1,
+            // Kind and nanoseconds.
+            STAMP_SIZE = 1 + 8
+        };
+
+        static ZMQTraceFrame*& currentFrame();
+
+        quint64 m_traceId;
+        QVector<Stamp> m_stamps;
+        bool m_valid;
+    };
+
+#ifdef NZMQT_TRACE
+    // Collects the events of the tracepoints (see NZMQT_TRACE_EVENT). Each thread appends to its
+    // own lock-free ring buffer, so recording costs a clock read and a few stores. The buffers
+    // outlive their threads, so traces of finished threads can still be written.
+    class NZMQT_API ZMQTrace
+    {
+    public:
+        struct Event
+        {
+            qint64 nsecs;
+            // Must point to a string literal.
+            const char* name;
+            const void* object;
+            char phase;
+        };
+
+        static void record(const char* name_, char phase_, const void* object_ = nullptr);
+
+        // Returns the events of the calling thread, oldest first.
+        static QVector<Event> threadEvents();
+
+        // Writes the events of all threads as Chrome Trace Event JSON, which can be viewed
+        // with Perfetto or chrome://tracing. Events recorded while writing may be missing.
+        static bool writeChromeTrace(QIODevice* device_);
+
+        static bool writeChromeTrace(const QString& fileName_);
+
+        // Discards the events recorded so far.
+        static void clear();
+
+    private:
+        class Buffer;
+
+        static Buffer* threadBuffer();
+
+        static QList<Buffer*> buffers();
+
+        static qint64 now();
+    };
+#endif
+
+    // Interface of codecs used by a socket's codec stage (see 'ZMQSocket::setCodec()').
+    class NZMQT_API ZMQCodec
+    {
+    public:
+        virtual ~ZMQCodec() {}
+
+        // Identifies the codec in the header byte of encoded frames.
+        // Must not be 0, which denotes frames that have not been encoded.
+        virtual quint8 id() const = 0;
+
+        virtual QByteArray encode(const QByteArray& data_) const = 0;
+
+        // Returns an empty byte array if the data cannot be decoded.
+        virtual QByteArray decode(const QByteArray& data_) const = 0;
+
+        // Returns false if peers connected through the given endpoint cannot decode
+        // frames encoded by this codec. Sockets having such an endpoint send all frames
+        // inline, i.e. without encoding them.
+        virtual bool supportsEndpoint(const QString& endpoint_) const { Q_UNUSED(endpoint_); return true; }
+    };
+
+    // Compresses frames using Qt's bundled zlib ('qCompress()').
+    class NZMQT_API ZMQZlibCodec : public ZMQCodec
+    {
+    public:
+        enum { ID = 1 };
+
+        // The compression level ranges from 0 (no compression) to 9 (best compression),
+        // -1 selects zlib's default.
+        explicit ZMQZlibCodec(int compressionLevel_ = -1);
+
+        quint8 id() const override;
+
+        QByteArray encode(const QByteArray& data_) const override;
+
+        QByteArray decode(const QByteArray& data_) const override;
+
+    private:
+        int m_compressionLevel;
+    };
+
+    // Offloads large frames to shared memory for peers on the same host. Instead of the
+    // payload only a small descriptor (segment key, offset and length) travels over the
+    // socket, and the receiving socket's codec stage copies the payload out of the segment.
+    // This saves copies inside 0MQ, but it is not zero-copy: only receivers which skip the
+    // codec stage and use 'attach()' read the payload in place.
+    // A segment starts with the number of readers which have not picked up its payload
+    // yet. Each receiver counts it down once it is done with the payload, and the sender
+    // releases segments nobody is waiting for any more. Segments which are never picked
+    // up, e.g. because a peer went away, are released after the lease time.
+    // If a segment cannot be created the frame is sent inline. The same happens on
+    // sockets having an endpoint which is not local (see 'isLocalEndpoint()'), as
+    // peers on other hosts cannot access the segments.
+    class NZMQT_API ZMQSharedMemoryCodec : public ZMQCodec
+    {
+    public:
+        enum { ID = 2 };
+
+        // Each frame is expected to be picked up by 'readers_' receivers, e.g. the
+        // number of subscribers of a PUB socket.
+        explicit ZMQSharedMemoryCodec(int leaseTime_ = NZMQT_SHAREDMEMORYCODEC_DEFAULT_LEASETIME, int readers_ = 1);
+
+        // Releases all segments still leased.
+        ~ZMQSharedMemoryCodec();
+
+        quint8 id() const override;
+
+        // Copies the data into a new segment and returns its descriptor.
+        QByteArray encode(const QByteArray& data_) const override;
+
+        // Returns a copy of the payload referenced by the given descriptor. Issues a
+        // warning and returns an empty byte array if the descriptor is malformed or the
+        // segment is gone, e.g. since its lease time has expired.
+        QByteArray decode(const QByteArray& data_) const override;
+
+        bool supportsEndpoint(const QString& endpoint_) const override;
+
+        // Releases segments which all readers have picked up, and those whose lease
+        // time has expired. This is done implicitly whenever a frame is encoded.
+        void releaseSegments() const;
+
+        // Returns the number of segments currently kept alive by this codec.
+        int leasedSegments() const;
+
+        // Attaches to the segment referenced by the given frame, which must be a frame
+        // received without codec stage (i.e. including its header byte). On success
+        // 'data_' and 'size_' refer to the payload inside the segment, which stays
+        // valid as long as the returned segment is referenced. Dropping the last
+        // reference counts the reader down, so attach only once per frame.
+        // Returns a null pointer if the frame is no descriptor or the segment is gone.
+        static QSharedPointer<QSharedMemory> attach(const QByteArray& frame_, const char** data_, int* size_);
+
+        // Returns true if peers connected through the given endpoint are located
+        // on the same host (inproc, ipc and tcp on the loopback interface).
+        static bool isLocalEndpoint(const QString& endpoint_);
+
+    private:
+        struct Lease
+        {
+            QSharedPointer<QSharedMemory> segment;
+            qint64 expiry;
+        };
+
+        // Size of the segment header holding the number of pending readers.
+        enum { SEGMENT_HEADER_SIZE = 8 };
+
+        static QBasicAtomicInt* pendingReaders(QSharedMemory* segment_);
+
+        static void releaseReader(QSharedMemory* segment_);
+
+        static QSharedPointer<QSharedMemory> attachDescriptor(const QByteArray& descriptor_, const char** data_, int* size_);
+
+        int m_leaseTime;
+        int m_readers;
+        QElapsedTimer m_clock;
+        mutable QMutex m_leasesMutex;
+        mutable QQueue<Lease> m_leases;
+        mutable quint64 m_segmentCounter;
+    };
+
     class ZMQContext;
 
     // This class cannot be instantiated. Its purpose is to serve as an
@@ -177,6 +582,9 @@ namespace nzmqt
 #ifdef ZMQ_REQ_RELAXED
             OPT_REQ_RELAXED = ZMQ_REQ_RELAXED,
 #endif
+#ifdef ZMQ_XPUB_VERBOSE
+            OPT_XPUB_VERBOSE = ZMQ_XPUB_VERBOSE,
+#endif
 
             // Get and set.
             OPT_AFFINITY = ZMQ_AFFINITY,
@@ -222,6 +630,16 @@ namespace nzmqt
 
         void getOption(Option option_, void *optval_, size_t *optvallen_) const;
 
+        // Restricts this socket to the given I/O threads of its context (numbered from 0,
+        // see 'ZMQContext::OPT_IO_THREADS') by setting 'OPT_AFFINITY'. Only connections
+        // made by binding or connecting afterwards are affected. An empty list lets 0MQ
+        // choose among all I/O threads again. Throws EINVAL for indexes outside [0, 63].
+        void setIoThreads(const QList<int>& ioThreads_);
+
+        QList<int> ioThreads() const;
+
+        // Binding and connecting apply the context's endpoint profile of the given address
+        // first, if any (see 'ZMQContext::setEndpointProfile()').
         void bindTo(const QString& addr_);
 
         void bindTo(const char *addr_);
@@ -294,9 +712,88 @@ namespace nzmqt
 
         bool isConnected();
 
+        // Installs a codec stage which is applied to messages sent and received as byte arrays.
+        // A sent frame of at least 'threshold_' bytes is encoded if this makes it smaller.
+        // Each frame passing the stage gets a one byte header denoting the codec used (or 0),
+        // so the receiving socket needs the same codec installed in order to decode it.
+        // Frames which are not encoded, e.g. because they are below the threshold, still
+        // pay for the header and for one more copy of their data.
+        // The first 'skipParts_' parts of a message don't pass the stage, so they are
+        // sent as is. Use this for topics (PUB-SUB) or routing envelopes (ROUTER).
+        // Once the socket is bound or connected to an endpoint the codec does not
+        // support (see 'ZMQCodec::supportsEndpoint()'), frames are sent inline.
+        // Frames which cannot be decoded are delivered as empty frames.
+        // Pass a null pointer in order to remove the stage.
+        void setCodec(const QSharedPointer<ZMQCodec>& codec_, int threshold_ = NZMQT_CODEC_DEFAULT_THRESHOLD, int skipParts_ = 0);
+
+        QSharedPointer<ZMQCodec> codec() const;
+
+        // Returns a snapshot of the socket's traffic counters. The counters are only
+        // maintained if NZMQT_METRICS is defined, otherwise all of them are 0.
+        ZMQMetrics metrics() const;
+
+        // Starts monitoring the given connection events (ZMQ_EVENT_* flags), which are then
+        // emitted as signals. The events are received by an inproc PAIR socket which is
+        // serviced by the context like any other socket, so nothing blocks. Start monitoring
+        // before binding or connecting in order not to miss any events. Note that 0MQ does
+        // not report events for the inproc transport.
+        void startMonitor(int events_ = ZMQ_EVENT_ALL);
+
+        void stopMonitor();
+
+        bool isMonitored() const;
+
+        // Returns the socket's dispatch timing. Call it from the socket's thread.
+        ZMQDispatchStatistics dispatchStatistics() const;
+
+        void resetDispatchStatistics();
+
+        // Enables the trace frame: every message sent gets a trailing trace frame, which
+        // continues the trace of the message being dispatched (see 'ZMQTraceFrame::current()')
+        // or starts a new one, stamped with the send time. Trace frames of received messages
+        // are stripped, stamped with the receive time and available via 'receivedTraceFrame()',
+        // so slots never see them. Peers need to enable it as well.
+        void setTraceFrameEnabled(bool enabled_);
+
+        bool isTraceFrameEnabled() const;
+
+        // Returns the trace frame of the last message received, which is invalid if the
+        // message had none.
+        ZMQTraceFrame receivedTraceFrame() const;
+
+        typedef std::function<void(const QList<QByteArray>& message)> MessageHandler;
+
+        // Sets a handler the context calls with each received message instead of emitting
+        // 'messageReceived()', which saves the signal's activation and, for queued
+        // connections, the event posting. The handler runs within the thread dispatching the
+        // socket's messages. It must neither delete the socket (use 'deleteLater()') nor
+        // replace itself. Pass an empty handler in order to emit the signal again.
+        // Note that everything connected to 'messageReceived()' stops receiving messages,
+        // including the helpers attaching to a socket by that signal (e.g.
+        // 'ZMQTopicDispatcher', 'ZMQSequencedReceiver' or 'ZMQFileReceiver'). A warning is
+        // issued if the signal is connected when a handler is set.
+        void setMessageHandler(const MessageHandler& handler_);
+
+        bool hasMessageHandler() const;
+
     signals:
         void messageReceived(const QList<QByteArray>&);
 
+        // Emitted for each monitor event. The event is one of the ZMQ_EVENT_* constants and
+        // the value depends on the event (e.g. a file descriptor or an error number).
+        void monitorEvent(int event, int value, const QString& endpoint);
+
+        void connected(const QString& endpoint);
+
+        void connectRetried(const QString& endpoint, int intervalMsecs);
+
+        void accepted(const QString& endpoint);
+
+        void disconnected(const QString& endpoint);
+
+        // Only emitted by 0MQ 4.3 or later.
+        void handshakeSucceeded(const QString& endpoint);
+
     public slots:
         void close();
 
@@ -312,16 +809,155 @@ namespace nzmqt
     protected:
         ZMQSocket(ZMQContext* context_, Type type_);
 
+        // Emits 'messageReceived()', measuring the time spent in connected slots.
+        // If 'dispatchStart_' is given and not negative (see 'dispatchClock()'), the time
+        // elapsed since then is accounted as one dispatch and '*dispatchStart_' is advanced to
+        // the end of it. So a loop dispatching several messages reads the clock once per message.
+        void emitMessageReceived(const QList<QByteArray>& message_, qint64* dispatchStart_ = nullptr);
+
+        // Returns the current time of the context's dispatch clock, or -1 if no stall
+        // threshold is set.
+        qint64 dispatchClock() const;
+
     private:
         friend class ZMQContext;
+        friend class PollingZMQContext;
+        friend class BusyPollingZMQContext;
+
+        bool sendPart(const QByteArray& bytes_, SendFlags flags_);
+
+        bool sendEncodedMessage(const QByteArray& bytes_, SendFlags flags_);
+
+        bool sendTraceFrame(SendFlags flags_);
+
+        void decodeMessage(QList<QByteArray>& parts_) const;
+
+        void applyEndpointProfile(const QString& addr_);
+
+        void addEndpoint(const QString& addr_);
+
+        void removeEndpoint(const QString& addr_);
+
+        // Determines whether frames may be encoded given the socket's endpoints.
+        void updateCodecSupport();
+
+    private slots:
+        void receiveMonitorEvent(const QList<QByteArray>& event_);
 
+    private:
         ZMQContext* m_context;
+        ZMQSocket* m_monitor;
+        // Index within the context's registered sockets.
+        int m_registryIndex;
+        ZMQDispatchStatistics m_dispatchStatistics;
+        bool m_traceFrameEnabled;
+        ZMQTraceFrame m_receivedTraceFrame;
+        MessageHandler m_messageHandler;
+
+        QSharedPointer<ZMQCodec> m_codec;
+        int m_codecThreshold;
+        int m_codecSkipParts;
+        // Endpoints bound or connected to, and whether the codec supports all of them.
+        QStringList m_endpoints;
+        bool m_codecSupportsEndpoints;
+        // Index of the next part to be sent.
+        int m_sendPart;
+
+        enum Counter
+        {
+            CNT_MESSAGESSENT,
+            CNT_BYTESSENT,
+            CNT_FRAMESSENT,
+            CNT_SENDFAILURES,
+            CNT_MESSAGESRECEIVED,
+            CNT_BYTESRECEIVED,
+            CNT_FRAMESRECEIVED,
+            CNT_HANDLERCALLS,
+            CNT_HANDLERNSECS,
+            CNT_COUNT
+        };
+
+        void count(Counter counter_, quint64 value_ = 1);
+
+        std::atomic<quint64> m_counters[CNT_COUNT];
     };
     Q_DECLARE_OPERATORS_FOR_FLAGS(ZMQSocket::Events)
     Q_DECLARE_OPERATORS_FOR_FLAGS(ZMQSocket::SendFlags)
     Q_DECLARE_OPERATORS_FOR_FLAGS(ZMQSocket::ReceiveFlags)
 
 
+    // A named set of socket option values. Profiles are applied to sockets by the context
+    // which created them (see 'ZMQContext::setSocketProfile()' and
+    // 'ZMQContext::setEndpointProfile()'). They compose: values of a profile added later
+    // override the ones of the profiles added before.
+    class NZMQT_API ZMQSocketProfile
+    {
+    public:
+        ZMQSocketProfile(const QString& name_ = QString());
+
+        QString name() const;
+
+        bool isEmpty() const;
+
+        bool contains(ZMQSocket::Option option_) const;
+
+        qint64 value(ZMQSocket::Option option_, qint64 defaultValue_ = 0) const;
+
+        ZMQSocketProfile& setValue(ZMQSocket::Option option_, qint64 value_);
+
+        void removeValue(ZMQSocket::Option option_);
+
+        // Returns the options in the order they are applied.
+        QList<ZMQSocket::Option> options() const;
+
+        // Adds the values of the given profile, overriding the ones set already.
+        ZMQSocketProfile& operator+=(const ZMQSocketProfile& other_);
+
+        ZMQSocketProfile operator+(const ZMQSocketProfile& other_) const;
+
+        // Sets all values of this profile on the given socket. Options the socket refuses
+        // (e.g. because its type does not support them) are skipped with a warning.
+        void applyTo(ZMQSocket* socket_) const;
+
+        // Small queues, no queueing for peers which are not connected yet and no lingering:
+        // bounds the time a message can spend waiting within the sockets.
+        static ZMQSocketProfile lowLatency();
+
+        // Large queues and kernel buffers, so that bursts of large messages do not stall
+        // the sender.
+        static ZMQSocketProfile bulkThroughput();
+
+        // Small queues and kernel buffers, a large listen backlog and slow reconnects:
+        // bounds the memory spent on peers which rarely send or receive anything.
+        static ZMQSocketProfile manyIdlePeers();
+
+        // Returns the preset of the given name ("low-latency", "bulk-throughput" or
+        // "many-idle-peers"), or an empty profile.
+        static ZMQSocketProfile preset(const QString& name_);
+
+        // Returns the option of the given configuration key (e.g. "sndhwm"), or -1.
+        static int optionFromName(const QString& name_);
+
+        // Reads the profiles of an INI file. Each group defines one profile. Keys are the
+        // lower case option names without the 'OPT_' prefix, the key 'base' lists the
+        // presets or profiles of the file the profile is composed of, and the key
+        // 'endpoints' lists the endpoint prefixes the profile applies to (see
+        // 'ZMQContext::setEndpointProfile()'). Returns false if the file cannot be read
+        // or contains unknown keys or profiles.
+        //
+        //     [feed]
+        //     base = bulk-throughput
+        //     sndhwm = 500000
+        //     endpoints = "tcp://feed.example.com:", ipc:///run/feed
+        static bool load(const QString& fileName_, QList<ZMQSocketProfile>* profiles_,
+                         QMap<QString, ZMQSocketProfile>* endpointProfiles_ = nullptr);
+
+    private:
+        QString m_name;
+        QList<QPair<ZMQSocket::Option, qint64> > m_values;
+    };
+
+
     // This class is an abstract base class for concrete implementations.
     class NZMQT_API ZMQContext : public QObject, private zmq::context_t
     {
@@ -333,6 +969,30 @@ namespace nzmqt
         friend class ZMQSocket;
 
     public:
+        enum Option
+        {
+            // Get only.
+#ifdef ZMQ_SOCKET_LIMIT
+            OPT_SOCKET_LIMIT = ZMQ_SOCKET_LIMIT,
+#endif
+
+            // Set only.
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+            OPT_THREAD_AFFINITY_CPU_ADD = ZMQ_THREAD_AFFINITY_CPU_ADD,
+            OPT_THREAD_AFFINITY_CPU_REMOVE = ZMQ_THREAD_AFFINITY_CPU_REMOVE,
+#endif
+
+            // Get and set.
+            OPT_IO_THREADS = ZMQ_IO_THREADS,
+            OPT_MAX_SOCKETS = ZMQ_MAX_SOCKETS,
+#ifdef ZMQ_THREAD_PRIORITY
+            OPT_THREAD_PRIORITY = ZMQ_THREAD_PRIORITY,
+#endif
+#ifdef ZMQ_THREAD_SCHED_POLICY
+            OPT_THREAD_SCHED_POLICY = ZMQ_THREAD_SCHED_POLICY,
+#endif
+        };
+
         ZMQContext(QObject* parent_ = nullptr, int io_threads_ = NZMQT_DEFAULT_IOTHREADS);
 
         // Deleting children is necessary, because otherwise the children are deleted after the context
@@ -342,6 +1002,28 @@ namespace nzmqt
 
         using zmqsuper::operator void*;
 
+        // Sets an option of the 0MQ context. 0MQ starts its I/O threads when the first socket
+        // is created, so the options concerning them or the number of sockets must be set
+        // before that. Setting them later has no effect and issues a warning.
+        void setOption(Option option_, int value_);
+
+        int option(Option option_) const;
+
+        // Pins 0MQ's I/O threads to the given CPUs, keeping them off the cores running the
+        // threads which dispatch messages. Must be called before the first socket is created.
+        // Throws if 0MQ does not support thread affinity.
+        void setIoThreadCpus(const QList<int>& cpus_);
+
+        // Sets the scheduling policy (e.g. SCHED_FIFO) and priority of 0MQ's I/O threads.
+        // Must be called before the first socket is created.
+        void setIoThreadPriority(int schedPolicy_, int priority_);
+
+        int ioThreads() const;
+
+        // Returns the largest number of sockets which may be set by 'OPT_MAX_SOCKETS',
+        // or -1 if 0MQ does not tell.
+        int socketLimit() const;
+
         // Creates a socket instance of the specified type and parent.
         // The created instance will have the specified parent
         // (as usual you can also call 'ZMQSocket::setParent()' method to change
@@ -359,12 +1041,52 @@ namespace nzmqt
         // Indicates if watching for incoming messages is enabled.
         virtual bool isStopped() const = 0;
 
+        // Returns the sum of the metrics of all sockets created by this context,
+        // including the ones which have been closed already.
+        ZMQMetrics metrics() const;
+
+        // Enables dispatch timing of all sockets of this context: 'dispatchStall()' is emitted
+        // whenever receiving a message and running the connected slots takes at least the
+        // given time. This costs one monotonic clock read per dispatch, so it may be left on
+        // in production. Pass 0 in order to disable it (the default).
+        void setStallThreshold(qint64 nsecs_);
+
+        qint64 stallThreshold() const;
+
+        // Sets the profile applied to every socket created by this context from now on.
+        void setSocketProfile(const ZMQSocketProfile& profile_);
+
+        ZMQSocketProfile socketProfile() const;
+
+        // Sets a profile applied to a socket of this context right before it binds or
+        // connects to an endpoint starting with the given prefix, overriding the values of
+        // the socket profile. The longest matching prefix wins. The values stay in effect
+        // for later endpoints of the same socket. Pass an empty profile in order to remove it.
+        void setEndpointProfile(const QString& endpointPrefix_, const ZMQSocketProfile& profile_);
+
+        // Returns the endpoint profile applying to the given address, or an empty profile.
+        ZMQSocketProfile endpointProfile(const QString& addr_) const;
+
+        // Loads the profiles of the given file (see 'ZMQSocketProfile::load()') and installs
+        // their endpoint profiles. The profile named 'default', if any, becomes the socket
+        // profile. Returns false, leaving the profiles untouched, if the file is invalid.
+        bool loadSocketProfiles(const QString& fileName_);
+
+    signals:
+        // Emitted from within the thread of the stalling socket.
+        void dispatchStall(nzmqt::ZMQSocket* socket, qint64 nsecs);
+
     protected:
         typedef QVector<ZMQSocket*> Sockets;
 
+        // Returns the current time of the dispatch clock, or -1 if no stall threshold is set.
+        qint64 dispatchClock() const;
+
         // Creates a socket instance of the specified type.
         virtual ZMQSocket* createSocketInternal(ZMQSocket::Type type_) = 0;
 
+        // Registering and unregistering take constant time. Unregistering moves the last
+        // socket into the place of the removed one, so the order of sockets is not kept.
         virtual void registerSocket(ZMQSocket* socket_);
 
         // Remove the given socket object from the list of registered sockets.
@@ -374,6 +1096,14 @@ namespace nzmqt
 
     private:
         Sockets m_sockets;
+        mutable QMutex m_socketsMutex;
+        QAtomicInteger<qint64> m_stallThreshold;
+        QElapsedTimer m_dispatchClock;
+        QAtomicInt m_socketsCreated;
+        ZMQSocketProfile m_socketProfile;
+        QMap<QString, ZMQSocketProfile> m_endpointProfiles;
+        mutable QMutex m_profilesMutex;
+        ZMQMetrics m_closedSocketMetrics;
     };
 
 /*
@@ -402,6 +1132,7 @@ namespace nzmqt
 */
 
     class PollingZMQContext;
+    class BusyPollingZMQContext;
 
     // An instance of this class cannot directly be created. Use one
     // of the 'PollingZMQContext::createSocket()' factory methods instead.
@@ -537,6 +1268,1223 @@ namespace nzmqt
         SocketNotifierZMQSocket* createSocketInternal(ZMQSocket::Type type_);
     };
 
+
+    // An instance of this class cannot directly be created. Use one
+    // of the 'BusyPollingZMQContext::createSocket()' factory methods instead.
+    class NZMQT_API BusyPollingZMQSocket : public ZMQSocket
+    {
+        Q_OBJECT
+
+        typedef ZMQSocket super;
+
+        friend class BusyPollingZMQContext;
+
+    protected:
+        BusyPollingZMQSocket(BusyPollingZMQContext* context_, Type type_);
+    };
+
+    // Polls its sockets from a dedicated thread, trading a CPU core for wake-up latency:
+    // after each message the thread keeps polling without blocking for the spin budget
+    // before it falls back to blocking. Messages are handed to the message handler, if
+    // one is set, from within the polling thread and without any Qt event posting.
+    // Otherwise the socket's own handler is called (see 'ZMQSocket::setMessageHandler()')
+    // or 'messageReceived()' is emitted from within the polling thread, so only slots
+    // connected directly avoid Qt's event queue.
+    // As 0MQ sockets must not be used by two threads at the same time, sockets should be
+    // set up before starting the context and, while it is running, only be used from
+    // within the handler or slots called by the polling thread. Sockets may still be
+    // created and closed from other threads: these wake the polling thread up instead
+    // of waiting for its blocking poll to time out.
+    class NZMQT_API BusyPollingZMQContext : public ZMQContext
+    {
+        Q_OBJECT
+
+        typedef ZMQContext super;
+
+    public:
+        typedef std::function<void(ZMQSocket* socket, const QList<QByteArray>& message)> MessageHandler;
+
+        BusyPollingZMQContext(QObject* parent_ = nullptr, int io_threads_ = NZMQT_DEFAULT_IOTHREADS);
+
+        // Stops the polling thread before the sockets are closed.
+        ~BusyPollingZMQContext();
+
+        // Sets the time the polling thread spins after the last message before it blocks.
+        void setSpinBudget(qint64 nsecs_);
+
+        qint64 spinBudget() const;
+
+        // Pins the polling thread to the given CPU (Linux only), or unpins it if -1 is given.
+        // Takes effect the next time the context is started.
+        void setCpu(int cpu_);
+
+        int cpu() const;
+
+        // Must not be changed while the context is running.
+        void setMessageHandler(const MessageHandler& handler_);
+
+        // Starts the polling thread.
+        void start() override;
+
+        // Stops the polling thread and waits for it to finish, unless called from within it.
+        void stop() override;
+
+        bool isStopped() const override;
+
+    signals:
+        // Emitted from within the polling thread if polling results in an exception. The
+        // thread waits longer after each error in a row, and stops on ETERM.
+        void pollError(int errorNum, const QString& errorMsg);
+
+    protected:
+        BusyPollingZMQSocket* createSocketInternal(ZMQSocket::Type type_) override;
+
+        void registerSocket(ZMQSocket* socket_) override;
+
+        void unregisterSocket(ZMQSocket* socket_) override;
+
+    private:
+        typedef QVector<pollitem_t> PollItems;
+
+        class PollThread : public QThread
+        {
+        public:
+            explicit PollThread(BusyPollingZMQContext* context_);
+
+        protected:
+            void run() override;
+
+        private:
+            BusyPollingZMQContext* m_context;
+        };
+
+        void pollLoop();
+
+        // Polls once and delivers all messages queued by the readable sockets.
+        // Returns false if no message has been received.
+        bool poll(long timeout_);
+
+        // Interrupts a blocking poll, so that other threads get hold of the poll items.
+        void wakePollThread();
+
+        // The first item belongs to 'm_wakeReceiver', the others to the registered sockets
+        // in the same order.
+        PollItems m_pollItems;
+        QMutex m_pollItemsMutex;
+        void* m_wakeSender;
+        void* m_wakeReceiver;
+        QMutex m_wakeSenderMutex;
+        // Number of threads waiting for the poll items.
+        QAtomicInt m_pollItemsWaiters;
+        QAtomicInteger<qint64> m_spinBudget;
+        int m_cpu;
+        MessageHandler m_messageHandler;
+        QAtomicInt m_stopped;
+        PollThread* m_thread;
+    };
+
+    // Operations supported by the sockets of the given type, checked at compile time
+    // by 'ZMQTypedSocket'.
+    template<ZMQSocket::Type TYPE>
+    struct ZMQSocketTraits
+    {
+        static constexpr bool canSend = TYPE != ZMQSocket::TYP_SUB && TYPE != ZMQSocket::TYP_PULL;
+        static constexpr bool canReceive = TYPE != ZMQSocket::TYP_PUB && TYPE != ZMQSocket::TYP_PUSH;
+        // 0MQ rejects the subscription options on XSUB sockets, which send subscription
+        // messages instead.
+        static constexpr bool canSubscribe = TYPE == ZMQSocket::TYP_SUB;
+        static constexpr bool sendsSubscriptions = TYPE == ZMQSocket::TYP_XSUB;
+        // Messages start with the identity of the peer they are received from or sent to.
+        static constexpr bool hasEnvelope = TYPE == ZMQSocket::TYP_ROUTER;
+    };
+
+    // A handle of a socket which only offers the operations valid for the socket's type, so
+    // misuse (e.g. subscribing a PUSH socket or sending on a ROUTER socket without an
+    // envelope) is rejected at compile time. The handle neither owns the socket nor is it a
+    // QObject: messages can be received directly or through a message handler without
+    // going through Qt's signals. Copying the handle is cheap.
+    template<ZMQSocket::Type TYPE>
+    class ZMQTypedSocket
+    {
+        typedef ZMQSocketTraits<TYPE> Traits;
+
+    public:
+        // Creates a socket of this type using the given context (see 'ZMQContext::createSocket()').
+        explicit ZMQTypedSocket(ZMQContext* context_, QObject* parent_ = nullptr)
+            : m_socket(context_->createSocket(TYPE, parent_))
+        {
+        }
+
+        // Wraps a socket of this type.
+        explicit ZMQTypedSocket(ZMQSocket* socket_)
+            : m_socket(socket_)
+        {
+            Q_ASSERT_X(socketType(socket_) == TYPE, Q_FUNC_INFO, "The socket is of another type.");
+        }
+
+        ZMQSocket* socket() const
+        {
+            return m_socket;
+        }
+
+        void bindTo(const QString& addr_)
+        {
+            m_socket->bindTo(addr_);
+        }
+
+        void connectTo(const QString& addr_)
+        {
+            m_socket->connectTo(addr_);
+        }
+
+        void unbindFrom(const QString& addr_)
+        {
+            m_socket->unbindFrom(addr_);
+        }
+
+        void disconnectFrom(const QString& addr_)
+        {
+            m_socket->disconnectFrom(addr_);
+        }
+
+        void subscribeTo(const QByteArray& filter_)
+        {
+            static_assert(Traits::canSubscribe, "Only SUB sockets subscribe, XSUB sockets use 'sendSubscription()'.");
+            m_socket->subscribeTo(filter_);
+        }
+
+        void unsubscribeFrom(const QByteArray& filter_)
+        {
+            static_assert(Traits::canSubscribe, "Only SUB sockets subscribe, XSUB sockets use 'sendSubscription()'.");
+            m_socket->unsubscribeFrom(filter_);
+        }
+
+        // Sends a subscription message upstream, i.e. the given filter prefixed by 1
+        // (subscribe) or 0 (unsubscribe).
+        bool sendSubscription(const QByteArray& filter_, bool subscribe_ = true,
+                              ZMQSocket::SendFlags flags_ = ZMQSocket::SND_DONTWAIT)
+        {
+            static_assert(Traits::sendsSubscriptions, "Only XSUB sockets send subscription messages.");
+            return m_socket->sendMessage(QByteArray(1, subscribe_ ? '\x01' : '\x00') + filter_, flags_);
+        }
+
+        // Sends a single-frame message.
+        bool send(const QByteArray& frame_, ZMQSocket::SendFlags flags_ = ZMQSocket::SND_DONTWAIT)
+        {
+            static_assert(Traits::canSend, "Sockets of this type cannot send.");
+            static_assert(!Traits::hasEnvelope, "Use 'sendTo()' in order to address the peer.");
+            return m_socket->sendMessage(frame_, flags_);
+        }
+
+        bool send(const QList<QByteArray>& message_, ZMQSocket::SendFlags flags_ = ZMQSocket::SND_DONTWAIT)
+        {
+            static_assert(Traits::canSend, "Sockets of this type cannot send.");
+            static_assert(!Traits::hasEnvelope, "Use 'sendTo()' in order to address the peer.");
+            return m_socket->sendMessage(message_, flags_);
+        }
+
+        // Sends a message to the peer of the given identity. Throws a ZMQException (EINVAL)
+        // if the message is empty, which would leave the identity frame pending.
+        bool sendTo(const QByteArray& identity_, const QList<QByteArray>& message_,
+                    ZMQSocket::SendFlags flags_ = ZMQSocket::SND_DONTWAIT)
+        {
+            static_assert(Traits::hasEnvelope, "Only ROUTER sockets address their peers.");
+            if (message_.isEmpty())
+            {
+                errno = EINVAL;
+                throw ZMQException();
+            }
+            return m_socket->sendMessage(identity_, flags_ | ZMQSocket::SND_MORE)
+                    && m_socket->sendMessage(message_, flags_);
+        }
+
+        // Receives a message, which is empty if none is available.
+        QList<QByteArray> receive(ZMQSocket::ReceiveFlags flags_ = ZMQSocket::RCV_DONTWAIT)
+        {
+            static_assert(Traits::canReceive, "Sockets of this type cannot receive.");
+            static_assert(!Traits::hasEnvelope, "Use 'receiveFrom()' in order to learn the peer.");
+            return m_socket->receiveMessage(flags_);
+        }
+
+        // Receives the first frame of a message into the given buffer, dropping any further
+        // frames. Unless the socket uses a codec or trace frames, this takes no detour through
+        // a list of frames. Returns false if no message is available.
+        bool receive(QByteArray* frame_, ZMQSocket::ReceiveFlags flags_ = ZMQSocket::RCV_DONTWAIT)
+        {
+            static_assert(Traits::canReceive, "Sockets of this type cannot receive.");
+            static_assert(!Traits::hasEnvelope, "Use 'receiveFrom()' in order to learn the peer.");
+            if (m_socket->codec() || m_socket->isTraceFrameEnabled())
+            {
+                const QList<QByteArray> message = m_socket->receiveMessage(flags_);
+                if (message.isEmpty())
+                    return false;
+                *frame_ = message.first();
+                return true;
+            }
+
+            ZMQMessage msg;
+            if (!m_socket->receiveMessage(&msg, flags_))
+                return false;
+            *frame_ = msg.toByteArray();
+            while (m_socket->hasMoreMessageParts())
+            {
+                msg.rebuild();
+                m_socket->receiveMessage(&msg, ZMQSocket::ReceiveFlags());
+            }
+            return true;
+        }
+
+        // Receives a message without the identity of the peer it came from, which is stored
+        // in the given buffer. The message is empty if none is available.
+        QList<QByteArray> receiveFrom(QByteArray* identity_, ZMQSocket::ReceiveFlags flags_ = ZMQSocket::RCV_DONTWAIT)
+        {
+            static_assert(Traits::hasEnvelope, "Only ROUTER sockets learn their peers.");
+            QList<QByteArray> message = m_socket->receiveMessage(flags_);
+            *identity_ = message.isEmpty() ? QByteArray() : message.takeFirst();
+            return message;
+        }
+
+        // See 'ZMQSocket::setMessageHandler()'. The messages of ROUTER sockets start with
+        // the identity of the peer.
+        void setMessageHandler(const ZMQSocket::MessageHandler& handler_)
+        {
+            static_assert(Traits::canReceive, "Sockets of this type cannot receive.");
+            m_socket->setMessageHandler(handler_);
+        }
+
+    private:
+        static int socketType(ZMQSocket* socket_)
+        {
+            int type = -1;
+            size_t size = sizeof(type);
+            socket_->getOption(ZMQSocket::OPT_TYPE, &type, &size);
+            return type;
+        }
+
+        ZMQSocket* m_socket;
+    };
+
+    typedef ZMQTypedSocket<ZMQSocket::TYP_PUB> ZMQPubSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_SUB> ZMQSubSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_PUSH> ZMQPushSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_PULL> ZMQPullSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_REQ> ZMQReqSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_REP> ZMQRepSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_DEALER> ZMQDealerSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_ROUTER> ZMQRouterSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_PAIR> ZMQPairSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_XPUB> ZMQXPubSocket;
+    typedef ZMQTypedSocket<ZMQSocket::TYP_XSUB> ZMQXSubSocket;
+
+    // Dispatches messages received by a SUB socket to handlers registered per topic prefix.
+    // Handlers are indexed by a byte-level trie, so for each message only the handlers
+    // whose prefix matches the message's topic (i.e. its first part) are invoked. The socket
+    // is subscribed to a prefix as soon as the first handler for it is added, and it is
+    // unsubscribed again as soon as the last handler for it is removed.
+    // Handlers may be added or removed from within a handler. Such changes take effect
+    // after the current message has been dispatched.
+    class NZMQT_API ZMQTopicDispatcher : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        typedef std::function<void(const QList<QByteArray>&)> Handler;
+        typedef quint32 HandlerId;
+
+        // Connects to the given socket's 'messageReceived()' signal. The dispatcher uses the
+        // socket for (un)subscribing, so make sure the socket outlives the dispatcher (e.g.
+        // by making the socket the dispatcher's parent).
+        explicit ZMQTopicDispatcher(ZMQSocket* socket_, QObject* parent_ = nullptr);
+
+        ZMQSocket* socket() const;
+
+        // Registers a handler for all messages whose topic starts with the given prefix.
+        // An empty prefix matches all messages. The returned id identifies the handler
+        // for a later call to 'removeHandler()'.
+        HandlerId addHandler(const QByteArray& prefix_, const Handler& handler_);
+
+        // Removes the handler with the given id.
+        // Returns false if there is no such handler.
+        bool removeHandler(HandlerId id_);
+
+        // Returns the number of currently registered handlers.
+        int handlerCount() const;
+
+    public slots:
+        // Invokes all handlers whose prefix matches the given message's topic.
+        void dispatch(const QList<QByteArray>& message_);
+
+    private:
+        struct Registration
+        {
+            HandlerId id;
+            Handler handler;
+            bool removed;
+        };
+
+        struct Node
+        {
+            Node() : activeHandlers(0) {}
+
+            // Edge bytes (sorted) and the corresponding child node indexes.
+            QByteArray keys;
+            QVector<int> children;
+            QVector<Registration> handlers;
+            int activeHandlers;
+        };
+
+        struct PendingHandler
+        {
+            QByteArray prefix;
+            Registration registration;
+        };
+
+        int findChild(int node_, char key_) const;
+
+        int findNode(const QByteArray& prefix_) const;
+
+        int insertNode(const QByteArray& prefix_);
+
+        void insertHandler(const QByteArray& prefix_, const Registration& registration_);
+
+        void applyPendingChanges();
+
+        ZMQSocket* m_socket;
+        QVector<Node> m_nodes;
+        QHash<HandlerId, QByteArray> m_prefixes;
+        HandlerId m_nextId;
+        int m_dispatchDepth;
+        QVector<PendingHandler> m_pendingHandlers;
+        QVector<int> m_dirtyNodes;
+    };
+
+    // A last value cache sitting between an XSUB socket connected to upstream publishers
+    // and an XPUB socket downstream subscribers connect to. All messages are forwarded
+    // downstream, and the latest message per topic (i.e. first message part) is kept in a
+    // cache. Whenever the XPUB socket reports a new subscription the cached messages
+    // matching the subscribed prefix are sent immediately, so late joining subscribers
+    // don't have to wait for the next update to see the current state.
+    // The cache is bounded by the total size of the cached messages. If it runs full the
+    // least recently used topics are evicted.
+    class NZMQT_API ZMQLastValueCache : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        struct Statistics
+        {
+            quint64 subscriptions;
+            // Subscriptions for which at least one cached message could be sent.
+            quint64 hits;
+            quint64 misses;
+            quint64 replayedMessages;
+            qint64 lastSnapshotNsecs;
+            qint64 totalSnapshotNsecs;
+
+            double hitRate() const;
+        };
+
+        // The cache subscribes the upstream socket to all topics and makes the downstream
+        // socket report every subscription (not only the first one per topic).
+        // Both sockets must outlive the cache.
+        ZMQLastValueCache(ZMQSocket* upstream_, ZMQSocket* downstream_, int maxBytes_ = NZMQT_LASTVALUECACHE_DEFAULT_MAXBYTES, QObject* parent_ = nullptr);
+
+        void setMaxBytes(int maxBytes_);
+
+        int maxBytes() const;
+
+        // Returns the total size of all currently cached messages.
+        int cachedBytes() const;
+
+        int cachedTopics() const;
+
+        Statistics statistics() const;
+
+        void resetStatistics();
+
+    signals:
+        // Emitted after cached messages have been sent for a new subscription. Subscriptions
+        // matching no cached message only count as misses (see 'Statistics').
+        void snapshotSent(const QByteArray& prefix, int messages, qint64 nsecs);
+
+    public slots:
+        void clear();
+
+    protected slots:
+        void upstreamMessageReceived(const QList<QByteArray>& message_);
+
+        void downstreamMessageReceived(const QList<QByteArray>& message_);
+
+    private:
+        static int messageCost(const QList<QByteArray>& message_);
+
+        ZMQSocket* m_upstream;
+        ZMQSocket* m_downstream;
+        QCache<QByteArray, QList<QByteArray> > m_cache;
+        Statistics m_statistics;
+    };
+
+    // A queue of received messages that only keeps the newest message per key. The key of
+    // a message is determined by a key extractor applied to its first part (by default the
+    // whole first part is used, i.e. the topic). A message arriving for a key which still has
+    // a pending message replaces that message in place, so the queue never grows beyond the
+    // number of distinct keys. Use it for consumers which process messages at their own pace
+    // (e.g. GUI widgets) but need to see the latest value for each key.
+    class NZMQT_API ZMQConflatingQueue : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        typedef std::function<QByteArray(const QByteArray&)> KeyExtractor;
+
+        // Connects to the given socket's 'messageReceived()' signal. If no socket is given
+        // messages need to be fed using the 'enqueue()' slot.
+        explicit ZMQConflatingQueue(ZMQSocket* socket_ = nullptr, QObject* parent_ = nullptr);
+
+        void setKeyExtractor(const KeyExtractor& extractor_);
+
+        // Returns a key extractor using the part of a topic in front of the first
+        // occurrence of the given delimiter.
+        static KeyExtractor keyUntil(char delimiter_);
+
+        bool isEmpty() const;
+
+        // Returns the number of pending messages, i.e. the number of distinct keys.
+        int size() const;
+
+        // Removes and returns the oldest pending message. The queue must not be empty.
+        QList<QByteArray> dequeue();
+
+        // Removes and returns (at most 'max_' if not negative) pending messages
+        // in order of arrival of their keys.
+        QList< QList<QByteArray> > dequeueAll(int max_ = -1);
+
+        // Returns the number of messages which have been replaced by newer ones.
+        quint64 conflatedCount() const;
+
+    signals:
+        // Emitted when a message is enqueued into an empty queue.
+        void messagesAvailable();
+
+    public slots:
+        void enqueue(const QList<QByteArray>& message_);
+
+        void clear();
+
+    private:
+        KeyExtractor m_keyExtractor;
+        QHash<QByteArray, QList<QByteArray> > m_messages;
+        QQueue<QByteArray> m_keys;
+        quint64 m_conflatedCount;
+    };
+
+    // Sends messages with a per-topic sequence number. The sequence number is inserted
+    // right after the topic (i.e. the first message part), so subscriptions still match
+    // the topic, as a 16 byte binary frame holding the sender's epoch and the sequence
+    // number (8 bytes big-endian each). Sequence numbers start with 1 for each topic.
+    // The epoch differs for each sender, so receivers tell a restarted publisher from
+    // duplicates. Use 'ZMQSequencedReceiver' on the receiving side.
+    class NZMQT_API ZMQSequencedSender : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        explicit ZMQSequencedSender(ZMQSocket* socket_, QObject* parent_ = nullptr);
+
+        ZMQSocket* socket() const;
+
+        // Returns the epoch sent along with the sequence numbers, which is derived from
+        // the wall clock at construction and unique within the process.
+        quint64 epoch() const;
+
+        // Returns the sequence number of the last message sent for the given topic
+        // or 0 if no message has been sent yet.
+        quint64 lastSequence(const QByteArray& topic_) const;
+
+        static QByteArray sequenceFrame(quint64 epoch_, quint64 sequence_);
+
+    public slots:
+        // Sends the given multi-part message adding the topic's next sequence number.
+        // The sequence number is only consumed if sending succeeds.
+        bool sendMessage(const QList<QByteArray>& msg_, nzmqt::ZMQSocket::SendFlags flags_ = ZMQSocket::SND_DONTWAIT);
+
+    private:
+        static quint64 nextEpoch();
+
+        ZMQSocket* m_socket;
+        quint64 m_epoch;
+        QHash<QByteArray, quint64> m_sequences;
+    };
+
+    // Receives messages sent by a 'ZMQSequencedSender' and checks their sequence numbers.
+    // Missing sequence numbers (e.g. due to high water mark drops) are reported using the
+    // 'gapDetected()' signal. Duplicates and out of order messages are dropped. All other
+    // messages are re-emitted without the sequence frame. The first message of a topic
+    // is never reported as gap, since a subscriber may join at any time. A message with
+    // another epoch than the previous one of its topic starts the topic over and is
+    // reported using the 'publisherRestarted()' signal.
+    class NZMQT_API ZMQSequencedReceiver : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        struct Statistics
+        {
+            quint64 messages;
+            quint64 gaps;
+            quint64 lostMessages;
+            quint64 duplicates;
+            // Messages without a valid sequence frame.
+            quint64 invalid;
+            quint64 restarts;
+        };
+
+        // Connects to the given socket's 'messageReceived()' signal. If no socket is given
+        // messages need to be fed using the 'receive()' slot.
+        explicit ZMQSequencedReceiver(ZMQSocket* socket_ = nullptr, QObject* parent_ = nullptr);
+
+        // Returns the sequence number of the last message received for the given topic
+        // or 0 if no message has been received yet.
+        quint64 lastSequence(const QByteArray& topic_) const;
+
+        Statistics statistics() const;
+
+        void resetStatistics();
+
+        static bool parseSequenceFrame(const QByteArray& frame_, quint64* epoch_, quint64* sequence_);
+
+    signals:
+        // Emitted for each in-order message with the sequence frame removed.
+        void messageReceived(const QList<QByteArray>& message);
+
+        // Emitted if the messages with sequence numbers 'from' up to and
+        // including 'to' of the given topic have been missed.
+        void gapDetected(const QByteArray& topic, quint64 from, quint64 to);
+
+        void duplicateDetected(const QByteArray& topic, quint64 sequence);
+
+        // Emitted if a message of the given topic carries another epoch than the previous
+        // one, e.g. since its publisher has been restarted. The message is delivered.
+        void publisherRestarted(const QByteArray& topic, quint64 epoch, quint64 sequence);
+
+    public slots:
+        void receive(const QList<QByteArray>& message_);
+
+        // Forgets about all topics.
+        void reset();
+
+    private:
+        struct TopicState
+        {
+            quint64 epoch;
+            quint64 sequence;
+        };
+
+        QHash<QByteArray, TopicState> m_topics;
+        Statistics m_statistics;
+    };
+
+    // Packs many small messages into a single frame in order to reduce per-message overhead.
+    // Each message is appended to the current batch prefixed by its length (4 bytes,
+    // big-endian). The batch is sent as soon as it would exceed the maximum batch size or
+    // when the flush interval has elapsed since the first message was added to it. A flush
+    // interval of 0 sends the batch as soon as control returns to the event loop. The
+    // optional envelope (e.g. a topic) is sent in front of each batch frame.
+    // Use 'ZMQCoalescedReceiver' on the receiving side.
+    class NZMQT_API ZMQCoalescingSender : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        // Note that pending messages are discarded on destruction, so call 'flush()'
+        // before if needed.
+        explicit ZMQCoalescingSender(ZMQSocket* socket_, const QList<QByteArray>& envelope_ = QList<QByteArray>(), QObject* parent_ = nullptr);
+
+        ZMQSocket* socket() const;
+
+        void setMaxBatchBytes(int bytes_);
+
+        int maxBatchBytes() const;
+
+        void setFlushInterval(int msec_);
+
+        int flushInterval() const;
+
+        // Returns the number of messages in the current batch.
+        int pendingMessages() const;
+
+        quint64 messagesSent() const;
+
+        quint64 batchesSent() const;
+
+        static void appendMessage(QByteArray* batch_, const QByteArray& message_);
+
+    public slots:
+        // Adds the message to the current batch. Returns false if the batch is full and
+        // could not be sent (the message is not added in this case).
+        bool sendMessage(const QByteArray& message_);
+
+        // Sends the current batch. Returns false if it could not be sent, in which case
+        // it will be retried by the next flush.
+        bool flush();
+
+    private:
+        ZMQSocket* m_socket;
+        QList<QByteArray> m_envelope;
+        QByteArray m_batch;
+        int m_batchMessages;
+        int m_maxBatchBytes;
+        QTimer m_flushTimer;
+        quint64 m_messagesSent;
+        quint64 m_batchesSent;
+    };
+
+    // Splits batches sent by a 'ZMQCoalescingSender' into the original messages again.
+    class NZMQT_API ZMQCoalescedReceiver : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        // Connects to the given socket's 'messageReceived()' signal. If no socket is given
+        // batches need to be fed using the 'receive()' slot.
+        explicit ZMQCoalescedReceiver(ZMQSocket* socket_ = nullptr, QObject* parent_ = nullptr);
+
+        quint64 messagesReceived() const;
+
+        quint64 batchesReceived() const;
+
+        // Returns the number of malformed batches, which have been dropped.
+        quint64 invalidBatches() const;
+
+        // Appends all messages contained in the given batch to 'messages_'.
+        // Returns false if the batch is malformed.
+        static bool split(const QByteArray& batch_, QList<QByteArray>* messages_);
+
+    signals:
+        // Emitted for each message of a batch. The message consists of the
+        // envelope parts followed by the original message.
+        void messageReceived(const QList<QByteArray>& message);
+
+    public slots:
+        void receive(const QList<QByteArray>& batch_);
+
+    private:
+        quint64 m_messagesReceived;
+        quint64 m_batchesReceived;
+        quint64 m_invalidBatches;
+    };
+
+    // Streams a file in fixed-size chunks without copying it. The file is memory-mapped and
+    // each chunk is sent as a zero-copy message referencing the mapping, which is released
+    // as soon as ZMQ has freed the last chunk. Each chunk is sent as the envelope parts
+    // followed by a chunk header (offset and file size, 8 bytes big-endian each) and the
+    // chunk data. Sending is paced by the socket's send HWM: as soon as it is reached the
+    // sender waits for the retry interval and continues, so the number of chunks in flight
+    // never exceeds the HWM. Chunks bypass the socket's codec stage, so do not set a codec
+    // on the socket. Use 'ZMQFileReceiver' on the receiving side.
+    class NZMQT_API ZMQFileSender : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        explicit ZMQFileSender(ZMQSocket* socket_, const QList<QByteArray>& envelope_ = QList<QByteArray>(), QObject* parent_ = nullptr);
+
+        ~ZMQFileSender();
+
+        ZMQSocket* socket() const;
+
+        void setChunkSize(int bytes_);
+
+        int chunkSize() const;
+
+        void setRetryInterval(int msec_);
+
+        int retryInterval() const;
+
+        bool isSending() const;
+
+        QString fileName() const;
+
+        qint64 bytesSent() const;
+
+        qint64 fileSize() const;
+
+    signals:
+        void progress(qint64 bytesSent, qint64 bytesTotal);
+
+        // Emitted when the last chunk has been queued for sending.
+        void fileSent(const QString& fileName);
+
+    public slots:
+        // Starts sending the given file. Returns false if another file is still being sent
+        // or if the file cannot be opened or mapped.
+        bool sendFile(const QString& fileName_);
+
+        // Stops sending the current file. Chunks already queued are still delivered.
+        void cancel();
+
+    private slots:
+        void sendChunks();
+
+    private:
+        struct Mapping;
+
+        // Returns false if the chunk could not be sent due to the HWM.
+        bool sendChunk();
+
+        static void releaseMapping(void* data_, void* hint_);
+
+        ZMQSocket* m_socket;
+        QList<QByteArray> m_envelope;
+        Mapping* m_mapping;
+        int m_chunkSize;
+        int m_retryInterval;
+        QTimer m_sendTimer;
+        QString m_fileName;
+        qint64 m_fileSize;
+        qint64 m_offset;
+    };
+
+    // Writes the chunks sent by a 'ZMQFileSender' to a file. A chunk with offset 0 starts
+    // a new transfer, truncating the file. Chunks are expected in order; a missing chunk
+    // aborts the transfer and is reported by 'transferFailed()'.
+    class NZMQT_API ZMQFileReceiver : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        // Connects to the given socket's 'messageReceived()' signal. If no socket is given
+        // chunks need to be fed using the 'receive()' slot.
+        explicit ZMQFileReceiver(const QString& fileName_, ZMQSocket* socket_ = nullptr, QObject* parent_ = nullptr);
+
+        QString fileName() const;
+
+        qint64 bytesReceived() const;
+
+        qint64 fileSize() const;
+
+        // Indicates if the last transfer has been received completely.
+        bool isComplete() const;
+
+    signals:
+        void progress(qint64 bytesReceived, qint64 bytesTotal);
+
+        void fileReceived(const QString& fileName);
+
+        void transferFailed(const QString& fileName, const QString& reason);
+
+    public slots:
+        void receive(const QList<QByteArray>& message_);
+
+    private:
+        void fail(const QString& reason_);
+
+        QFile m_file;
+        qint64 m_fileSize;
+        qint64 m_bytesReceived;
+        bool m_complete;
+    };
+
+    // Records received messages to an append-only log for later replay by 'ZMQReplayer'.
+    // The log is split into segments of fixed size, which are preallocated and memory-mapped,
+    // so recording a message amounts to copying it into the mapping. Each record consists of
+    // its size (4 bytes), a timestamp in nanoseconds relative to 'open()' (8 bytes), the number
+    // of parts (4 bytes) and each part prefixed by its size (4 bytes), all big-endian.
+    // Every n-th record is added to the index (timestamp, segment, offset), which allows
+    // seeking without scanning the log. Unused space is cut off the last segment by 'close()'.
+    // Once a segment is half full the next one is created and mapped by a worker thread,
+    // so switching segments does not stall recording.
+    class NZMQT_API ZMQRecorder : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        // Connects to the given socket's 'messageReceived()' signal. If no socket is given
+        // messages need to be fed using the 'record()' slot.
+        explicit ZMQRecorder(const QString& baseName_, ZMQSocket* socket_ = nullptr, QObject* parent_ = nullptr);
+
+        ~ZMQRecorder();
+
+        QString baseName() const;
+
+        // Takes effect for segments created after the call.
+        void setSegmentSize(qint64 bytes_);
+
+        qint64 segmentSize() const;
+
+        // Values below 1 are treated as 1, i.e. every record is indexed.
+        void setIndexInterval(int records_);
+
+        int indexInterval() const;
+
+        // Starts a new log, replacing an existing one of the same name.
+        bool open();
+
+        void close();
+
+        bool isOpen() const;
+
+        quint64 recordedMessages() const;
+
+        static QString segmentFileName(const QString& baseName_, int segment_);
+
+        static QString indexFileName(const QString& baseName_);
+
+    public slots:
+        // Returns false if the log is not open or the message does not fit into a segment.
+        bool record(const QList<QByteArray>& message_);
+
+    private:
+        // A segment file which has been created and mapped, or a null file on failure.
+        struct Segment
+        {
+            QFile* file;
+            uchar* data;
+            qint64 size;
+        };
+
+        // Runs on a worker thread as well, so the file is handed over to 'thread_'.
+        static Segment createSegment(const QString& fileName_, qint64 size_, QThread* thread_);
+
+        bool openSegment(int segment_);
+
+        void closeSegment();
+
+        // Discards the next segment if it has been prepared already.
+        void discardNextSegment();
+
+        void writeIndexEntry(qint64 timestamp_);
+
+        QString m_baseName;
+        qint64 m_segmentSize;
+        int m_indexInterval;
+        QFile* m_segment;
+        QFile m_index;
+        uchar* m_data;
+        qint64 m_mappedSize;
+        qint64 m_offset;
+        std::future<Segment> m_nextSegment;
+        int m_segmentIndex;
+        QElapsedTimer m_clock;
+        quint64 m_recordedMessages;
+    };
+
+    // Replays a log written by 'ZMQRecorder' through a socket. Messages are sent at the
+    // recorded rate multiplied by the speed factor, or as fast as possible if the speed
+    // is 0. Sending is retried as long as the socket's HWM is reached.
+    class NZMQT_API ZMQReplayer : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        explicit ZMQReplayer(const QString& baseName_, ZMQSocket* socket_ = nullptr, QObject* parent_ = nullptr);
+
+        QString baseName() const;
+
+        ZMQSocket* socket() const;
+
+        void setSpeed(double factor_);
+
+        double speed() const;
+
+        // Opens the log and positions at its first message.
+        bool open();
+
+        void close();
+
+        // Positions at the first message recorded at or after the given time.
+        // Returns false if there is no such message.
+        bool seek(qint64 nsecs_);
+
+        // Reads the next message and its timestamp. Returns false at the end of the log.
+        bool readMessage(QList<QByteArray>* message_, qint64* nsecs_);
+
+        bool isReplaying() const;
+
+        quint64 replayedMessages() const;
+
+    signals:
+        // Emitted when the end of the log has been reached by 'start()'.
+        void finished();
+
+    public slots:
+        // Starts replaying from the current position. Requires a socket.
+        void start();
+
+        void stop();
+
+    private slots:
+        void replay();
+
+    private:
+        struct IndexEntry
+        {
+            qint64 timestamp;
+            int segment;
+            qint64 offset;
+        };
+
+        bool openSegment(int segment_);
+
+        void closeSegment();
+
+        bool readRecord(QList<QByteArray>* message_, qint64* nsecs_);
+
+        QString m_baseName;
+        ZMQSocket* m_socket;
+        double m_speed;
+        QVector<IndexEntry> m_index;
+        QFile m_segment;
+        uchar* m_data;
+        qint64 m_size;
+        qint64 m_offset;
+        int m_segmentIndex;
+        QList<QByteArray> m_pending;
+        qint64 m_pendingTimestamp;
+        bool m_hasPending;
+        bool m_replaying;
+        qint64 m_firstTimestamp;
+        QElapsedTimer m_clock;
+        QTimer m_replayTimer;
+        quint64 m_replayedMessages;
+    };
+
+    // Persistent outbound spool for sockets like PUSH or DEALER. Messages are sent directly
+    // as long as the socket accepts them and nothing is spooled, which costs a single check.
+    // Otherwise they are appended to the spool, which consists of preallocated, memory-mapped
+    // segment files. Spooled messages are drained in order and in batches as soon as the
+    // socket signals POLLOUT again, and drained segments are removed. Each segment starts
+    // with the offset of its first undrained record (8 bytes), followed by records consisting
+    // of their size and number of parts (4 bytes each) and the parts prefixed by their size
+    // (4 bytes), all big-endian. So an existing spool is resumed by 'open()' after a restart.
+    class NZMQT_API ZMQSpool : public QObject
+    {
+        Q_OBJECT
+        Q_ENUMS(SyncPolicy)
+
+        typedef QObject super;
+
+    public:
+        enum SyncPolicy
+        {
+            // Leave writing back spooled messages to the operating system.
+            SYNC_NEVER,
+            // Sync once per drain interval.
+            SYNC_BATCH,
+            // Sync after each spooled message.
+            SYNC_ALWAYS
+        };
+
+        explicit ZMQSpool(ZMQSocket* socket_, const QString& baseName_, QObject* parent_ = nullptr);
+
+        ~ZMQSpool();
+
+        ZMQSocket* socket() const;
+
+        QString baseName() const;
+
+        // Takes effect for segments created after the call.
+        void setSegmentSize(qint64 bytes_);
+
+        qint64 segmentSize() const;
+
+        void setMaxBytes(qint64 bytes_);
+
+        qint64 maxBytes() const;
+
+        void setSyncPolicy(SyncPolicy policy_);
+
+        SyncPolicy syncPolicy() const;
+
+        void setDrainInterval(int msec_);
+
+        int drainInterval() const;
+
+        // Opens the spool, resuming messages spooled before.
+        bool open();
+
+        void close();
+
+        bool isOpen() const;
+
+        bool isEmpty() const;
+
+        quint64 spooledMessages() const;
+
+        qint64 spooledBytes() const;
+
+        // Returns the number of messages dropped because the size limit was reached.
+        quint64 droppedMessages() const;
+
+        static QString segmentFileName(const QString& baseName_, int segment_);
+
+    signals:
+        // Emitted when the last spooled message has been sent.
+        void drained();
+
+    public slots:
+        // Returns false if the message could neither be sent nor spooled.
+        bool sendMessage(const QList<QByteArray>& msg_);
+
+        // Sends a batch of spooled messages if the socket is ready for sending.
+        void drain();
+
+    private:
+        struct Segment
+        {
+            QSharedPointer<QFile> file;
+            uchar* data;
+            qint64 size;
+            int index;
+        };
+
+        bool spool(const QList<QByteArray>& msg_);
+
+        bool openSegment(Segment* segment_, const QString& fileName_, QIODevice::OpenMode mode_);
+
+        bool appendSegment();
+
+        void removeHead();
+
+        // Returns the size of the record at the given offset or 0 if there is none.
+        static qint64 readRecord(const Segment& segment_, qint64 offset_, QList<QByteArray>* message_);
+
+        void sync();
+
+        ZMQSocket* m_socket;
+        QString m_baseName;
+        qint64 m_segmentSize;
+        qint64 m_maxBytes;
+        SyncPolicy m_syncPolicy;
+        QList<Segment> m_segments;
+        qint64 m_readOffset;
+        qint64 m_writeOffset;
+        quint64 m_spooledMessages;
+        qint64 m_spooledBytes;
+        quint64 m_droppedMessages;
+        bool m_open;
+        bool m_unsynced;
+        QTimer m_drainTimer;
+    };
+
+    // Log-linear histogram of latencies in nanoseconds (similar to HdrHistogram). Values
+    // below 2^precisionBits are counted exactly. Larger values are counted in buckets
+    // covering 2^(precisionBits-1) linear steps per power of two. The buckets are allocated
+    // on construction, so recording a value takes constant time and never allocates.
+    // A histogram is not thread-safe; use one per thread and merge them for reporting.
+    class NZMQT_API ZMQLatencyHistogram
+    {
+    public:
+        explicit ZMQLatencyHistogram(int precisionBits_ = NZMQT_LATENCYHISTOGRAM_DEFAULT_PRECISIONBITS);
+
+        int precisionBits() const;
+
+        // Negative values are recorded as 0.
+        void record(qint64 nsecs_);
+
+        // Adds all values recorded by the given histogram.
+        void merge(const ZMQLatencyHistogram& other_);
+
+        void reset();
+
+        quint64 count() const;
+
+        qint64 min() const;
+
+        qint64 max() const;
+
+        double mean() const;
+
+        // Returns the value below or at which the given percentage (0-100) of values lie.
+        qint64 valueAtPercentile(double percentile_) const;
+
+        // Formats the histogram as a summary in Prometheus text format, in seconds.
+        // The labels (e.g. 'service="echo"') are added to each sample.
+        QByteArray toPrometheus(const QByteArray& name_, const QByteArray& labels_ = QByteArray()) const;
+
+    private:
+        int bucketIndex(quint64 value_) const;
+
+        // Returns the highest value counted by the given bucket.
+        quint64 bucketValue(int index_) const;
+
+        int m_precisionBits;
+        QVector<quint64> m_counts;
+        quint64 m_count;
+        quint64 m_sum;
+        qint64 m_min;
+        qint64 m_max;
+    };
+
+    // Measures round-trip latencies of requests sent through a REQ or DEALER socket.
+    // Requests sent by 'sendRequest()' are timestamped using a monotonic clock and replies
+    // are matched in order, which suits REQ sockets and DEALER sockets talking to a server
+    // replying in order. If an id extractor is set, requests and replies are matched by the
+    // id it returns for them instead (e.g. a correlation id contained in the messages).
+    class NZMQT_API ZMQLatencyTracker : public QObject
+    {
+        Q_OBJECT
+
+        typedef QObject super;
+
+    public:
+        typedef std::function<QByteArray(const QList<QByteArray>&)> IdExtractor;
+
+        // Connects to the given socket's 'messageReceived()' signal.
+        explicit ZMQLatencyTracker(ZMQSocket* socket_, QObject* parent_ = nullptr);
+
+        ZMQSocket* socket() const;
+
+        void setIdExtractor(const IdExtractor& idExtractor_);
+
+        const ZMQLatencyHistogram& histogram() const;
+
+        // Returns the number of requests still waiting for a reply.
+        int pendingRequests() const;
+
+    signals:
+        void replyReceived(const QList<QByteArray>& reply, qint64 latencyNsecs);
+
+    public slots:
+        bool sendRequest(const QList<QByteArray>& request_, nzmqt::ZMQSocket::SendFlags flags_ = ZMQSocket::SND_DONTWAIT);
+
+        // Clears the histogram and forgets pending requests.
+        void reset();
+
+    private slots:
+        void receiveReply(const QList<QByteArray>& reply_);
+
+    private:
+        ZMQSocket* m_socket;
+        IdExtractor m_idExtractor;
+        ZMQLatencyHistogram m_histogram;
+        QElapsedTimer m_clock;
+        QQueue<qint64> m_pending;
+        QHash<QByteArray, qint64> m_pendingById;
+    };
+
     NZMQT_API inline ZMQContext* createDefaultContext(QObject* parent_ = nullptr, int io_threads_ = NZMQT_DEFAULT_IOTHREADS)
     {
         return new NZMQT_DEFAULT_ZMQCONTEXT_IMPLEMENTATION(parent_, io_threads_);
@@ -43,6 +43,8 @@
 #include "pushpull/Ventilator.hpp"
 #include "pushpull/Worker.hpp"
 #include "pushpull/Sink.hpp"
+#include "loadgen/LoadSender.hpp"
+#include "loadgen/LoadReceiver.hpp"
 
 
 namespace nzmqt
@@ -96,6 +98,15 @@ protected slots:
             SampleBase* commandImpl = 0;
 
             ZMQContext* context = createDefaultContext(this);
+            // Keep 0MQ's I/O threads off the cores dispatching messages, e.g. NZMQT_IO_CPUS=2,3.
+            const QString ioCpus = QString::fromLocal8Bit(qgetenv("NZMQT_IO_CPUS"));
+            if (!ioCpus.isEmpty())
+            {
+                QList<int> cpus;
+                for (const QString& cpu : ioCpus.split(','))
+                    cpus << intArgument(cpu.trimmed(), "CPU in NZMQT_IO_CPUS", 0);
+                context->setIoThreadCpus(cpus);
+            }
             context->start();
 
             if ("pubsub-publisher" == command)
@@ -141,8 +152,9 @@ protected slots:
 
                 QString ventilatorAddress = args[2];
                 QString sinkAddress = args[3];
-                quint32 numberOfWorkItems = args[4].toUInt();
-                commandImpl = new pushpull::Ventilator(*context, ventilatorAddress, sinkAddress, numberOfWorkItems, this);
+                quint32 numberOfWorkItems = quint32(intArgument(args[4], "number of work items", 0));
+                int numberOfWorkers = args.size() > 5 ? intArgument(args[5], "number of workers", 1) : 1;
+                commandImpl = new pushpull::Ventilator(*context, ventilatorAddress, sinkAddress, numberOfWorkItems, numberOfWorkers, this);
 
                 // Wait for user start.
                 QTextStream outStream(stdout);
@@ -167,6 +179,29 @@ protected slots:
                 QString sinkAddress = args[2];
                 commandImpl = new pushpull::Sink(*context, sinkAddress, this);
             }
+            else if ("bench-pub" == command || "bench-req" == command)
+            {
+                if (args.size() < 4)
+                    throw std::runtime_error("Mandatory argument(s) missing!");
+
+                QString address = args[2];
+                double rate = doubleArgument(args[3], "rate");
+                int messageSize = args.size() > 4 ? intArgument(args[4], "message size", 0) : 64;
+                int parts = args.size() > 5 ? intArgument(args[5], "number of parts", 1) : 1;
+                int duration = args.size() > 6 ? intArgument(args[6], "duration", 0) : 10;
+                loadgen::LoadSender::Mode mode = "bench-pub" == command ? loadgen::LoadSender::MODE_PUB : loadgen::LoadSender::MODE_REQ;
+                commandImpl = new loadgen::LoadSender(*context, mode, address, rate, messageSize, parts, duration, this);
+            }
+            else if ("bench-sub" == command || "bench-rep" == command)
+            {
+                if (args.size() < 3)
+                    throw std::runtime_error("Mandatory argument(s) missing!");
+
+                QString address = args[2];
+                int duration = args.size() > 3 ? intArgument(args[3], "duration", 0) : 0;
+                loadgen::LoadReceiver::Mode mode = "bench-sub" == command ? loadgen::LoadReceiver::MODE_SUB : loadgen::LoadReceiver::MODE_REP;
+                commandImpl = new loadgen::LoadReceiver(*context, mode, address, duration, this);
+            }
             else
             {
                 throw std::runtime_error(QString("Unknown command: '%1'").arg(command).toStdString());
@@ -198,10 +233,16 @@ USAGE: %1 pubsub-publisher <address> <topic>
 USAGE: %1 reqrep-replier <address> <reply-msg>                                        -- Start REQ server.\n\
        %1 reqrep-requester <address> <request-msg>                                    -- Start REP client.\n\
 \n\
-USAGE: %1 pushpull-ventilator <ventilator-address> <sink-address> <numberOfWorkItems> -- Start ventilator.\n\
+USAGE: %1 pushpull-ventilator <ventilator-address> <sink-address> <numberOfWorkItems> [<numberOfWorkers>]\n\
+                                                                                      -- Start ventilator (default: 1 worker).\n\
        %1 pushpull-worker <ventilator-address> <sink-address>                         -- Start a worker.\n\
        %1 pushpull-sink <sink-address>                                                -- Start sink.\n\
 \n\
+USAGE: %1 bench-pub <address> <msgs/s> [<size> [<parts> [<secs>]]]                    -- Publish load (default: 64 B, 1 part, 10 s).\n\
+       %1 bench-sub <address> [<secs>]                                                -- Receive load (default: forever).\n\
+       %1 bench-req <address> <msgs/s> [<size> [<parts> [<secs>]]]                    -- Send requests (default: 64 B, 1 part, 10 s).\n\
+       %1 bench-rep <address> [<secs>]                                                -- Echo requests (default: forever).\n\
+\n\
 Publish-Subscribe Sample:\n\
 * Publisher:   %1 pubsub-publisher tcp://127.0.0.1:1234 ping\n\
 * Subscriber:  %1 pubsub-subscriber tcp://127.0.0.1:1234 ping\n\
@@ -211,11 +252,39 @@ Request-Reply Sample:\n\
 * Requester:   %1 reqrep-requester tcp://127.0.0.1:1234 Hello\n\
 \n\
 Push-Pull Sample:\n\
-* Ventilator:  %1 pushpull-ventilator tcp://127.0.0.1:5557 tcp://127.0.0.1:5558 100\n\
+* Ventilator:  %1 pushpull-ventilator tcp://127.0.0.1:5557 tcp://127.0.0.1:5558 100 2\n\
 * Worker 1..n: %1 pushpull-worker tcp://127.0.0.1:5557 tcp://127.0.0.1:5558\n\
 * Sink:        %1 pushpull-sink tcp://127.0.0.1:5558\n\
+\n\
+Load Generator (latencies are measured from the intended send time at the given rate):\n\
+* Subscriber:  %1 bench-sub tcp://127.0.0.1:5559\n\
+* Publisher:   %1 bench-pub tcp://127.0.0.1:5559 10000 256 1 30\n\
+* Replier:     %1 bench-rep tcp://127.0.0.1:5560\n\
+* Requester:   %1 bench-req tcp://127.0.0.1:5560 10000 256 1 30\n\
+\n\
+Set NZMQT_IO_CPUS to a comma separated list of CPUs in order to pin 0MQ's I/O threads to them.\n\
 \n").arg(executable);
     }
+
+    // Converts a numeric argument, which must not be less than 'min'.
+    static int intArgument(const QString& arg, const char* name, int min)
+    {
+        bool ok = false;
+        const int value = arg.toInt(&ok);
+        if (!ok || value < min)
+            throw std::runtime_error(QString("Invalid %1: '%2'").arg(name).arg(arg).toStdString());
+        return value;
+    }
+
+    // Converts a numeric argument, which must be greater than 0.
+    static double doubleArgument(const QString& arg, const char* name)
+    {
+        bool ok = false;
+        const double value = arg.toDouble(&ok);
+        if (!ok || value <= 0)
+            throw std::runtime_error(QString("Invalid %1: '%2'").arg(name).arg(arg).toStdString());
+        return value;
+    }
 };
 
 }
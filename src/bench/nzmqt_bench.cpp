@@ -0,0 +1,1483 @@
+// Copyright 2011-2014 Johann Duscher (a.k.a. Jonny Dee). All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//    1. Redistributions of source code must retain the above copyright notice, this list of
+//       conditions and the following disclaimer.
+//
+//    2. Redistributions in binary form must reproduce the above copyright notice, this list
+//       of conditions and the following disclaimer in the documentation and/or other materials
+//       provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY JOHANN DUSCHER ''AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// The views and conclusions contained in the software and documentation are those of the
+// authors and should not be interpreted as representing official policies, either expressed
+// or implied, of Johann Duscher.
+
+#include "nzmqt/nzmqt.hpp"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+#include <QtTest>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <thread>
+
+#ifndef NZMQT_BENCH_VERSION
+    #define NZMQT_BENCH_VERSION "unknown"
+#endif
+
+namespace bench
+{
+    // Heap allocations made by the current thread, see below.
+    static thread_local quint64 threadAllocations = 0;
+}
+
+// Count heap allocations by interposing the C allocator, which operator new and Qt's
+// containers end up in as well. Without glibc only operator new can be counted.
+#if defined(__GLIBC__)
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) __THROW
+{
+    ++bench::threadAllocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) __THROW
+{
+    ++bench::threadAllocations;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) __THROW
+{
+    ++bench::threadAllocations;
+    return __libc_realloc(ptr, size);
+}
+}
+#else
+void* operator new(std::size_t size)
+{
+    ++bench::threadAllocations;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+// Run with '-csv' or '-xml' to get machine readable results. Additionally, the throughput
+// and latency benchmarks append all of their figures to the CSV file named by the
+// NZMQT_BENCH_CSV environment variable, so results of releases can be compared.
+namespace bench
+{
+
+// Monotonic clock shared by the threads of the wake-up latency benchmark.
+static qint64 steadyNsecs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Peer of the throughput and latency benchmarks, modelled on libzmq's remote_thr and
+// remote_lat. It uses the plain 0MQ API from within its own thread, so only the local
+// side of a benchmark goes through nzmqt.
+class RemotePeer : public QThread
+{
+public:
+    enum Mode
+    {
+        // Connects a PUSH socket and sends 'messageCount' messages.
+        MODE_THROUGHPUT,
+        // Connects a REP socket and echoes 'messageCount' messages.
+        MODE_LATENCY,
+        // Connects a PUSH socket and sends 'messageCount' messages starting with the time
+        // they were sent at, one every 2 ms, so that the receiver falls idle in-between.
+        MODE_WAKEUP
+    };
+
+    RemotePeer(void* context, Mode mode, const QByteArray& address, int messageSize, int messageCount)
+        : context_(context), mode_(mode), address_(address), messageSize_(messageSize), messageCount_(messageCount)
+    {
+    }
+
+protected:
+    void run() override
+    {
+        void* socket = zmq_socket(context_, MODE_LATENCY == mode_ ? ZMQ_REP : ZMQ_PUSH);
+        if (!socket)
+            return;
+
+        // Give up if the local side stalls, e.g. because the benchmark timed out.
+        int timeout = 10000;
+        zmq_setsockopt(socket, ZMQ_SNDTIMEO, &timeout, sizeof(timeout));
+        zmq_setsockopt(socket, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+
+        if (0 == zmq_connect(socket, address_.constData()))
+        {
+            if (MODE_THROUGHPUT == mode_)
+            {
+                const QByteArray payload(messageSize_, 'x');
+                for (int i = 0; i < messageCount_; ++i)
+                {
+                    if (zmq_send(socket, payload.constData(), payload.size(), 0) < 0)
+                        break;
+                }
+            }
+            else if (MODE_WAKEUP == mode_)
+            {
+                QByteArray payload(qMax(messageSize_, int(sizeof(qint64))), 'x');
+                for (int i = 0; i < messageCount_; ++i)
+                {
+                    QThread::msleep(2);
+                    const qint64 sentNsecs = steadyNsecs();
+                    memcpy(payload.data(), &sentNsecs, sizeof(sentNsecs));
+                    if (zmq_send(socket, payload.constData(), payload.size(), 0) < 0)
+                        break;
+                }
+            }
+            else
+            {
+                zmq_msg_t msg;
+                zmq_msg_init(&msg);
+                for (int i = 0; i < messageCount_; ++i)
+                {
+                    if (zmq_msg_recv(&msg, socket, 0) < 0 || zmq_msg_send(&msg, socket, 0) < 0)
+                        break;
+                }
+                zmq_msg_close(&msg);
+            }
+        }
+
+        // Give messages not yet transferred some time.
+        int linger = 1000;
+        zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(linger));
+        zmq_close(socket);
+    }
+
+private:
+    void* context_;
+    Mode mode_;
+    QByteArray address_;
+    int messageSize_;
+    int messageCount_;
+};
+
+// Receiver used to emulate the classic way of handling many topics with one
+// SUB socket: every slot is connected to 'messageReceived()' and filters the
+// topic itself.
+class TopicFilter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TopicFilter(const QByteArray& topic) : topic_(topic), count_(0) {}
+
+public slots:
+    void receive(const QList<QByteArray>& msg)
+    {
+        if (msg[0].startsWith(topic_))
+            ++count_;
+    }
+
+private:
+    QByteArray topic_;
+    int count_;
+};
+
+class NzmqtBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    NzmqtBench();
+
+protected:
+    static QList<QByteArray> makeTopics(int count);
+
+    static void addMessageSizeRows();
+
+    // Prints throughput and CPU time per message measured
+    // across all runs of a QBENCHMARK block.
+    static void reportThroughput(quint64 messages, qint64 wallNsecs, std::clock_t cpuTicks);
+
+    static QByteArray makePayload(const QString& kind, int size);
+
+    // Sends 'messageCount' copies of 'payload' through a relay thread which forwards
+    // frames at no more than 'bitsPerSecond', and returns the messages per second which
+    // arrived. The average size of the frames forwarded is stored in 'frameBytes'.
+    static double measureRateLimitedLink(const QSharedPointer<nzmqt::ZMQCodec>& codec, const QByteArray& payload, int messageCount, double bitsPerSecond, double* frameBytes);
+
+    // Adds rows for each combination of context implementation, transport and message size.
+    static void addTransportRows();
+
+    static nzmqt::ZMQContext* createContext(const QString& contextKind);
+
+    static QByteArray makeAddress(const QString& transport, const QString& name, int tcpPort);
+
+    // Prints the heap allocations per operation counted across
+    // all runs of a QBENCHMARK block.
+    static void reportAllocations(quint64 operations, quint64 allocations);
+
+    static void addMultipartRows();
+
+    // Returns the number of file descriptors open by this process, or -1 if unknown.
+    static int openFileDescriptors();
+
+    // Appends a row to the CSV file named by the NZMQT_BENCH_CSV environment variable, if set.
+    static void appendResult(double msgsPerSec, double mbPerSec, qint64 p50Nsecs, qint64 p99Nsecs, double cpuNsecsPerMsg);
+
+    // Returns the 99th percentile of the time messages spend queued between an overloaded
+    // receiver and a sender shedding load.
+    static qint64 measureQueueingDelay(const nzmqt::ZMQSocketProfile& profile);
+
+    // Returns the nanoseconds a sender needs to hand a burst of messages to a slow reader.
+    static qint64 measureBurstSendTime(const nzmqt::ZMQSocketProfile& profile);
+
+    // Returns the bytes a publisher queues for each subscriber which never reads.
+    static double measureIdlePeerBacklog(const nzmqt::ZMQSocketProfile& profile);
+
+private slots:
+    void benchTopicDispatchSignalFanOut_data();
+    void benchTopicDispatchSignalFanOut();
+    void benchTopicDispatchTrie_data();
+    void benchTopicDispatchTrie();
+    void benchSmallMessagesUnbatched_data();
+    void benchSmallMessagesUnbatched();
+    void benchSmallMessagesCoalesced_data();
+    void benchSmallMessagesCoalesced();
+    void benchCompression_data();
+    void benchCompression();
+    void benchRecorder_data();
+    void benchRecorder();
+    void benchThroughput_data();
+    void benchThroughput();
+    void benchLatency_data();
+    void benchLatency();
+    void benchMessageFromByteArray_data();
+    void benchMessageFromByteArray();
+    void benchMessageToByteArray_data();
+    void benchMessageToByteArray();
+    void benchReceiveMessageList_data();
+    void benchReceiveMessageList();
+    void benchSendMessageList_data();
+    void benchSendMessageList();
+    void benchEmitMessageReceived_data();
+    void benchEmitMessageReceived();
+    void benchDispatchPath_data();
+    void benchDispatchPath();
+    void benchSocketChurn_data();
+    void benchSocketChurn();
+    void benchSocketProfiles_data();
+    void benchSocketProfiles();
+    void benchWakeupLatency_data();
+    void benchWakeupLatency();
+};
+
+NzmqtBench::NzmqtBench()
+{
+    qRegisterMetaType< QList<QByteArray> >();
+}
+
+QList<QByteArray> NzmqtBench::makeTopics(int count)
+{
+    QList<QByteArray> topics;
+    for (int i = 0; i < count; ++i)
+        topics += "instrument." + QByteArray::number(i) + ".";
+    return topics;
+}
+
+void NzmqtBench::benchTopicDispatchSignalFanOut_data()
+{
+    QTest::addColumn<int>("topics");
+
+    QTest::newRow("10 topics") << 10;
+    QTest::newRow("100 topics") << 100;
+    QTest::newRow("1000 topics") << 1000;
+    QTest::newRow("10000 topics") << 10000;
+}
+
+void NzmqtBench::benchTopicDispatchSignalFanOut()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, topics);
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* socket = context->createSocket(ZMQSocket::TYP_SUB, context.data());
+
+    const QList<QByteArray> topicList = makeTopics(topics);
+    QList<QList<QByteArray> > messages;
+    for (const QByteArray& topic : topicList)
+    {
+        socket->subscribeTo(topic);
+        TopicFilter* filter = new TopicFilter(topic);
+        filter->setParent(socket);
+        connect(socket, &ZMQSocket::messageReceived, filter, &TopicFilter::receive);
+        messages += QList<QByteArray>() << topic + "bid" << "payload";
+    }
+
+    int i = 0;
+    QBENCHMARK {
+        emit socket->messageReceived(messages[i]);
+        i = (i + 1) % messages.size();
+    }
+}
+
+void NzmqtBench::benchTopicDispatchTrie_data()
+{
+    benchTopicDispatchSignalFanOut_data();
+}
+
+void NzmqtBench::benchTopicDispatchTrie()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, topics);
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* socket = context->createSocket(ZMQSocket::TYP_SUB, context.data());
+    ZMQTopicDispatcher* dispatcher = new ZMQTopicDispatcher(socket, socket);
+
+    const QList<QByteArray> topicList = makeTopics(topics);
+    QList<QList<QByteArray> > messages;
+    int count = 0;
+    for (const QByteArray& topic : topicList)
+    {
+        dispatcher->addHandler(topic, [&count](const QList<QByteArray>&) { ++count; });
+        messages += QList<QByteArray>() << topic + "bid" << "payload";
+    }
+
+    int i = 0;
+    QBENCHMARK {
+        emit socket->messageReceived(messages[i]);
+        i = (i + 1) % messages.size();
+    }
+
+    QVERIFY(count > 0);
+}
+
+void NzmqtBench::addMessageSizeRows()
+{
+    QTest::addColumn<int>("messageSize");
+
+    QTest::newRow("64 B") << 64;
+    QTest::newRow("256 B") << 256;
+    QTest::newRow("1 KB") << 1024;
+}
+
+void NzmqtBench::reportThroughput(quint64 messages, qint64 wallNsecs, std::clock_t cpuTicks)
+{
+    const double cpuNsecs = double(cpuTicks) * 1e9 / CLOCKS_PER_SEC;
+    qDebug("%s: %.0f msgs/s, %.1f ns CPU per message",
+           QTest::currentDataTag(),
+           wallNsecs > 0 ? messages * 1e9 / wallNsecs : 0.0,
+           messages > 0 ? cpuNsecs / messages : 0.0);
+}
+
+void NzmqtBench::benchSmallMessagesUnbatched_data()
+{
+    addMessageSizeRows();
+}
+
+void NzmqtBench::benchSmallMessagesUnbatched()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, messageSize);
+    const int messagesPerRun = 10000;
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+    ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    pusher->setSendHighWaterMark(0);
+    puller->setReceiveHighWaterMark(0);
+    pusher->bindTo("inproc://bench-unbatched");
+    puller->connectTo("inproc://bench-unbatched");
+
+    const QByteArray payload(messageSize, 'x');
+    quint64 messages = 0;
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    const std::clock_t cpuStart = std::clock();
+
+    QBENCHMARK {
+        for (int i = 0; i < messagesPerRun; ++i)
+            pusher->sendMessage(payload);
+
+        ZMQMessage msg;
+        for (int i = 0; i < messagesPerRun; ++i)
+            puller->receiveMessage(&msg, ZMQSocket::ReceiveFlags());
+
+        messages += messagesPerRun;
+    }
+
+    reportThroughput(messages, stopWatch.nsecsElapsed(), std::clock() - cpuStart);
+}
+
+void NzmqtBench::benchSmallMessagesCoalesced_data()
+{
+    addMessageSizeRows();
+}
+
+void NzmqtBench::benchSmallMessagesCoalesced()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, messageSize);
+    const int messagesPerRun = 10000;
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+    ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    pusher->setSendHighWaterMark(0);
+    puller->setReceiveHighWaterMark(0);
+    pusher->bindTo("inproc://bench-coalesced");
+    puller->connectTo("inproc://bench-coalesced");
+
+    ZMQCoalescingSender sender(pusher);
+
+    const QByteArray payload(messageSize, 'x');
+    quint64 messages = 0;
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    const std::clock_t cpuStart = std::clock();
+
+    QBENCHMARK {
+        const quint64 batchesBefore = sender.batchesSent();
+        for (int i = 0; i < messagesPerRun; ++i)
+            sender.sendMessage(payload);
+        sender.flush();
+
+        QList<QByteArray> received;
+        received.reserve(messagesPerRun);
+        for (quint64 batch = batchesBefore; batch < sender.batchesSent(); ++batch)
+        {
+            ZMQMessage msg;
+            puller->receiveMessage(&msg, ZMQSocket::ReceiveFlags());
+            ZMQCoalescedReceiver::split(msg.toByteArray(), &received);
+        }
+        QCOMPARE(received.size(), messagesPerRun);
+
+        messages += messagesPerRun;
+    }
+
+    reportThroughput(messages, stopWatch.nsecsElapsed(), std::clock() - cpuStart);
+}
+
+QByteArray NzmqtBench::makePayload(const QString& kind, int size)
+{
+    QByteArray payload;
+    payload.reserve(size + 128);
+    for (int i = 0; payload.size() < size; ++i)
+    {
+        if ("json" == kind)
+            payload += QString("{\"instrument\":\"EURUSD\",\"bid\":%1,\"ask\":%2,\"seq\":%3},")
+                       .arg(1.1 + (qrand() % 1000) / 1e5).arg(1.1 + (qrand() % 1000) / 1e5).arg(i).toLatin1();
+        else if ("csv" == kind)
+            payload += QString("EURUSD;%1;%2;%3\n")
+                       .arg(1.1 + (qrand() % 1000) / 1e5).arg(1.1 + (qrand() % 1000) / 1e5).arg(i).toLatin1();
+        else
+            payload += char(qrand());
+    }
+    payload.truncate(size);
+    return payload;
+}
+
+double NzmqtBench::measureRateLimitedLink(const QSharedPointer<nzmqt::ZMQCodec>& codec, const QByteArray& payload, int messageCount, double bitsPerSecond, double* frameBytes)
+{
+    using namespace nzmqt;
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+    ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    if (codec)
+    {
+        pusher->setCodec(codec);
+        puller->setCodec(codec);
+    }
+    pusher->setSendHighWaterMark(0);
+    puller->setReceiveHighWaterMark(0);
+    puller->setOption(ZMQSocket::OPT_RCVTIMEO, 10000);
+    pusher->bindTo("inproc://bench-link-in");
+
+    // The relay's sockets are set up here and handed over to its thread, which the
+    // thread start orders properly.
+    void* relayIn = zmq_socket(static_cast<void*>(*context), ZMQ_PULL);
+    void* relayOut = zmq_socket(static_cast<void*>(*context), ZMQ_PUSH);
+    const int hwm = 0;
+    const int timeout = 10000;
+    zmq_setsockopt(relayIn, ZMQ_RCVHWM, &hwm, sizeof(hwm));
+    zmq_setsockopt(relayIn, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+    zmq_setsockopt(relayOut, ZMQ_SNDHWM, &hwm, sizeof(hwm));
+    zmq_connect(relayIn, "inproc://bench-link-in");
+    zmq_bind(relayOut, "inproc://bench-link-out");
+    puller->connectTo("inproc://bench-link-out");
+
+    // The relay forwards each frame once the link would have finished transmitting all
+    // bytes before it, so a frame costs its size on the wire, header included.
+    quint64 forwardedBytes = 0;
+    std::thread relay([&]() {
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < messageCount; ++i)
+        {
+            if (zmq_msg_recv(&msg, relayIn, 0) < 0)
+                break;
+            forwardedBytes += zmq_msg_size(&msg);
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(qint64(forwardedBytes * 8e9 / bitsPerSecond)));
+            if (zmq_msg_send(&msg, relayOut, 0) < 0)
+                break;
+        }
+        zmq_msg_close(&msg);
+    });
+
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    for (int i = 0; i < messageCount; ++i)
+        pusher->sendMessage(payload);
+
+    int received = 0;
+    while (received < messageCount && !puller->receiveMessage(ZMQSocket::ReceiveFlags()).isEmpty())
+        ++received;
+    const qint64 wallNsecs = stopWatch.nsecsElapsed();
+    relay.join();
+
+    const int linger = 0;
+    zmq_setsockopt(relayIn, ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_setsockopt(relayOut, ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_close(relayIn);
+    zmq_close(relayOut);
+
+    *frameBytes = double(forwardedBytes) / messageCount;
+    if (received < messageCount)
+        return 0.0;
+    return received * 1e9 / qMax<qint64>(wallNsecs, 1);
+}
+
+void NzmqtBench::benchCompression_data()
+{
+    QTest::addColumn<QString>("kind");
+    QTest::addColumn<int>("messageSize");
+
+    // Below the default threshold, so nothing is encoded.
+    QTest::newRow("json 512 B") << "json" << 512;
+    QTest::newRow("json 4 KB") << "json" << 4096;
+    QTest::newRow("json 64 KB") << "json" << 65536;
+    QTest::newRow("csv 64 KB") << "csv" << 65536;
+    QTest::newRow("random 64 KB") << "random" << 65536;
+}
+
+void NzmqtBench::benchCompression()
+{
+    using namespace nzmqt;
+
+    QFETCH(QString, kind);
+    QFETCH(int, messageSize);
+    const int messagesPerRun = 100;
+    // Bandwidth of the rate limited link.
+    const double linkBitsPerSecond = 100e6;
+    // About half a second on the link without compression.
+    const int linkMessageCount = qBound(100, int(linkBitsPerSecond / 16 / messageSize), 20000);
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+    ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    QSharedPointer<ZMQCodec> codec(new ZMQZlibCodec);
+    pusher->setCodec(codec);
+    puller->setCodec(codec);
+    pusher->setSendHighWaterMark(0);
+    puller->setReceiveHighWaterMark(0);
+    pusher->bindTo("inproc://bench-compression");
+    puller->connectTo("inproc://bench-compression");
+
+    const QByteArray payload = makePayload(kind, messageSize);
+
+    quint64 messages = 0;
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    const std::clock_t cpuStart = std::clock();
+
+    QBENCHMARK {
+        for (int i = 0; i < messagesPerRun; ++i)
+            pusher->sendMessage(payload);
+
+        for (int i = 0; i < messagesPerRun; ++i)
+            puller->receiveMessage(ZMQSocket::ReceiveFlags());
+
+        messages += messagesPerRun;
+    }
+
+    const std::clock_t cpuTicks = std::clock() - cpuStart;
+    reportThroughput(messages, stopWatch.nsecsElapsed(), cpuTicks);
+
+    // Frames which are not encoded still carry the codec header and are copied once
+    // more, which shows for the rows below the threshold.
+    double rawFrameBytes = 0.0;
+    double encodedFrameBytes = 0.0;
+    const double rawMsgsPerSec = measureRateLimitedLink(QSharedPointer<ZMQCodec>(), payload, linkMessageCount, linkBitsPerSecond, &rawFrameBytes);
+    const double encodedMsgsPerSec = measureRateLimitedLink(codec, payload, linkMessageCount, linkBitsPerSecond, &encodedFrameBytes);
+    QVERIFY(rawMsgsPerSec > 0.0 && encodedMsgsPerSec > 0.0);
+    qDebug("%s: compression ratio %.3f, %.0f msgs/s raw vs. %.0f msgs/s compressed on a %.0f Mbit/s link",
+           QTest::currentDataTag(),
+           encodedFrameBytes / rawFrameBytes,
+           rawMsgsPerSec, encodedMsgsPerSec, linkBitsPerSecond / 1e6);
+}
+
+void NzmqtBench::benchRecorder_data()
+{
+    addMessageSizeRows();
+}
+
+void NzmqtBench::benchRecorder()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, messageSize);
+    const int messagesPerRun = 100000;
+    const QString baseName = QDir(QDir::tempPath()).filePath("nzmqt_bench_log");
+
+    ZMQRecorder recorder(baseName);
+    QVERIFY(recorder.open());
+
+    const QList<QByteArray> message = QList<QByteArray>() << "topic" << QByteArray(messageSize, 'x');
+    quint64 messages = 0;
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    const std::clock_t cpuStart = std::clock();
+
+    QBENCHMARK {
+        for (int i = 0; i < messagesPerRun; ++i)
+            recorder.record(message);
+
+        messages += messagesPerRun;
+    }
+
+    reportThroughput(messages, stopWatch.nsecsElapsed(), std::clock() - cpuStart);
+    QCOMPARE(recorder.recordedMessages(), messages);
+
+    recorder.close();
+    for (int i = 0; QFile::exists(ZMQRecorder::segmentFileName(baseName, i)); ++i)
+        QFile::remove(ZMQRecorder::segmentFileName(baseName, i));
+    QFile::remove(ZMQRecorder::indexFileName(baseName));
+}
+
+void NzmqtBench::addTransportRows()
+{
+    QTest::addColumn<QString>("contextKind");
+    QTest::addColumn<QString>("transport");
+    QTest::addColumn<int>("messageSize");
+
+    const QList<int> sizes = QList<int>() << 1 << 64 << 1024 << 65536 << 1024 * 1024;
+    for (const QString& contextKind : QStringList() << "polling" << "notifier")
+    {
+        for (const QString& transport : QStringList() << "inproc" << "ipc" << "tcp")
+        {
+            for (int size : sizes)
+            {
+                const QString sizeTag = size >= 1024 * 1024 ? QString("%1 MB").arg(size / (1024 * 1024))
+                                      : size >= 1024 ? QString("%1 KB").arg(size / 1024)
+                                      : QString("%1 B").arg(size);
+                const QByteArray tag = QString("%1/%2/%3").arg(contextKind, transport, sizeTag).toLatin1();
+                QTest::newRow(tag.constData()) << contextKind << transport << size;
+            }
+        }
+    }
+}
+
+nzmqt::ZMQContext* NzmqtBench::createContext(const QString& contextKind)
+{
+    if ("notifier" == contextKind)
+        return new nzmqt::SocketNotifierZMQContext();
+    if ("busy" == contextKind)
+        return new nzmqt::BusyPollingZMQContext();
+    return new nzmqt::PollingZMQContext();
+}
+
+QByteArray NzmqtBench::makeAddress(const QString& transport, const QString& name, int tcpPort)
+{
+    if ("inproc" == transport)
+        return "inproc://nzmqt-" + name.toLatin1();
+    if ("ipc" == transport)
+        return "ipc://" + QDir(QDir::tempPath()).filePath("nzmqt-" + name + ".ipc").toLocal8Bit();
+    return "tcp://127.0.0.1:" + QByteArray::number(tcpPort);
+}
+
+void NzmqtBench::appendResult(double msgsPerSec, double mbPerSec, qint64 p50Nsecs, qint64 p99Nsecs, double cpuNsecsPerMsg)
+{
+    const QString fileName = QString::fromLocal8Bit(qgetenv("NZMQT_BENCH_CSV"));
+    if (fileName.isEmpty())
+        return;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning("Cannot write results: %s", qPrintable(file.errorString()));
+        return;
+    }
+
+    if (0 == file.size())
+        file.write("nzmqt_version,zmq_version,benchmark,tag,msgs_per_sec,mb_per_sec,p50_nsecs,p99_nsecs,cpu_nsecs_per_msg\n");
+
+    int major, minor, patch;
+    nzmqt::version(&major, &minor, &patch);
+    file.write(QString("%1,%2.%3.%4,%5,%6,%7,%8,%9,%10,%11\n")
+               .arg(NZMQT_BENCH_VERSION)
+               .arg(major).arg(minor).arg(patch)
+               .arg(QTest::currentTestFunction())
+               .arg(QTest::currentDataTag())
+               .arg(msgsPerSec, 0, 'f', 0)
+               .arg(mbPerSec, 0, 'f', 3)
+               .arg(p50Nsecs)
+               .arg(p99Nsecs)
+               .arg(cpuNsecsPerMsg, 0, 'f', 1)
+               .toLatin1());
+}
+
+void NzmqtBench::benchThroughput_data()
+{
+    addTransportRows();
+}
+
+void NzmqtBench::benchThroughput()
+{
+    using namespace nzmqt;
+
+    QFETCH(QString, contextKind);
+    QFETCH(QString, transport);
+    QFETCH(int, messageSize);
+#if defined(Q_OS_WIN)
+    if ("ipc" == transport)
+        QSKIP("The ipc transport is not supported on Windows");
+#endif
+    // About 64 MB per run.
+    const int messageCount = qBound(100, 64 * 1024 * 1024 / messageSize, 1000000);
+
+    QEventLoop loop;
+    int received = 0;
+
+    QScopedPointer<ZMQContext> context(createContext(contextKind));
+    ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    const QByteArray address = makeAddress(transport, "bench-throughput", 5561);
+    puller->bindTo(address.constData());
+    connect(puller, &ZMQSocket::messageReceived, puller, [&](const QList<QByteArray>&) {
+        if (++received == messageCount)
+            loop.quit();
+    });
+
+    RemotePeer peer(static_cast<void*>(*context), RemotePeer::MODE_THROUGHPUT, address, messageSize, messageCount);
+    context->start();
+
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    const std::clock_t cpuStart = std::clock();
+
+    peer.start();
+    QTimer::singleShot(60000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    const qint64 wallNsecs = stopWatch.nsecsElapsed();
+    const std::clock_t cpuTicks = std::clock() - cpuStart;
+    context->stop();
+    peer.wait();
+    QCOMPARE(received, messageCount);
+
+    // CPU time is the one of the whole process, i.e. of both peers.
+    const double msgsPerSec = received * 1e9 / qMax<qint64>(wallNsecs, 1);
+    const double mbPerSec = msgsPerSec * messageSize / (1024.0 * 1024.0);
+    const double cpuNsecsPerMsg = double(cpuTicks) * 1e9 / CLOCKS_PER_SEC / received;
+    qDebug("%s: %.0f msgs/s, %.1f MB/s, %.1f ns CPU per message",
+           QTest::currentDataTag(), msgsPerSec, mbPerSec, cpuNsecsPerMsg);
+    QTest::setBenchmarkResult(msgsPerSec * messageSize, QTest::BytesPerSecond);
+    appendResult(msgsPerSec, mbPerSec, 0, 0, cpuNsecsPerMsg);
+}
+
+void NzmqtBench::benchLatency_data()
+{
+    addTransportRows();
+}
+
+void NzmqtBench::benchLatency()
+{
+    using namespace nzmqt;
+
+    QFETCH(QString, contextKind);
+    QFETCH(QString, transport);
+    QFETCH(int, messageSize);
+#if defined(Q_OS_WIN)
+    if ("ipc" == transport)
+        QSKIP("The ipc transport is not supported on Windows");
+#endif
+    // About 16 MB per run.
+    const int roundtripCount = qBound(100, 16 * 1024 * 1024 / messageSize, 10000);
+
+    QEventLoop loop;
+    ZMQLatencyHistogram histogram;
+    QElapsedTimer roundtripTimer;
+    const QByteArray payload(messageSize, 'x');
+    int roundtrips = 0;
+
+    QScopedPointer<ZMQContext> context(createContext(contextKind));
+    ZMQSocket* requester = context->createSocket(ZMQSocket::TYP_REQ, context.data());
+    const QByteArray address = makeAddress(transport, "bench-latency", 5562);
+    requester->bindTo(address.constData());
+    connect(requester, &ZMQSocket::messageReceived, requester, [&](const QList<QByteArray>&) {
+        histogram.record(roundtripTimer.nsecsElapsed());
+        if (++roundtrips == roundtripCount)
+        {
+            loop.quit();
+            return;
+        }
+        roundtripTimer.start();
+        requester->sendMessage(payload, ZMQSocket::SendFlags());
+    });
+
+    RemotePeer peer(static_cast<void*>(*context), RemotePeer::MODE_LATENCY, address, messageSize, roundtripCount);
+    peer.start();
+    context->start();
+
+    const std::clock_t cpuStart = std::clock();
+    // Blocks until the peer has connected.
+    roundtripTimer.start();
+    requester->sendMessage(payload, ZMQSocket::SendFlags());
+    QTimer::singleShot(60000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    const std::clock_t cpuTicks = std::clock() - cpuStart;
+    context->stop();
+    peer.wait();
+    QCOMPARE(roundtrips, roundtripCount);
+
+    const qint64 p50 = histogram.valueAtPercentile(50.0);
+    const qint64 p99 = histogram.valueAtPercentile(99.0);
+    const double cpuNsecsPerMsg = double(cpuTicks) * 1e9 / CLOCKS_PER_SEC / roundtrips;
+    qDebug("%s: round trip p50 %.1f us, p99 %.1f us, max %.1f us, %.1f ns CPU per round trip",
+           QTest::currentDataTag(), p50 / 1e3, p99 / 1e3, histogram.max() / 1e3, cpuNsecsPerMsg);
+    QTest::setBenchmarkResult(p50, QTest::WalltimeNanoseconds);
+    appendResult(1e9 / qMax(histogram.mean(), 1.0), 0.0, p50, p99, cpuNsecsPerMsg);
+}
+
+void NzmqtBench::reportAllocations(quint64 operations, quint64 allocations)
+{
+    qDebug("%s: %.2f heap allocations per operation",
+           QTest::currentDataTag(),
+           operations > 0 ? double(allocations) / operations : 0.0);
+}
+
+void NzmqtBench::addMultipartRows()
+{
+    QTest::addColumn<int>("parts");
+    QTest::addColumn<int>("messageSize");
+
+    QTest::newRow("1 x 64 B") << 1 << 64;
+    QTest::newRow("4 x 64 B") << 4 << 64;
+    QTest::newRow("4 x 1 KB") << 4 << 1024;
+    QTest::newRow("1 x 64 KB") << 1 << 65536;
+}
+
+void NzmqtBench::benchMessageFromByteArray_data()
+{
+    addMessageSizeRows();
+    QTest::newRow("64 KB") << 65536;
+}
+
+void NzmqtBench::benchMessageFromByteArray()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, messageSize);
+
+    const QByteArray payload(messageSize, 'x');
+    quint64 operations = 0;
+    const quint64 allocationsBefore = threadAllocations;
+
+    QBENCHMARK {
+        ZMQMessage msg(payload);
+        ++operations;
+    }
+
+    reportAllocations(operations, threadAllocations - allocationsBefore);
+}
+
+void NzmqtBench::benchMessageToByteArray_data()
+{
+    benchMessageFromByteArray_data();
+}
+
+void NzmqtBench::benchMessageToByteArray()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, messageSize);
+
+    ZMQMessage msg(QByteArray(messageSize, 'x'));
+    quint64 operations = 0;
+    const quint64 allocationsBefore = threadAllocations;
+
+    QBENCHMARK {
+        const QByteArray bytes = msg.toByteArray();
+        ++operations;
+    }
+
+    reportAllocations(operations, threadAllocations - allocationsBefore);
+}
+
+void NzmqtBench::benchReceiveMessageList_data()
+{
+    addMultipartRows();
+}
+
+void NzmqtBench::benchReceiveMessageList()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, parts);
+    QFETCH(int, messageSize);
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+    ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+    receiver->bindTo("inproc://bench-receive-list");
+    sender->connectTo("inproc://bench-receive-list");
+
+    const QByteArray payload(messageSize, 'x');
+    quint64 operations = 0;
+    quint64 senderAllocations = 0;
+    const quint64 allocationsBefore = threadAllocations;
+
+    // The time includes sending with the plain 0MQ API, its allocations are not counted.
+    QBENCHMARK {
+        const quint64 sendAllocationsBefore = threadAllocations;
+        for (int i = 0; i < parts; ++i)
+            zmq_send(static_cast<void*>(*sender), payload.constData(), payload.size(), i + 1 < parts ? ZMQ_SNDMORE : 0);
+        senderAllocations += threadAllocations - sendAllocationsBefore;
+
+        const QList<QByteArray> message = receiver->receiveMessage();
+        Q_ASSERT(message.size() == parts);
+        ++operations;
+    }
+
+    reportAllocations(operations, threadAllocations - allocationsBefore - senderAllocations);
+}
+
+void NzmqtBench::benchSendMessageList_data()
+{
+    addMultipartRows();
+}
+
+void NzmqtBench::benchSendMessageList()
+{
+    using namespace nzmqt;
+
+    QFETCH(int, parts);
+    QFETCH(int, messageSize);
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+    ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+    receiver->bindTo("inproc://bench-send-list");
+    sender->connectTo("inproc://bench-send-list");
+
+    QList<QByteArray> message;
+    for (int i = 0; i < parts; ++i)
+        message += QByteArray(messageSize, 'x');
+
+    zmq_msg_t msg;
+    zmq_msg_init(&msg);
+    quint64 operations = 0;
+    quint64 receiverAllocations = 0;
+    const quint64 allocationsBefore = threadAllocations;
+
+    // The time includes receiving with the plain 0MQ API, its allocations are not counted.
+    QBENCHMARK {
+        sender->sendMessage(message);
+
+        const quint64 receiveAllocationsBefore = threadAllocations;
+        for (int i = 0; i < parts; ++i)
+            zmq_msg_recv(&msg, static_cast<void*>(*receiver), 0);
+        receiverAllocations += threadAllocations - receiveAllocationsBefore;
+
+        ++operations;
+    }
+
+    zmq_msg_close(&msg);
+    reportAllocations(operations, threadAllocations - allocationsBefore - receiverAllocations);
+}
+
+void NzmqtBench::benchEmitMessageReceived_data()
+{
+    QTest::addColumn<bool>("queued");
+
+    QTest::newRow("direct") << false;
+    QTest::newRow("queued") << true;
+}
+
+void NzmqtBench::benchEmitMessageReceived()
+{
+    using namespace nzmqt;
+
+    QFETCH(bool, queued);
+
+    QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+    ZMQSocket* socket = context->createSocket(ZMQSocket::TYP_SUB, context.data());
+    TopicFilter* filter = new TopicFilter(QByteArray());
+    filter->setParent(socket);
+    connect(socket, &ZMQSocket::messageReceived, filter, &TopicFilter::receive,
+            queued ? Qt::QueuedConnection : Qt::DirectConnection);
+
+    const QList<QByteArray> message = QList<QByteArray>() << "topic" << QByteArray(64, 'x');
+    quint64 operations = 0;
+    const quint64 allocationsBefore = threadAllocations;
+
+    // A queued emission is complete once the receiver has processed the posted event.
+    QBENCHMARK {
+        emit socket->messageReceived(message);
+        if (queued)
+            QCoreApplication::sendPostedEvents(filter, QEvent::MetaCall);
+        ++operations;
+    }
+
+    reportAllocations(operations, threadAllocations - allocationsBefore);
+}
+
+void NzmqtBench::benchDispatchPath_data()
+{
+    QTest::addColumn<QString>("path");
+
+    QTest::newRow("signal/direct") << "direct";
+    QTest::newRow("signal/queued") << "queued";
+    QTest::newRow("handler") << "handler";
+}
+
+void NzmqtBench::benchDispatchPath()
+{
+    using namespace nzmqt;
+
+    QFETCH(QString, path);
+    const int messagesPerRun = 1000;
+
+    // The context is polled manually, so a run sends, receives and dispatches a batch.
+    QScopedPointer<PollingZMQContext> context(new PollingZMQContext());
+    ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+    ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    pusher->bindTo("inproc://bench-dispatch");
+    puller->connectTo("inproc://bench-dispatch");
+
+    TopicFilter* filter = new TopicFilter(QByteArray());
+    filter->setParent(puller);
+    if ("handler" == path)
+        puller->setMessageHandler([filter](const QList<QByteArray>& message) { filter->receive(message); });
+    else
+        connect(puller, &ZMQSocket::messageReceived, filter, &TopicFilter::receive,
+                "queued" == path ? Qt::QueuedConnection : Qt::DirectConnection);
+
+    const QList<QByteArray> message = QList<QByteArray>() << "topic" << QByteArray(64, 'x');
+    quint64 messages = 0;
+    const quint64 allocationsBefore = threadAllocations;
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    const std::clock_t cpuStart = std::clock();
+
+    // Sending and receiving cost the same on all paths, so the differences are due to dispatching.
+    QBENCHMARK {
+        for (int i = 0; i < messagesPerRun; ++i)
+            pusher->sendMessage(message);
+        context->poll();
+        if ("queued" == path)
+            QCoreApplication::sendPostedEvents(filter, QEvent::MetaCall);
+        messages += messagesPerRun;
+    }
+
+    reportThroughput(messages, stopWatch.nsecsElapsed(), std::clock() - cpuStart);
+    reportAllocations(messages, threadAllocations - allocationsBefore);
+}
+
+int NzmqtBench::openFileDescriptors()
+{
+    QDir fds("/proc/self/fd");
+    if (!fds.exists())
+        return -1;
+    return fds.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).size();
+}
+
+void NzmqtBench::benchSocketChurn_data()
+{
+    QTest::addColumn<QString>("contextKind");
+    QTest::addColumn<int>("liveSockets");
+    // Sockets created per second, 0 means as fast as possible.
+    QTest::addColumn<int>("rate");
+
+    for (const QString& contextKind : QStringList() << "polling" << "notifier")
+    {
+        for (int liveSockets : QList<int>() << 10 << 100 << 1000)
+        {
+            const QByteArray tag = QString("%1/%2 live").arg(contextKind).arg(liveSockets).toLatin1();
+            QTest::newRow(tag + "/unlimited") << contextKind << liveSockets << 0;
+        }
+        QTest::newRow(QString("%1/100 live/1000 per s").arg(contextKind).toLatin1().constData()) << contextKind << 100 << 1000;
+    }
+}
+
+// Emulates a gateway with many short-lived DEALER sockets: keeps 'liveSockets' sockets
+// connected to a ROUTER, each sending one message, and replaces the oldest one by a new
+// one at the given rate while the context keeps dispatching the traffic.
+void NzmqtBench::benchSocketChurn()
+{
+    using namespace nzmqt;
+
+    QFETCH(QString, contextKind);
+    QFETCH(int, liveSockets);
+    QFETCH(int, rate);
+    const int churnCount = qMax(5000, 2 * liveSockets);
+
+    ZMQLatencyHistogram createLatency;
+    ZMQLatencyHistogram closeLatency;
+    int received = 0;
+
+    QScopedPointer<ZMQContext> context(createContext(contextKind));
+    ZMQSocket* router = context->createSocket(ZMQSocket::TYP_ROUTER, context.data());
+    router->bindTo("inproc://bench-churn");
+    connect(router, &ZMQSocket::messageReceived, router, [&received](const QList<QByteArray>&) { ++received; });
+    context->start();
+
+    const int fdsBefore = openFileDescriptors();
+    QQueue<ZMQSocket*> live;
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    const std::clock_t cpuStart = std::clock();
+    QElapsedTimer latencyTimer;
+
+    for (int i = 0; i < churnCount; ++i)
+    {
+        if (rate > 0)
+        {
+            const qint64 dueNsecs = qint64(i) * 1000000000 / rate;
+            while (stopWatch.nsecsElapsed() < dueNsecs)
+                QCoreApplication::processEvents();
+        }
+        else if (0 == i % 16)
+        {
+            QCoreApplication::processEvents();
+        }
+
+        if (live.size() >= liveSockets)
+        {
+            ZMQSocket* socket = live.dequeue();
+            latencyTimer.start();
+            delete socket;
+            closeLatency.record(latencyTimer.nsecsElapsed());
+        }
+
+        latencyTimer.start();
+        ZMQSocket* socket = context->createSocket(ZMQSocket::TYP_DEALER, context.data());
+        socket->connectTo("inproc://bench-churn");
+        createLatency.record(latencyTimer.nsecsElapsed());
+
+        socket->sendMessage("ping");
+        live.enqueue(socket);
+    }
+
+    while (!live.isEmpty())
+        delete live.dequeue();
+
+    const qint64 wallNsecs = stopWatch.nsecsElapsed();
+    const std::clock_t cpuTicks = std::clock() - cpuStart;
+
+    // Let deferred deletes run and 0MQ's reaper release the sockets' resources.
+    for (int i = 0; i < 50 && (received < churnCount || openFileDescriptors() > fdsBefore); ++i)
+    {
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        QTest::qWait(10);
+    }
+    const int leakedFds = fdsBefore >= 0 ? openFileDescriptors() - fdsBefore : -1;
+
+    qDebug("%s: %.0f sockets/s, create p50 %.1f us, p99 %.1f us, close p50 %.1f us, p99 %.1f us, "
+           "%.1f us CPU per socket, %d of %d messages received, %d leaked file descriptors",
+           QTest::currentDataTag(),
+           churnCount * 1e9 / qMax<qint64>(wallNsecs, 1),
+           createLatency.valueAtPercentile(50) / 1e3, createLatency.valueAtPercentile(99) / 1e3,
+           closeLatency.valueAtPercentile(50) / 1e3, closeLatency.valueAtPercentile(99) / 1e3,
+           double(cpuTicks) * 1e6 / CLOCKS_PER_SEC / churnCount,
+           received, churnCount, leakedFds);
+    QTest::setBenchmarkResult(createLatency.valueAtPercentile(50) + closeLatency.valueAtPercentile(50), QTest::WalltimeNanoseconds);
+    QVERIFY(leakedFds <= 0);
+}
+
+void NzmqtBench::benchSocketProfiles_data()
+{
+    QTest::addColumn<QString>("preset");
+
+    for (const QString& preset : QStringList() << "low-latency" << "bulk-throughput" << "many-idle-peers")
+        QTest::newRow(preset.toLatin1().constData()) << preset;
+}
+
+void NzmqtBench::benchSocketProfiles()
+{
+    using namespace nzmqt;
+
+    QFETCH(QString, preset);
+
+    // Each preset is measured against its own goal and compared to 0MQ's defaults.
+    if ("low-latency" == preset)
+    {
+        const qint64 baseline = measureQueueingDelay(ZMQSocketProfile());
+        const qint64 tuned = measureQueueingDelay(ZMQSocketProfile::lowLatency());
+        qDebug("%s: queueing delay p99 under overload %.1f us, %.1f us with defaults",
+               QTest::currentDataTag(), tuned / 1e3, baseline / 1e3);
+        QTest::setBenchmarkResult(tuned, QTest::WalltimeNanoseconds);
+        appendResult(0.0, 0.0, 0, tuned, 0.0);
+        QVERIFY(tuned < baseline);
+    }
+    else if ("bulk-throughput" == preset)
+    {
+        // With 0MQ's default HWMs the sender stalls until the slow reader has drained
+        // the queues, while the preset's queues absorb the whole burst.
+        const qint64 baseline = measureBurstSendTime(ZMQSocketProfile());
+        const qint64 tuned = measureBurstSendTime(ZMQSocketProfile::bulkThroughput());
+        qDebug("%s: burst of 4000 16 KB messages handed to a slow reader in %.1f ms, %.1f ms with defaults",
+               QTest::currentDataTag(), tuned / 1e6, baseline / 1e6);
+        QTest::setBenchmarkResult(tuned, QTest::WalltimeNanoseconds);
+        appendResult(0.0, 0.0, 0, tuned, 0.0);
+        QVERIFY(tuned > 0 && baseline > 0);
+        QVERIFY(tuned < baseline / 2);
+    }
+    else
+    {
+        const double baseline = measureIdlePeerBacklog(ZMQSocketProfile());
+        const double tuned = measureIdlePeerBacklog(ZMQSocketProfile::manyIdlePeers());
+        qDebug("%s: %.1f KB queued per idle peer, %.1f KB with defaults",
+               QTest::currentDataTag(), tuned / 1024, baseline / 1024);
+        QTest::setBenchmarkResult(tuned, QTest::BytesAllocated);
+        QVERIFY(tuned < baseline);
+    }
+}
+
+qint64 NzmqtBench::measureQueueingDelay(const nzmqt::ZMQSocketProfile& profile)
+{
+    using namespace nzmqt;
+
+    QScopedPointer<ZMQContext> context(createContext("polling"));
+    context->setSocketProfile(profile);
+    ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    receiver->bindTo("inproc://bench-profile-latency");
+    ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+    sender->connectTo("inproc://bench-profile-latency");
+
+    ZMQLatencyHistogram sojourn;
+    QElapsedTimer clock;
+    clock.start();
+
+    // The sender offers ten times the load the receiver can handle and sheds whatever
+    // does not fit into the queues, so the queues stay full.
+    for (int i = 0; i < 20000; ++i)
+    {
+        for (int j = 0; j < 10; ++j)
+        {
+            const qint64 sentNsecs = clock.nsecsElapsed();
+            sender->sendMessage(QByteArray(reinterpret_cast<const char*>(&sentNsecs), sizeof(sentNsecs)));
+        }
+
+        const QList<QByteArray> message = receiver->receiveMessage();
+        if (message.isEmpty())
+            continue;
+        qint64 sentNsecs = 0;
+        memcpy(&sentNsecs, message.first().constData(), sizeof(sentNsecs));
+        sojourn.record(clock.nsecsElapsed() - sentNsecs);
+
+        // 10 us of work per message.
+        const qint64 busyUntil = clock.nsecsElapsed() + 10000;
+        while (clock.nsecsElapsed() < busyUntil)
+            ;
+    }
+    return sojourn.valueAtPercentile(99.0);
+}
+
+qint64 NzmqtBench::measureBurstSendTime(const nzmqt::ZMQSocketProfile& profile)
+{
+    using namespace nzmqt;
+
+    const int messageSize = 16 * 1024;
+    const int burstSize = 4000;
+    // The reader takes a break of 1 ms after each batch of this many messages.
+    const int readerBatchSize = 50;
+#if defined(Q_OS_WIN)
+    const QByteArray address = makeAddress("inproc", "bench-profile-burst", 0);
+#else
+    const QByteArray address = makeAddress("ipc", "bench-profile-burst", 0);
+#endif
+
+    QScopedPointer<ZMQContext> context(createContext("polling"));
+    context->setSocketProfile(profile);
+    ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    receiver->bindTo(address.constData());
+    receiver->setOption(ZMQSocket::OPT_RCVTIMEO, 10000);
+    ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+    sender->connectTo(address.constData());
+    sender->setOption(ZMQSocket::OPT_SNDTIMEO, 10000);
+
+    // The context is not started, so both sockets are used by blocking calls only and
+    // the sender may be handed over to another thread. It blocks as soon as the queues
+    // between the peers are full, until the reader has caught up.
+    const QByteArray payload(messageSize, 'x');
+    qint64 burstNsecs = -1;
+    std::thread sending([&]() {
+        const qint64 start = steadyNsecs();
+        for (int i = 0; i < burstSize; ++i)
+        {
+            if (!sender->sendMessage(payload, ZMQSocket::SendFlags()))
+                return;
+        }
+        burstNsecs = steadyNsecs() - start;
+    });
+
+    int received = 0;
+    while (received < burstSize && !receiver->receiveMessage(ZMQSocket::ReceiveFlags()).isEmpty())
+    {
+        if (0 == ++received % readerBatchSize)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    sending.join();
+
+    if (received < burstSize)
+        return -1;
+    return burstNsecs;
+}
+
+double NzmqtBench::measureIdlePeerBacklog(const nzmqt::ZMQSocketProfile& profile)
+{
+    using namespace nzmqt;
+
+    const int peerCount = 100;
+    const int messageCount = 5000;
+    const int messageSize = 256;
+
+    QScopedPointer<ZMQContext> context(createContext("polling"));
+    context->setSocketProfile(profile);
+    ZMQSocket* publisher = context->createSocket(ZMQSocket::TYP_PUB, context.data());
+    publisher->bindTo("inproc://bench-profile-idle");
+    QList<ZMQSocket*> subscribers;
+    for (int i = 0; i < peerCount; ++i)
+    {
+        ZMQSocket* subscriber = context->createSocket(ZMQSocket::TYP_SUB, context.data());
+        subscriber->subscribeTo("");
+        subscriber->connectTo("inproc://bench-profile-idle");
+        subscribers << subscriber;
+    }
+    // Let the publisher see the subscriptions.
+    publisher->sendMessage("warm-up");
+    QTest::qWait(50);
+
+    // The subscribers do not read, so the publisher queues for each of them until its
+    // high water mark is reached and drops everything after that.
+    const QByteArray payload(messageSize, 'x');
+    for (int i = 0; i < messageCount; ++i)
+        publisher->sendMessage(payload);
+
+    quint64 queuedBytes = 0;
+    for (ZMQSocket* subscriber : subscribers)
+    {
+        for (QList<QByteArray> message = subscriber->receiveMessage(); !message.isEmpty(); message = subscriber->receiveMessage())
+            queuedBytes += message.first().size();
+    }
+    return double(queuedBytes) / peerCount;
+}
+
+void NzmqtBench::benchWakeupLatency_data()
+{
+    QTest::addColumn<QString>("contextKind");
+    QTest::addColumn<qint64>("spinBudget");
+
+    QTest::newRow("polling") << "polling" << qint64(0);
+    QTest::newRow("notifier") << "notifier" << qint64(0);
+    // The sender's pauses are shorter than the spin budget, so the polling thread never blocks.
+    QTest::newRow("busy/spinning") << "busy" << qint64(1000000000);
+    QTest::newRow("busy/blocking") << "busy" << qint64(0);
+}
+
+void NzmqtBench::benchWakeupLatency()
+{
+    using namespace nzmqt;
+
+    QFETCH(QString, contextKind);
+    QFETCH(qint64, spinBudget);
+    const int messageCount = 500;
+
+    ZMQLatencyHistogram histogram;
+    QAtomicInt received;
+    auto record = [&](const QList<QByteArray>& message) {
+        qint64 sentNsecs = 0;
+        memcpy(&sentNsecs, message.first().constData(), sizeof(sentNsecs));
+        histogram.record(steadyNsecs() - sentNsecs);
+        received.fetchAndAddOrdered(1);
+    };
+
+    QScopedPointer<ZMQContext> context(createContext(contextKind));
+    ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+    const QByteArray address = makeAddress("tcp", "bench-wakeup", 5564);
+    puller->bindTo(address.constData());
+    if (BusyPollingZMQContext* busyContext = qobject_cast<BusyPollingZMQContext*>(context.data()))
+    {
+        busyContext->setSpinBudget(spinBudget);
+        busyContext->setMessageHandler([&](ZMQSocket*, const QList<QByteArray>& message) { record(message); });
+    }
+    else
+    {
+        connect(puller, &ZMQSocket::messageReceived, puller, record);
+    }
+
+    RemotePeer peer(static_cast<void*>(*context), RemotePeer::MODE_WAKEUP, address, 64, messageCount);
+    const std::clock_t cpuStart = std::clock();
+    context->start();
+    peer.start();
+    for (int i = 0; i < 1000 && received.load() < messageCount; ++i)
+        QTest::qWait(10);
+
+    const std::clock_t cpuTicks = std::clock() - cpuStart;
+    context->stop();
+    peer.wait();
+    QCOMPARE(received.load(), messageCount);
+
+    const qint64 p50 = histogram.valueAtPercentile(50.0);
+    const qint64 p99 = histogram.valueAtPercentile(99.0);
+    const double cpuNsecsPerMsg = double(cpuTicks) * 1e9 / CLOCKS_PER_SEC / messageCount;
+    qDebug("%s: wake-up p50 %.1f us, p99 %.1f us, max %.1f us, %.1f us CPU per message",
+           QTest::currentDataTag(), p50 / 1e3, p99 / 1e3, histogram.max() / 1e3, cpuNsecsPerMsg / 1e3);
+    QTest::setBenchmarkResult(p50, QTest::WalltimeNanoseconds);
+    appendResult(0.0, 0.0, p50, p99, cpuNsecsPerMsg);
+}
+
+}
+
+QTEST_MAIN(bench::NzmqtBench)
+
+#include "nzmqt_bench.moc"
@@ -31,7 +31,9 @@
 
 #include <QDebug>
 #include <QEventLoop>
+#include <QList>
 #include <QThread>
+#include <QTimer>
 
 
 namespace nzmqt
@@ -58,9 +60,23 @@ protected:
 
     virtual void startImpl() = 0;
 
+    // Invokes the given slot of this object as soon as each of the sockets has established
+    // a connection to a peer, instead of waiting for an arbitrary period of time. Call this
+    // before binding or connecting the sockets. The timeout covers transports for which 0MQ
+    // does not report connection events (i.e. inproc). A socket listed n times is waited for
+    // until n of its peers have connected.
+    void invokeWhenConnected(const QList<ZMQSocket*>& sockets, const char* slot, int timeoutMsecs = 1000);
+
     static void sleep(unsigned long msecs);
 
+private slots:
+    void peerConnected();
+    void peerConnectTimeout();
+
 private:
+    QList<ZMQSocket*> unconnectedSockets_;
+    QByteArray connectedSlot_;
+
     class ThreadTools : private QThread
     {
     public:
@@ -95,6 +111,46 @@ inline void SampleBase::stop()
     emit finished();
 }
 
+inline void SampleBase::invokeWhenConnected(const QList<ZMQSocket*>& sockets, const char* slot, int timeoutMsecs)
+{
+    unconnectedSockets_ = sockets;
+    connectedSlot_ = slot;
+
+    for (ZMQSocket* socket : sockets)
+    {
+        // Messages sent by a binding socket before the handshake has completed might get lost.
+#ifdef ZMQ_EVENT_HANDSHAKE_SUCCEEDED
+        socket->startMonitor(ZMQ_EVENT_CONNECTED | ZMQ_EVENT_HANDSHAKE_SUCCEEDED);
+        connect(socket, SIGNAL(handshakeSucceeded(const QString&)), SLOT(peerConnected()));
+#else
+        socket->startMonitor(ZMQ_EVENT_CONNECTED | ZMQ_EVENT_ACCEPTED);
+        connect(socket, SIGNAL(accepted(const QString&)), SLOT(peerConnected()));
+#endif
+        connect(socket, SIGNAL(connected(const QString&)), SLOT(peerConnected()));
+    }
+
+    QTimer::singleShot(timeoutMsecs, this, SLOT(peerConnectTimeout()));
+}
+
+inline void SampleBase::peerConnected()
+{
+    unconnectedSockets_.removeOne(qobject_cast<ZMQSocket*>(sender()));
+    if (unconnectedSockets_.isEmpty())
+        peerConnectTimeout();
+}
+
+inline void SampleBase::peerConnectTimeout()
+{
+    if (connectedSlot_.isEmpty())
+        return;
+
+    const QByteArray slot = connectedSlot_;
+    connectedSlot_.clear();
+    unconnectedSockets_.clear();
+
+    QMetaObject::invokeMethod(this, slot.constData());
+}
+
 inline void SampleBase::sleep(unsigned long msecs)
 {
     ThreadTools::msleep(msecs);
@@ -0,0 +1,145 @@
+// Copyright 2011-2014 Johann Duscher (a.k.a. Jonny Dee). All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//    1. Redistributions of source code must retain the above copyright notice, this list of
+//       conditions and the following disclaimer.
+//
+//    2. Redistributions in binary form must reproduce the above copyright notice, this list
+//       of conditions and the following disclaimer in the documentation and/or other materials
+//       provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY JOHANN DUSCHER ''AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// The views and conclusions contained in the software and documentation are those of the
+// authors and should not be interpreted as representing official policies, either expressed
+// or implied, of Johann Duscher.
+
+
+#ifndef NZMQT_LOADRECEIVER_H
+#define NZMQT_LOADRECEIVER_H
+
+#include "common/SampleBase.hpp"
+#include "loadgen/LoadStatistics.hpp"
+
+#include <nzmqt/nzmqt.hpp>
+
+#include <QByteArray>
+#include <QList>
+#include <QTextStream>
+#include <QTimer>
+
+
+namespace nzmqt
+{
+
+namespace samples
+{
+
+namespace loadgen
+{
+
+// Counterpart of 'LoadSender'. In SUB mode it subscribes to all messages and reports
+// throughput and one-way latencies, measured from the intended send time stamped into
+// the messages (which requires synchronized clocks if the sender runs on another host).
+// In REP mode it echoes each request and reports throughput only.
+class LoadReceiver : public SampleBase
+{
+    Q_OBJECT
+    typedef SampleBase super;
+
+public:
+    enum Mode
+    {
+        MODE_SUB,
+        MODE_REP
+    };
+
+    explicit LoadReceiver(ZMQContext& context, Mode mode, const QString& address, int durationSecs, QObject* parent = 0)
+        : super(parent)
+        , mode_(mode), address_(address), durationSecs_(durationSecs)
+        , socket_(0)
+        , statistics_(MODE_SUB == mode ? "bench-sub" : "bench-rep")
+        , cout_(stdout)
+    {
+        socket_ = context.createSocket(MODE_SUB == mode_ ? ZMQSocket::TYP_SUB : ZMQSocket::TYP_REP, this);
+        socket_->setObjectName(MODE_SUB == mode_ ? "LoadReceiver.Socket.socket(SUB)" : "LoadReceiver.Socket.socket(REP)");
+        connect(socket_, SIGNAL(messageReceived(const QList<QByteArray>&)), SLOT(receiveMessage(const QList<QByteArray>&)));
+
+        connect(&reportTimer_, SIGNAL(timeout()), SLOT(report()));
+    }
+
+protected:
+    void startImpl()
+    {
+        if (MODE_SUB == mode_)
+        {
+            socket_->subscribeTo(QString());
+            socket_->connectTo(address_);
+        }
+        else
+        {
+            socket_->bindTo(address_);
+        }
+
+        reportTimer_.start(1000);
+        if (durationSecs_ > 0)
+            QTimer::singleShot(durationSecs_ * 1000, this, SLOT(finish()));
+    }
+
+protected slots:
+    void receiveMessage(const QList<QByteArray>& message)
+    {
+        if (MODE_SUB == mode_)
+        {
+            const qint64 intendedNsecs = message.isEmpty() ? -1 : LoadStatistics::messageStamp(message[0]);
+            statistics_.recordReceived(intendedNsecs >= 0 ? LoadStatistics::nowNsecs() - intendedNsecs : -1);
+        }
+        else
+        {
+            statistics_.recordReceived();
+            if (socket_->sendMessage(message))
+                statistics_.recordSent();
+        }
+    }
+
+    void report()
+    {
+        statistics_.printInterval(cout_);
+    }
+
+    void finish()
+    {
+        reportTimer_.stop();
+        statistics_.printSummary(cout_);
+        emit finished();
+    }
+
+private:
+    Mode mode_;
+    QString address_;
+    int durationSecs_;
+
+    ZMQSocket* socket_;
+    QTimer reportTimer_;
+
+    LoadStatistics statistics_;
+    QTextStream cout_;
+};
+
+}
+
+}
+
+}
+
+#endif // NZMQT_LOADRECEIVER_H
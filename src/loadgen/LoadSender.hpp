@@ -0,0 +1,202 @@
+// Copyright 2011-2014 Johann Duscher (a.k.a. Jonny Dee). All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//    1. Redistributions of source code must retain the above copyright notice, this list of
+//       conditions and the following disclaimer.
+//
+//    2. Redistributions in binary form must reproduce the above copyright notice, this list
+//       of conditions and the following disclaimer in the documentation and/or other materials
+//       provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY JOHANN DUSCHER ''AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// The views and conclusions contained in the software and documentation are those of the
+// authors and should not be interpreted as representing official policies, either expressed
+// or implied, of Johann Duscher.
+
+
+#ifndef NZMQT_LOADSENDER_H
+#define NZMQT_LOADSENDER_H
+
+#include "common/SampleBase.hpp"
+#include "loadgen/LoadStatistics.hpp"
+
+#include <nzmqt/nzmqt.hpp>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTextStream>
+#include <QTimer>
+
+#include <stdexcept>
+
+
+namespace nzmqt
+{
+
+namespace samples
+{
+
+namespace loadgen
+{
+
+// Generates open-loop load at a target rate: messages are due at fixed points in time,
+// independent of how fast previous messages were sent or answered. Messages which cannot
+// be sent in time stay due and are sent as soon as possible, their latency still being
+// measured from the intended send time. Due messages are sent in batches of at most
+// 'SENDBATCH' messages, so a generator falling behind still dispatches replies and reports.
+// Each message consists of 'parts' parts of 'messageSize' bytes, the first 8 bytes
+// carrying the intended send time.
+// In PUB mode the load is published (see 'LoadReceiver' for the subscriber side). PUB
+// sockets drop messages at the high water mark instead of failing, so messages counted
+// as sent may have been dropped and no backlog builds up. The subscriber's figures tell.
+// In REQ mode it is sent through a DEALER socket, so requests don't wait for replies,
+// to a REP socket echoing them, and round-trip latencies are reported.
+class LoadSender : public SampleBase
+{
+    Q_OBJECT
+    typedef SampleBase super;
+
+public:
+    enum Mode
+    {
+        MODE_PUB,
+        MODE_REQ
+    };
+
+    enum { SENDBATCH = 1000 };
+
+    explicit LoadSender(ZMQContext& context, Mode mode, const QString& address, double rate, int messageSize, int parts, int durationSecs, QObject* parent = 0)
+        : super(parent)
+        , mode_(mode), address_(address), rate_(rate), durationNsecs_(qint64(durationSecs) * 1000000000)
+        , socket_(0)
+        , startNsecs_(0), sent_(0)
+        , statistics_(MODE_PUB == mode ? "bench-pub" : "bench-req")
+        , cout_(stdout)
+    {
+        if (rate_ <= 0)
+            throw std::runtime_error("Rate must be greater than 0!");
+
+        if (MODE_REQ == mode_)
+            message_ += QByteArray(); // Empty delimiter expected by REP sockets.
+        message_ += QByteArray(qMax(messageSize, int(sizeof(qint64))), 'x');
+        for (int i = 1; i < parts; ++i)
+            message_ += QByteArray(messageSize, 'x');
+
+        socket_ = context.createSocket(MODE_PUB == mode_ ? ZMQSocket::TYP_PUB : ZMQSocket::TYP_DEALER, this);
+        socket_->setObjectName(MODE_PUB == mode_ ? "LoadSender.Socket.socket(PUB)" : "LoadSender.Socket.socket(DEALER)");
+        connect(socket_, SIGNAL(messageReceived(const QList<QByteArray>&)), SLOT(receiveReply(const QList<QByteArray>&)));
+
+        sendTimer_.setTimerType(Qt::PreciseTimer);
+        connect(&sendTimer_, SIGNAL(timeout()), SLOT(sendDueMessages()));
+        connect(&reportTimer_, SIGNAL(timeout()), SLOT(report()));
+    }
+
+protected:
+    void startImpl()
+    {
+        invokeWhenConnected(QList<ZMQSocket*>() << socket_, "startLoad");
+
+        if (MODE_PUB == mode_)
+            socket_->bindTo(address_);
+        else
+            socket_->connectTo(address_);
+    }
+
+protected slots:
+    void startLoad()
+    {
+        // Messages are scheduled by the monotonic clock, so changes of the system time
+        // don't make them due early or late. Only their stamps refer to the system time.
+        if (MODE_PUB == mode_)
+            cout_ << "bench-pub: PUB drops messages at the high water mark without failing, so 'sent' "
+                     "includes dropped messages and the backlog stays 0. Compare with the subscriber.\n" << ::flush;
+
+        startNsecs_ = LoadStatistics::nowNsecs();
+        clock_.start();
+        sendTimer_.start(1);
+        reportTimer_.start(1000);
+        sendDueMessages();
+    }
+
+    void sendDueMessages()
+    {
+        const qint64 elapsedNsecs = clock_.nsecsElapsed();
+        if (durationNsecs_ > 0 && elapsedNsecs >= durationNsecs_)
+        {
+            sendTimer_.stop();
+            // Give outstanding replies a second.
+            QTimer::singleShot(MODE_REQ == mode_ ? 1000 : 0, this, SLOT(finish()));
+            return;
+        }
+
+        // The first message is due at the start.
+        const quint64 due = quint64(elapsedNsecs * rate_ / 1e9) + 1;
+        QByteArray& stampedPart = message_[MODE_REQ == mode_ ? 1 : 0];
+        // The remaining messages are sent by the next timer event.
+        for (int i = 0; i < SENDBATCH && sent_ < due; ++i)
+        {
+            LoadStatistics::stampMessage(stampedPart, startNsecs_ + qint64(sent_ * 1e9 / rate_));
+            if (!socket_->sendMessage(message_))
+                break;
+
+            ++sent_;
+            statistics_.recordSent();
+        }
+    }
+
+    void receiveReply(const QList<QByteArray>& reply)
+    {
+        const qint64 intendedNsecs = reply.size() > 1 ? LoadStatistics::messageStamp(reply[1]) : -1;
+        statistics_.recordReceived(intendedNsecs >= 0 ? LoadStatistics::nowNsecs() - intendedNsecs : -1);
+    }
+
+    void report()
+    {
+        const quint64 due = quint64(clock_.nsecsElapsed() * rate_ / 1e9) + 1;
+        statistics_.printInterval(cout_, due > sent_ ? due - sent_ : 0);
+    }
+
+    void finish()
+    {
+        reportTimer_.stop();
+        statistics_.printSummary(cout_);
+        emit finished();
+    }
+
+private:
+    Mode mode_;
+    QString address_;
+    double rate_;
+    qint64 durationNsecs_;
+
+    ZMQSocket* socket_;
+    QList<QByteArray> message_;
+    QTimer sendTimer_;
+    QTimer reportTimer_;
+
+    qint64 startNsecs_;
+    QElapsedTimer clock_;
+    quint64 sent_;
+    LoadStatistics statistics_;
+    QTextStream cout_;
+};
+
+}
+
+}
+
+}
+
+#endif // NZMQT_LOADSENDER_H
@@ -0,0 +1,166 @@
+// Copyright 2011-2014 Johann Duscher (a.k.a. Jonny Dee). All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//    1. Redistributions of source code must retain the above copyright notice, this list of
+//       conditions and the following disclaimer.
+//
+//    2. Redistributions in binary form must reproduce the above copyright notice, this list
+//       of conditions and the following disclaimer in the documentation and/or other materials
+//       provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY JOHANN DUSCHER ''AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// The views and conclusions contained in the software and documentation are those of the
+// authors and should not be interpreted as representing official policies, either expressed
+// or implied, of Johann Duscher.
+
+
+#ifndef NZMQT_LOADSTATISTICS_H
+#define NZMQT_LOADSTATISTICS_H
+
+#include <nzmqt/nzmqt.hpp>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QTextStream>
+#include <QtEndian>
+
+#include <chrono>
+
+
+namespace nzmqt
+{
+
+namespace samples
+{
+
+namespace loadgen
+{
+
+// Throughput and latency figures of a load generator, reported per interval and in total.
+// Latencies are measured against the time a message was supposed to be sent according to
+// the target rate, not the time it was actually sent. So queueing caused by the generator
+// falling behind is included (i.e. no coordinated omission).
+class LoadStatistics
+{
+public:
+    explicit LoadStatistics(const QString& name)
+        : name_(name)
+        , sent_(0), received_(0), intervalSent_(0), intervalReceived_(0)
+    {
+        stopWatch_.start();
+        intervalStopWatch_.start();
+    }
+
+    // Wall clock time in nanoseconds since the epoch, which can be compared between
+    // processes on the same host (or hosts with synchronized clocks).
+    static qint64 nowNsecs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Writes the intended send time into the first 8 bytes of the given part.
+    static void stampMessage(QByteArray& part, qint64 intendedNsecs)
+    {
+        qToBigEndian(intendedNsecs, reinterpret_cast<uchar*>(part.data()));
+    }
+
+    // Returns the intended send time of the given part, or -1 if it has none.
+    static qint64 messageStamp(const QByteArray& part)
+    {
+        if (part.size() < int(sizeof(qint64)))
+            return -1;
+        return qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(part.constData()));
+    }
+
+    void recordSent()
+    {
+        ++sent_;
+        ++intervalSent_;
+    }
+
+    void recordReceived(qint64 latencyNsecs = -1)
+    {
+        ++received_;
+        ++intervalReceived_;
+        if (latencyNsecs >= 0)
+        {
+            interval_.record(latencyNsecs);
+            total_.record(latencyNsecs);
+        }
+    }
+
+    // Prints the figures since the previous call and starts a new interval.
+    void printInterval(QTextStream& out, quint64 backlog = 0)
+    {
+        const double secs = intervalStopWatch_.nsecsElapsed() / 1e9;
+        out << QString("%1 %2s: sent %3 msgs/s, received %4 msgs/s")
+               .arg(name_)
+               .arg(stopWatch_.elapsed() / 1000)
+               .arg(intervalSent_ / secs, 0, 'f', 0)
+               .arg(intervalReceived_ / secs, 0, 'f', 0);
+        if (backlog > 0)
+            out << QString(", backlog %1 msgs").arg(backlog);
+        printPercentiles(out, interval_);
+        out << "\n" << ::flush;
+
+        intervalSent_ = 0;
+        intervalReceived_ = 0;
+        interval_.reset();
+        intervalStopWatch_.restart();
+    }
+
+    void printSummary(QTextStream& out)
+    {
+        const double secs = stopWatch_.nsecsElapsed() / 1e9;
+        out << QString("%1 total: sent %2 msgs (%3 msgs/s), received %4 msgs (%5 msgs/s)")
+               .arg(name_)
+               .arg(sent_).arg(sent_ / secs, 0, 'f', 0)
+               .arg(received_).arg(received_ / secs, 0, 'f', 0);
+        printPercentiles(out, total_);
+        out << "\n" << ::flush;
+    }
+
+private:
+    static void printPercentiles(QTextStream& out, const ZMQLatencyHistogram& histogram)
+    {
+        if (0 == histogram.count())
+            return;
+
+        out << QString(", latency usec p50 %1, p90 %2, p99 %3, p99.9 %4, max %5")
+               .arg(histogram.valueAtPercentile(50) / 1e3, 0, 'f', 1)
+               .arg(histogram.valueAtPercentile(90) / 1e3, 0, 'f', 1)
+               .arg(histogram.valueAtPercentile(99) / 1e3, 0, 'f', 1)
+               .arg(histogram.valueAtPercentile(99.9) / 1e3, 0, 'f', 1)
+               .arg(histogram.max() / 1e3, 0, 'f', 1);
+    }
+
+    QString name_;
+    QElapsedTimer stopWatch_;
+    QElapsedTimer intervalStopWatch_;
+    quint64 sent_;
+    quint64 received_;
+    quint64 intervalSent_;
+    quint64 intervalReceived_;
+    ZMQLatencyHistogram interval_;
+    ZMQLatencyHistogram total_;
+};
+
+}
+
+}
+
+}
+
+#endif // NZMQT_LOADSTATISTICS_H
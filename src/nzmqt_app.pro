@@ -56,6 +56,9 @@ HEADERS += \
     pushpull/Ventilator.hpp \
     reqrep/Requester.hpp \
     reqrep/Replier.hpp \
+    loadgen/LoadStatistics.hpp \
+    loadgen/LoadSender.hpp \
+    loadgen/LoadReceiver.hpp \
     app/NzmqtApp.hpp
 
 LIBS += -lzmq
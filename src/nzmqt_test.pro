@@ -38,6 +38,8 @@ TEMPLATE = app
 
 DEFINES += \
 #    NZMQT_LIB \
+    NZMQT_METRICS \
+    NZMQT_TRACE \
     SRCDIR=\\\"$$PWD/\\\"
 
 SOURCES += \
@@ -67,9 +67,9 @@ signals:
 protected:
     void startImpl()
     {
-        socket_->bindTo(address_);
+        invokeWhenConnected(QList<ZMQSocket*>() << socket_, "sendPing");
 
-        QTimer::singleShot(1000, this, SLOT(sendPing()));
+        socket_->bindTo(address_);
     }
 
 protected slots:
@@ -34,6 +34,7 @@
 #include <QByteArray>
 #include <QList>
 #include <QTime>
+#include <QVector>
 
 
 namespace nzmqt
@@ -59,6 +60,7 @@ public:
     {
         sink_ = context.createSocket(ZMQSocket::TYP_PULL, this);
         sink_->setObjectName("Sink.Socket.sink(PULL)");
+        sink_->setTraceFrameEnabled(true);
         connect(sink_, SIGNAL(messageReceived(const QList<QByteArray>&)), SLOT(batchEvent(const QList<QByteArray>&)));
     }
 
@@ -95,6 +97,13 @@ protected slots:
             else
                 qDebug() << ".";
 
+            // Ventilator -> worker -> sink: transit, work and transit time.
+            const QVector<qint64> hopLatencies = sink_->receivedTraceFrame().hopLatencies();
+            if (hopLatencies.size() == 3)
+                qDebug() << "Hop latencies (usec): ventilator->worker" << hopLatencies[0] / 1000
+                         << "worker" << hopLatencies[1] / 1000
+                         << "worker->sink" << hopLatencies[2] / 1000;
+
             --numberOfWorkItems_;
             emit workItemResultReceived();
         }
@@ -52,16 +52,19 @@ class Ventilator : public SampleBase
     typedef SampleBase super;
 
 public:
-    explicit Ventilator(ZMQContext& context, const QString& ventilatorAddress, const QString& sinkAddress, quint32 numberOfWorkItems, QObject* parent = 0)
+    explicit Ventilator(ZMQContext& context, const QString& ventilatorAddress, const QString& sinkAddress, quint32 numberOfWorkItems, int numberOfWorkers = 1, QObject* parent = 0)
         : super(parent)
-        , ventilatorAddress_(ventilatorAddress), sinkAddress_(sinkAddress), numberOfWorkItems_(numberOfWorkItems)
+        , ventilatorAddress_(ventilatorAddress), sinkAddress_(sinkAddress), numberOfWorkItems_(numberOfWorkItems), numberOfWorkers_(qMax(numberOfWorkers, 1))
         , ventilator_(0), sink_(0)
     {
         ventilator_ = context.createSocket(ZMQSocket::TYP_PUSH, this);
         ventilator_->setObjectName("Ventilator.Socket.ventilator(PUSH)");
+        // Lets the sink report how long work items spent in each stage.
+        ventilator_->setTraceFrameEnabled(true);
 
         sink_ = context.createSocket(ZMQSocket::TYP_PUSH, this);
         sink_->setObjectName("Ventilator.Socket.sink(PUSH)");
+        sink_->setTraceFrameEnabled(true);
     }
 
     int numberOfWorkItems() const
@@ -69,6 +72,11 @@ public:
         return numberOfWorkItems_;
     }
 
+    int numberOfWorkers() const
+    {
+        return numberOfWorkers_;
+    }
+
     int maxWorkLoad() const
     {
         return 100;
@@ -81,11 +89,16 @@ signals:
 protected:
     void startImpl()
     {
+        // Start batch as soon as all workers and the sink are connected. PUSH only spreads
+        // work items over the workers connected at that time.
+        QList<ZMQSocket*> sockets;
+        for (int i = 0; i < numberOfWorkers(); ++i)
+            sockets << ventilator_;
+        sockets << sink_;
+        invokeWhenConnected(sockets, "runBatch");
+
         ventilator_->bindTo(ventilatorAddress_);
         sink_->connectTo(sinkAddress_);
-
-        // Start batch after some period of time needed to setup workers.
-        QTimer::singleShot(1000, this, SLOT(runBatch()));
     }
 
 protected slots:
@@ -124,6 +137,7 @@ private:
     QString ventilatorAddress_;
     QString sinkAddress_;
     quint32 numberOfWorkItems_;
+    int numberOfWorkers_;
 
     ZMQSocket* ventilator_;
     ZMQSocket* sink_;
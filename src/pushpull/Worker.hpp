@@ -57,9 +57,11 @@ public:
     {
         sink_ = context.createSocket(ZMQSocket::TYP_PUSH, this);
         sink_->setObjectName("Worker.Socket.sink(PUSH)");
+        sink_->setTraceFrameEnabled(true);
 
         ventilator_ = context.createSocket(ZMQSocket::TYP_PULL, this);
         ventilator_->setObjectName("Worker.Socket.ventilator(PULL)");
+        ventilator_->setTraceFrameEnabled(true);
         connect(ventilator_, SIGNAL(messageReceived(const QList<QByteArray>&)), SLOT(receiveWorkItem(const QList<QByteArray>&)));
     }
 
@@ -55,11 +55,17 @@ public:
     explicit Requester(ZMQContext& context, const QString& address, const QString& requestMsg, QObject *parent = 0)
         : super(parent)
         , address_(address), requestMsg_(requestMsg)
-        , socket_(0)
+        , socket_(0), latencyTracker_(0)
     {
         socket_ = context.createSocket(ZMQSocket::TYP_REQ, this);
         socket_->setObjectName("Requester.Socket.socket(REQ)");
-        connect(socket_, SIGNAL(messageReceived(const QList<QByteArray>&)), SLOT(receiveReply(const QList<QByteArray>&)));
+        latencyTracker_ = new ZMQLatencyTracker(socket_, this);
+        connect(latencyTracker_, SIGNAL(replyReceived(const QList<QByteArray>&, qint64)), SLOT(receiveReply(const QList<QByteArray>&, qint64)));
+    }
+
+    const ZMQLatencyHistogram& latencyHistogram() const
+    {
+        return latencyTracker_->histogram();
     }
 
 signals:
@@ -69,9 +75,9 @@ signals:
 protected:
     void startImpl()
     {
-        socket_->connectTo(address_);
+        invokeWhenConnected(QList<ZMQSocket*>() << socket_, "sendRequest");
 
-        QTimer::singleShot(1000, this, SLOT(sendRequest()));
+        socket_->connectTo(address_);
     }
 
 protected slots:
@@ -83,13 +89,15 @@ protected slots:
         request += QString("REQUEST[%1: %2]").arg(++counter).arg(QDateTime::currentDateTime().toString(Qt::ISODate)).toLocal8Bit();
         request += requestMsg_.toLocal8Bit();
         qDebug() << "Requester::sendRequest> " << request;
-        socket_->sendMessage(request);
+        latencyTracker_->sendRequest(request);
         emit requestSent(request);
     }
 
-    void receiveReply(const QList<QByteArray>& reply)
+    void receiveReply(const QList<QByteArray>& reply, qint64 latencyNsecs)
     {
-        qDebug() << "Requester::replyReceived> " << reply;
+        qDebug() << "Requester::replyReceived> " << reply << "after" << latencyNsecs / 1000 << "usec"
+                 << "(p50:" << latencyHistogram().valueAtPercentile(50) / 1000
+                 << "usec, p99:" << latencyHistogram().valueAtPercentile(99) / 1000 << "usec)";
         emit replyReceived(reply);
 
         // Start timer again in order to trigger the next sendRequest() call.
@@ -101,6 +109,7 @@ private:
     QString requestMsg_;
 
     ZMQSocket* socket_;
+    ZMQLatencyTracker* latencyTracker_;
 };
 
 }
@@ -33,6 +33,8 @@
 #include "pushpull/Sink.hpp"
 
 #include <QCoreApplication>
+#include <QDir>
+#include <QFile>
 #include <QString>
 #include <QtTest>
 
@@ -54,6 +56,28 @@ private slots:
     void testPubSub();
     void testReqRep();
     void testPushPull();
+    void testTopicDispatcher();
+    void testLastValueCache();
+    void testConflatingQueue();
+    void testSequencedReceiver();
+    void testCoalescedReceiver();
+    void testCodec();
+    void testSharedMemoryCodec();
+    void testFileTransfer();
+    void testRecordReplay();
+    void testSpool();
+    void testMetrics();
+    void testLatencyHistogram();
+    void testSocketMonitor();
+    void testDispatchStall();
+    void testTrace();
+    void testSocketChurn();
+    void testTraceFrame();
+    void testSocketProfiles();
+    void testContextOptions();
+    void testBusyPolling();
+    void testMessageHandler();
+    void testTypedSockets();
 
 protected slots:
     // Dummy slot used in test case 'testSignalSlotConnections'.
@@ -332,6 +356,1293 @@ void NzmqtTest::testPushPull()
     }
 }
 
+void NzmqtTest::testTopicDispatcher()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* socket = context->createSocket(ZMQSocket::TYP_SUB, context.data());
+        ZMQTopicDispatcher dispatcher(socket);
+
+        int allCount = 0, aCount = 0, abCount = 0, bCount = 0;
+        ZMQTopicDispatcher::HandlerId allId = dispatcher.addHandler("", [&](const QList<QByteArray>&) { ++allCount; });
+        dispatcher.addHandler("a", [&](const QList<QByteArray>&) { ++aCount; });
+        ZMQTopicDispatcher::HandlerId abId = dispatcher.addHandler("ab", [&](const QList<QByteArray>&) { ++abCount; });
+        dispatcher.addHandler("b", [&](const QList<QByteArray>&) { ++bCount; });
+        QCOMPARE(dispatcher.handlerCount(), 4);
+
+        dispatcher.dispatch(QList<QByteArray>() << "abc" << "payload");
+        dispatcher.dispatch(QList<QByteArray>() << "a" << "payload");
+        dispatcher.dispatch(QList<QByteArray>() << "ba" << "payload");
+        dispatcher.dispatch(QList<QByteArray>() << "c" << "payload");
+
+        QCOMPARE(allCount, 4);
+        QCOMPARE(aCount, 2);
+        QCOMPARE(abCount, 1);
+        QCOMPARE(bCount, 1);
+
+        // Handlers removing themselves take effect after the current message.
+        ZMQTopicDispatcher::HandlerId selfId = 0;
+        int selfCount = 0;
+        selfId = dispatcher.addHandler("ab", [&](const QList<QByteArray>&) { ++selfCount; dispatcher.removeHandler(selfId); });
+        QVERIFY(dispatcher.removeHandler(abId));
+        QVERIFY(dispatcher.removeHandler(allId));
+        QVERIFY(!dispatcher.removeHandler(allId));
+
+        dispatcher.dispatch(QList<QByteArray>() << "abc" << "payload");
+        dispatcher.dispatch(QList<QByteArray>() << "abc" << "payload");
+
+        QCOMPARE(selfCount, 1);
+        QCOMPARE(abCount, 1);
+        QCOMPARE(allCount, 4);
+        QCOMPARE(aCount, 4);
+        QCOMPARE(dispatcher.handlerCount(), 2);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testLastValueCache()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+
+        ZMQSocket* publisher = context->createSocket(ZMQSocket::TYP_PUB, context.data());
+        publisher->bindTo("inproc://lvc-upstream");
+        ZMQSocket* upstream = context->createSocket(ZMQSocket::TYP_XSUB, context.data());
+        upstream->connectTo("inproc://lvc-upstream");
+        ZMQSocket* downstream = context->createSocket(ZMQSocket::TYP_XPUB, context.data());
+        downstream->bindTo("inproc://lvc-downstream");
+
+        ZMQLastValueCache cache(upstream, downstream);
+        QSignalSpy spySnapshotSent(&cache, SIGNAL(snapshotSent(const QByteArray&, int, qint64)));
+
+        context->start();
+        QTest::qWait(200);
+
+        publisher->sendMessage(QList<QByteArray>() << "a" << "1");
+        publisher->sendMessage(QList<QByteArray>() << "a" << "2");
+        publisher->sendMessage(QList<QByteArray>() << "b" << "1");
+        QTest::qWait(200);
+
+        QCOMPARE(cache.cachedTopics(), 2);
+
+        // A late joining subscriber immediately gets the latest value.
+        ZMQSocket* subscriber = context->createSocket(ZMQSocket::TYP_SUB, context.data());
+        QSignalSpy spyMessageReceived(subscriber, SIGNAL(messageReceived(const QList<QByteArray>&)));
+        subscriber->subscribeTo("a");
+        subscriber->connectTo("inproc://lvc-downstream");
+        QTest::qWait(500);
+
+        QCOMPARE(spySnapshotSent.size(), 1);
+        QCOMPARE(spyMessageReceived.size(), 1);
+        QCOMPARE(spyMessageReceived[0][0].value< QList<QByteArray> >(), QList<QByteArray>() << "a" << "2");
+
+        ZMQLastValueCache::Statistics statistics = cache.statistics();
+        QCOMPARE(statistics.subscriptions, quint64(1));
+        QCOMPARE(statistics.hits, quint64(1));
+        QCOMPARE(statistics.replayedMessages, quint64(1));
+
+        // Subscriptions without cached messages get no snapshot.
+        ZMQSocket* lateSubscriber = context->createSocket(ZMQSocket::TYP_SUB, context.data());
+        lateSubscriber->subscribeTo("c");
+        lateSubscriber->connectTo("inproc://lvc-downstream");
+        for (int i = 0; i < 100 && cache.statistics().subscriptions < 2; ++i)
+            QTest::qWait(10);
+        QCOMPARE(cache.statistics().misses, quint64(1));
+        QCOMPARE(spySnapshotSent.size(), 1);
+
+        // Evict least recently used topics when running out of memory.
+        cache.setMaxBytes(4);
+        QCOMPARE(cache.cachedTopics(), 1);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testConflatingQueue()
+{
+    using namespace nzmqt;
+
+    ZMQConflatingQueue queue;
+    queue.setKeyExtractor(ZMQConflatingQueue::keyUntil('.'));
+    QSignalSpy spyMessagesAvailable(&queue, SIGNAL(messagesAvailable()));
+
+    queue.enqueue(QList<QByteArray>() << "EURUSD.bid" << "1");
+    queue.enqueue(QList<QByteArray>() << "USDJPY.bid" << "1");
+    queue.enqueue(QList<QByteArray>() << "EURUSD.ask" << "2");
+    queue.enqueue(QList<QByteArray>() << "EURUSD.bid" << "3");
+
+    QCOMPARE(spyMessagesAvailable.size(), 1);
+    QCOMPARE(queue.size(), 2);
+    QCOMPARE(queue.conflatedCount(), quint64(2));
+
+    QCOMPARE(queue.dequeue(), QList<QByteArray>() << "EURUSD.bid" << "3");
+    queue.enqueue(QList<QByteArray>() << "EURUSD.bid" << "4");
+
+    QList< QList<QByteArray> > messages = queue.dequeueAll();
+    QCOMPARE(messages.size(), 2);
+    QCOMPARE(messages[0], QList<QByteArray>() << "USDJPY.bid" << "1");
+    QCOMPARE(messages[1], QList<QByteArray>() << "EURUSD.bid" << "4");
+    QVERIFY(queue.isEmpty());
+
+    queue.enqueue(QList<QByteArray>() << "USDJPY.bid" << "2");
+    QCOMPARE(spyMessagesAvailable.size(), 2);
+}
+
+void NzmqtTest::testSequencedReceiver()
+{
+    using namespace nzmqt;
+
+    ZMQSequencedReceiver receiver;
+    QSignalSpy spyMessageReceived(&receiver, SIGNAL(messageReceived(const QList<QByteArray>&)));
+    QSignalSpy spyGapDetected(&receiver, SIGNAL(gapDetected(const QByteArray&, quint64, quint64)));
+    QSignalSpy spyDuplicateDetected(&receiver, SIGNAL(duplicateDetected(const QByteArray&, quint64)));
+    QSignalSpy spyPublisherRestarted(&receiver, SIGNAL(publisherRestarted(const QByteArray&, quint64, quint64)));
+
+    // Late join: the first sequence number of a topic is accepted as is.
+    for (quint64 sequence : QList<quint64>() << 5 << 6 << 9 << 9 << 10)
+        receiver.receive(QList<QByteArray>() << "ping" << ZMQSequencedSender::sequenceFrame(1, sequence) << "payload");
+    receiver.receive(QList<QByteArray>() << "pong" << ZMQSequencedSender::sequenceFrame(1, 1) << "payload");
+    receiver.receive(QList<QByteArray>() << "pong" << "garbage");
+
+    QCOMPARE(spyMessageReceived.size(), 5);
+    QCOMPARE(spyMessageReceived[0][0].value< QList<QByteArray> >(), QList<QByteArray>() << "ping" << "payload");
+
+    QCOMPARE(spyGapDetected.size(), 1);
+    QCOMPARE(spyGapDetected[0][0].toByteArray(), QByteArray("ping"));
+    QCOMPARE(spyGapDetected[0][1].value<quint64>(), quint64(7));
+    QCOMPARE(spyGapDetected[0][2].value<quint64>(), quint64(8));
+
+    QCOMPARE(spyDuplicateDetected.size(), 1);
+
+    ZMQSequencedReceiver::Statistics statistics = receiver.statistics();
+    QCOMPARE(statistics.messages, quint64(5));
+    QCOMPARE(statistics.gaps, quint64(1));
+    QCOMPARE(statistics.lostMessages, quint64(2));
+    QCOMPARE(statistics.duplicates, quint64(1));
+    QCOMPARE(statistics.invalid, quint64(1));
+    QCOMPARE(statistics.restarts, quint64(0));
+    QCOMPARE(receiver.lastSequence("ping"), quint64(10));
+
+    // A restarted publisher starts over with a new epoch, which is neither a duplicate
+    // nor a gap.
+    for (quint64 sequence : QList<quint64>() << 1 << 2)
+        receiver.receive(QList<QByteArray>() << "ping" << ZMQSequencedSender::sequenceFrame(2, sequence) << "payload");
+    QCOMPARE(spyMessageReceived.size(), 7);
+    QCOMPARE(spyPublisherRestarted.size(), 1);
+    QCOMPARE(spyPublisherRestarted[0][0].toByteArray(), QByteArray("ping"));
+    QCOMPARE(spyPublisherRestarted[0][1].value<quint64>(), quint64(2));
+    QCOMPARE(spyPublisherRestarted[0][2].value<quint64>(), quint64(1));
+    QCOMPARE(spyDuplicateDetected.size(), 1);
+    QCOMPARE(spyGapDetected.size(), 1);
+    QCOMPARE(receiver.statistics().restarts, quint64(1));
+    QCOMPARE(receiver.lastSequence("ping"), quint64(2));
+
+    // Each sender has an epoch of its own.
+    ZMQSequencedSender first(nullptr);
+    ZMQSequencedSender second(nullptr);
+    QVERIFY(first.epoch() != second.epoch());
+}
+
+void NzmqtTest::testCoalescedReceiver()
+{
+    using namespace nzmqt;
+
+    QByteArray batch;
+    ZMQCoalescingSender::appendMessage(&batch, "first");
+    ZMQCoalescingSender::appendMessage(&batch, "");
+    ZMQCoalescingSender::appendMessage(&batch, "third");
+
+    ZMQCoalescedReceiver receiver;
+    QSignalSpy spyMessageReceived(&receiver, SIGNAL(messageReceived(const QList<QByteArray>&)));
+
+    receiver.receive(QList<QByteArray>() << "topic" << batch);
+    receiver.receive(QList<QByteArray>() << "topic" << batch.left(batch.size() - 1));
+
+    QCOMPARE(spyMessageReceived.size(), 3);
+    QCOMPARE(spyMessageReceived[0][0].value< QList<QByteArray> >(), QList<QByteArray>() << "topic" << "first");
+    QCOMPARE(spyMessageReceived[1][0].value< QList<QByteArray> >(), QList<QByteArray>() << "topic" << "");
+    QCOMPARE(spyMessageReceived[2][0].value< QList<QByteArray> >(), QList<QByteArray>() << "topic" << "third");
+    QCOMPARE(receiver.messagesReceived(), quint64(3));
+    QCOMPARE(receiver.batchesReceived(), quint64(1));
+    QCOMPARE(receiver.invalidBatches(), quint64(1));
+}
+
+void NzmqtTest::testCodec()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        receiver->bindTo("inproc://codec");
+        sender->connectTo("inproc://codec");
+
+        QSharedPointer<ZMQCodec> codec(new ZMQZlibCodec);
+        sender->setCodec(codec, 64, 1);
+        receiver->setCodec(codec, 64, 1);
+
+        const QList<QByteArray> message = QList<QByteArray>() << "topic" << QByteArray(4096, 'x') << "small" << "";
+        QVERIFY(sender->sendMessage(message));
+        QCOMPARE(receiver->receiveMessage(ZMQSocket::ReceiveFlags()), message);
+
+        // The topic is sent as is and the large part is compressed.
+        receiver->setCodec(QSharedPointer<ZMQCodec>());
+        QVERIFY(sender->sendMessage(message));
+        const QList<QByteArray> raw = receiver->receiveMessage(ZMQSocket::ReceiveFlags());
+        QCOMPARE(raw.size(), message.size());
+        QCOMPARE(raw[0], message[0]);
+        QCOMPARE(int(raw[1][0]), int(ZMQZlibCodec::ID));
+        QVERIFY(raw[1].size() < 256);
+        QCOMPARE(raw[2], QByteArray(1, '\0') + message[2]);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testSharedMemoryCodec()
+{
+    using namespace nzmqt;
+    try {
+        QVERIFY(ZMQSharedMemoryCodec::isLocalEndpoint("inproc://shm"));
+        QVERIFY(ZMQSharedMemoryCodec::isLocalEndpoint("ipc:///tmp/shm"));
+        QVERIFY(ZMQSharedMemoryCodec::isLocalEndpoint("tcp://127.0.0.1:5555"));
+        QVERIFY(ZMQSharedMemoryCodec::isLocalEndpoint("tcp://[::1]:5555"));
+        QVERIFY(!ZMQSharedMemoryCodec::isLocalEndpoint("tcp://192.168.1.10:5555"));
+
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        receiver->bindTo("inproc://shm");
+        sender->connectTo("inproc://shm");
+
+        QSharedPointer<ZMQSharedMemoryCodec> codec(new ZMQSharedMemoryCodec);
+        sender->setCodec(codec, 1024);
+        receiver->setCodec(codec, 1024);
+
+        QByteArray payload(1024 * 1024, Qt::Uninitialized);
+        for (int i = 0; i < payload.size(); ++i)
+            payload[i] = char(i % 251);
+        const QList<QByteArray> message = QList<QByteArray>() << "small" << payload;
+        QVERIFY(sender->sendMessage(message));
+        QCOMPARE(codec->leasedSegments(), 1);
+        QCOMPARE(receiver->receiveMessage(ZMQSocket::ReceiveFlags()), message);
+        // The receiver has picked up the payload, so the segment can go.
+        codec->releaseSegments();
+        QCOMPARE(codec->leasedSegments(), 0);
+
+        // Zero-copy access to the segment from the raw frame.
+        receiver->setCodec(QSharedPointer<ZMQCodec>());
+        QVERIFY(sender->sendMessage(message));
+        const QList<QByteArray> raw = receiver->receiveMessage(ZMQSocket::ReceiveFlags());
+        QCOMPARE(raw.size(), 2);
+        QVERIFY(raw[1].size() < 256);
+        const char* data = nullptr;
+        int size = 0;
+        QSharedPointer<QSharedMemory> segment = ZMQSharedMemoryCodec::attach(raw[1], &data, &size);
+        QVERIFY(!segment.isNull());
+        QCOMPARE(QByteArray::fromRawData(data, size), payload);
+        codec->releaseSegments();
+        QCOMPARE(codec->leasedSegments(), 1);
+        segment.clear();
+        codec->releaseSegments();
+        QCOMPARE(codec->leasedSegments(), 0);
+
+        // A descriptor referring to no segment is delivered as empty frame, along with the
+        // other frames of its message.
+        receiver->setCodec(codec, 1024);
+        sender->setCodec(QSharedPointer<ZMQCodec>());
+        QVERIFY(sender->sendMessage(QList<QByteArray>() << QByteArray(1, '\0') + "missing"
+                                    << QByteArray(1, char(ZMQSharedMemoryCodec::ID)) + QByteArray(16, '\0') + "nzmqt-missing"));
+        QCOMPARE(receiver->receiveMessage(ZMQSocket::ReceiveFlags()), QList<QByteArray>() << "missing" << QByteArray());
+
+        // Once the sender has an endpoint other hosts may connect to, frames are sent inline.
+        sender->setCodec(codec, 1024);
+        sender->bindTo("tcp://*:*");
+        QVERIFY(sender->sendMessage(message));
+        QCOMPARE(codec->leasedSegments(), 0);
+        QCOMPARE(receiver->receiveMessage(ZMQSocket::ReceiveFlags()), message);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testFileTransfer()
+{
+    using namespace nzmqt;
+    const QString sourceName = QDir(QDir::tempPath()).filePath("nzmqt_test_source.bin");
+    const QString targetName = QDir(QDir::tempPath()).filePath("nzmqt_test_target.bin");
+    try {
+        QByteArray content(3 * 65536 + 1000, Qt::Uninitialized);
+        for (int i = 0; i < content.size(); ++i)
+            content[i] = char(i % 253);
+        {
+            QFile source(sourceName);
+            QVERIFY(source.open(QIODevice::WriteOnly | QIODevice::Truncate));
+            QCOMPARE(source.write(content), qint64(content.size()));
+        }
+
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        sender->setOption(ZMQSocket::OPT_SNDHWM, 2);
+        receiver->bindTo("inproc://file");
+        sender->connectTo("inproc://file");
+
+        ZMQFileSender fileSender(sender);
+        fileSender.setChunkSize(65536);
+        ZMQFileReceiver fileReceiver(targetName, receiver);
+        QSignalSpy spyFileSent(&fileSender, SIGNAL(fileSent(const QString&)));
+        QSignalSpy spyFileReceived(&fileReceiver, SIGNAL(fileReceived(const QString&)));
+        QSignalSpy spyTransferFailed(&fileReceiver, SIGNAL(transferFailed(const QString&, const QString&)));
+
+        context->start();
+        QVERIFY(fileSender.sendFile(sourceName));
+        QVERIFY(!fileSender.sendFile(sourceName));
+
+        for (int i = 0; i < 100 && !fileReceiver.isComplete(); ++i)
+            QTest::qWait(50);
+
+        QCOMPARE(spyFileSent.size(), 1);
+        QCOMPARE(spyFileReceived.size(), 1);
+        QCOMPARE(spyTransferFailed.size(), 0);
+        QVERIFY(!fileSender.isSending());
+        QCOMPARE(fileReceiver.bytesReceived(), qint64(content.size()));
+
+        QFile target(targetName);
+        QVERIFY(target.open(QIODevice::ReadOnly));
+        QCOMPARE(target.readAll(), content);
+        target.close();
+
+        // A missing chunk aborts the transfer.
+        uchar header[2 * sizeof(quint64)];
+        qToBigEndian<quint64>(quint64(2 * 65536), header);
+        qToBigEndian<quint64>(quint64(content.size()), header + sizeof(quint64));
+        fileReceiver.receive(QList<QByteArray>() << QByteArray(reinterpret_cast<const char*>(header), sizeof(header)) << content.left(65536));
+        qToBigEndian<quint64>(0, header);
+        fileReceiver.receive(QList<QByteArray>() << QByteArray(reinterpret_cast<const char*>(header), sizeof(header)) << content.left(65536));
+        qToBigEndian<quint64>(quint64(2 * 65536), header);
+        fileReceiver.receive(QList<QByteArray>() << QByteArray(reinterpret_cast<const char*>(header), sizeof(header)) << content.mid(2 * 65536, 65536));
+        QCOMPARE(spyTransferFailed.size(), 1);
+        QVERIFY(!fileReceiver.isComplete());
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+    QFile::remove(sourceName);
+    QFile::remove(targetName);
+}
+
+void NzmqtTest::testRecordReplay()
+{
+    using namespace nzmqt;
+    const QString baseName = QDir(QDir::tempPath()).filePath("nzmqt_test_log");
+    try {
+        QList< QList<QByteArray> > messages;
+        for (int i = 0; i < 10; ++i)
+            messages << (QList<QByteArray>() << "topic" << QByteArray(40, char('a' + i)));
+
+        // Small segments and a dense index force segment changes and indexed seeks.
+        ZMQRecorder recorder(baseName);
+        recorder.setSegmentSize(256);
+        recorder.setIndexInterval(0);
+        QCOMPARE(recorder.indexInterval(), 1);
+        recorder.setIndexInterval(2);
+        QVERIFY(!recorder.record(messages[0]));
+        QVERIFY(recorder.open());
+        for (const QList<QByteArray>& message : messages)
+            QVERIFY(recorder.record(message));
+        QVERIFY(!recorder.record(QList<QByteArray>() << QByteArray(512, 'x')));
+        recorder.close();
+        QCOMPARE(recorder.recordedMessages(), quint64(messages.size()));
+        QVERIFY(QFile::exists(ZMQRecorder::segmentFileName(baseName, 1)));
+        // A segment prepared in advance but never used is removed.
+        int segments = 0;
+        while (QFile::exists(ZMQRecorder::segmentFileName(baseName, segments)))
+            ++segments;
+        QVERIFY(QFile(ZMQRecorder::segmentFileName(baseName, segments - 1)).size() > 0);
+
+        ZMQReplayer reader(baseName);
+        QVERIFY(reader.open());
+        QList<QByteArray> message;
+        QVector<qint64> timestamps;
+        qint64 timestamp;
+        while (reader.readMessage(&message, &timestamp))
+        {
+            QCOMPARE(message, messages[timestamps.size()]);
+            QVERIFY(timestamps.isEmpty() || timestamp >= timestamps.last());
+            timestamps << timestamp;
+        }
+        QCOMPARE(timestamps.size(), messages.size());
+
+        QVERIFY(reader.seek(timestamps[7]));
+        QVERIFY(reader.readMessage(&message, &timestamp));
+        QCOMPARE(timestamp, timestamps[7]);
+        QVERIFY(!reader.seek(timestamps.last() + 1));
+
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        receiver->bindTo("inproc://replay");
+        sender->connectTo("inproc://replay");
+
+        ZMQReplayer replayer(baseName, sender);
+        replayer.setSpeed(0);
+        QSignalSpy spyFinished(&replayer, SIGNAL(finished()));
+        QVERIFY(replayer.open());
+        replayer.start();
+        for (int i = 0; i < 100 && spyFinished.isEmpty(); ++i)
+            QTest::qWait(10);
+        QCOMPARE(spyFinished.size(), 1);
+        QCOMPARE(replayer.replayedMessages(), quint64(messages.size()));
+
+        for (const QList<QByteArray>& expected : messages)
+            QCOMPARE(receiver->receiveMessage(ZMQSocket::ReceiveFlags()), expected);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+    for (int i = 0; QFile::exists(ZMQRecorder::segmentFileName(baseName, i)); ++i)
+        QFile::remove(ZMQRecorder::segmentFileName(baseName, i));
+    QFile::remove(ZMQRecorder::indexFileName(baseName));
+}
+
+void NzmqtTest::testSpool()
+{
+    using namespace nzmqt;
+    const QString baseName = QDir(QDir::tempPath()).filePath("nzmqt_test_spool");
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        pusher->bindTo("inproc://spool");
+
+        QList< QList<QByteArray> > messages;
+        for (int i = 0; i < 10; ++i)
+            messages << (QList<QByteArray>() << "job" << QByteArray(40, char('a' + i)));
+
+        // Without a peer all messages are spooled.
+        {
+            ZMQSpool spool(pusher, baseName);
+            spool.setSegmentSize(256);
+            QVERIFY(spool.open());
+            for (const QList<QByteArray>& message : messages)
+                QVERIFY(spool.sendMessage(message));
+            QCOMPARE(spool.spooledMessages(), quint64(messages.size()));
+            QVERIFY(QFile::exists(ZMQSpool::segmentFileName(baseName, 1)));
+
+            spool.setMaxBytes(spool.spooledBytes());
+            QVERIFY(!spool.sendMessage(messages[0]));
+            QCOMPARE(spool.droppedMessages(), quint64(1));
+        }
+
+        // Spooled messages survive reopening and are drained in order.
+        ZMQSpool spool(pusher, baseName);
+        spool.setSegmentSize(256);
+        QSignalSpy spyDrained(&spool, SIGNAL(drained()));
+        QVERIFY(spool.open());
+        QCOMPARE(spool.spooledMessages(), quint64(messages.size()));
+
+        ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        puller->connectTo("inproc://spool");
+        for (int i = 0; i < 100 && !spool.isEmpty(); ++i)
+            QTest::qWait(10);
+        QVERIFY(spool.isEmpty());
+        QCOMPARE(spyDrained.size(), 1);
+        QVERIFY(!QFile::exists(ZMQSpool::segmentFileName(baseName, 0)));
+
+        for (const QList<QByteArray>& expected : messages)
+            QCOMPARE(puller->receiveMessage(ZMQSocket::ReceiveFlags()), expected);
+
+        // A healthy peer is served directly.
+        QVERIFY(spool.sendMessage(messages[0]));
+        QVERIFY(spool.isEmpty());
+        QCOMPARE(puller->receiveMessage(ZMQSocket::ReceiveFlags()), messages[0]);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+    for (int i = 0; QFile::exists(ZMQSpool::segmentFileName(baseName, i)); ++i)
+        QFile::remove(ZMQSpool::segmentFileName(baseName, i));
+}
+
+void NzmqtTest::testMetrics()
+{
+#ifndef NZMQT_METRICS
+    QSKIP("nzmqt is built without NZMQT_METRICS");
+#else
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        receiver->bindTo("inproc://metrics");
+        sender->connectTo("inproc://metrics");
+
+        QVERIFY(sender->sendMessage(QList<QByteArray>() << "a" << "bc" << "def"));
+        QVERIFY(sender->sendMessage(QByteArray("ghij")));
+        QCOMPARE(receiver->receiveMessages(ZMQSocket::ReceiveFlags()).size(), 2);
+
+        const ZMQMetrics sent = sender->metrics();
+        QCOMPARE(sent.messagesSent, quint64(2));
+        QCOMPARE(sent.framesSent, quint64(4));
+        QCOMPARE(sent.bytesSent, quint64(10));
+        QCOMPARE(sent.framesPerMessageSent(), 2.0);
+        QCOMPARE(sent.sendFailures, quint64(0));
+
+        const ZMQMetrics received = receiver->metrics();
+        QCOMPARE(received.messagesReceived, quint64(2));
+        QCOMPARE(received.framesReceived, quint64(4));
+        QCOMPARE(received.bytesReceived, quint64(10));
+
+        // Handler time is measured when messages are dispatched by the context.
+        QSignalSpy spyMessageReceived(receiver, SIGNAL(messageReceived(const QList<QByteArray>&)));
+        context->start();
+        QVERIFY(sender->sendMessage(QByteArray("k")));
+        for (int i = 0; i < 100 && spyMessageReceived.isEmpty(); ++i)
+            QTest::qWait(10);
+        context->stop();
+        QCOMPARE(receiver->metrics().handlerCalls, quint64(1));
+
+        // Closed sockets still count for the context.
+        ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        pusher->bindTo("inproc://metrics-nopeer");
+        QVERIFY(!pusher->sendMessage(QByteArray("lost")));
+        QCOMPARE(pusher->metrics().sendFailures, quint64(1));
+        delete pusher;
+
+        const ZMQMetrics total = context->metrics();
+        QCOMPARE(total.messagesSent, quint64(3));
+        QCOMPARE(total.messagesReceived, quint64(3));
+        QCOMPARE(total.sendFailures, quint64(1));
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+#endif
+}
+
+void NzmqtTest::testLatencyHistogram()
+{
+    using namespace nzmqt;
+    try {
+        ZMQLatencyHistogram histogram;
+        QCOMPARE(histogram.valueAtPercentile(50), qint64(0));
+        for (qint64 value = 1; value <= 1000; ++value)
+            histogram.record(value * 1000);
+        QCOMPARE(histogram.count(), quint64(1000));
+        QCOMPARE(histogram.min(), qint64(1000));
+        QCOMPARE(histogram.max(), qint64(1000000));
+        QCOMPARE(histogram.mean(), 500500.0);
+
+        // Values are kept with a relative error below 2^-(precisionBits-1).
+        const double precision = 1.0 / (1 << (histogram.precisionBits() - 1));
+        QVERIFY(qAbs(histogram.valueAtPercentile(50) - 500000) <= 500000 * precision);
+        QVERIFY(qAbs(histogram.valueAtPercentile(99) - 990000) <= 990000 * precision);
+        QVERIFY(qAbs(histogram.valueAtPercentile(99.9) - 999000) <= 999000 * precision);
+        QCOMPARE(histogram.valueAtPercentile(100), qint64(1000000));
+
+        ZMQLatencyHistogram other;
+        other.record(5);
+        other.record(2000000);
+        histogram.merge(other);
+        QCOMPARE(histogram.count(), quint64(1002));
+        QCOMPARE(histogram.min(), qint64(5));
+        QCOMPARE(histogram.max(), qint64(2000000));
+
+        const QByteArray text = histogram.toPrometheus("rtt_seconds", "service=\"echo\"");
+        QVERIFY(text.contains("# TYPE rtt_seconds summary\n"));
+        QVERIFY(text.contains("rtt_seconds{service=\"echo\",quantile=\"0.99\"} "));
+        QVERIFY(text.contains("rtt_seconds_count{service=\"echo\"} 1002\n"));
+
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* requester = context->createSocket(ZMQSocket::TYP_REQ, context.data());
+        ZMQSocket* replier = context->createSocket(ZMQSocket::TYP_REP, context.data());
+        replier->bindTo("inproc://latency");
+        requester->connectTo("inproc://latency");
+
+        ZMQLatencyTracker tracker(requester);
+        QSignalSpy spyReplyReceived(&tracker, SIGNAL(replyReceived(const QList<QByteArray>&, qint64)));
+        connect(replier, &ZMQSocket::messageReceived, replier, [replier](const QList<QByteArray>& request) {
+            replier->sendMessage(request);
+        });
+
+        context->start();
+        for (int i = 0; i < 3; ++i)
+        {
+            QVERIFY(tracker.sendRequest(QList<QByteArray>() << QByteArray::number(i)));
+            QCOMPARE(tracker.pendingRequests(), 1);
+            for (int j = 0; j < 100 && spyReplyReceived.size() <= i; ++j)
+                QTest::qWait(10);
+        }
+        QCOMPARE(spyReplyReceived.size(), 3);
+        QCOMPARE(tracker.pendingRequests(), 0);
+        QCOMPARE(tracker.histogram().count(), quint64(3));
+        QVERIFY(tracker.histogram().min() > 0);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testSocketMonitor()
+{
+#if defined(Q_OS_WIN)
+    QSKIP("The ipc transport is not supported on Windows");
+#endif
+    using namespace nzmqt;
+    // 0MQ does not report connection events for inproc.
+    const QString address = "ipc://" + QDir(QDir::tempPath()).filePath("nzmqt-test-monitor.ipc");
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        QSignalSpy spyAccepted(puller, SIGNAL(accepted(const QString&)));
+        QSignalSpy spyDisconnected(puller, SIGNAL(disconnected(const QString&)));
+        QSignalSpy spyConnected(pusher, SIGNAL(connected(const QString&)));
+        QSignalSpy spyMonitorEvent(pusher, SIGNAL(monitorEvent(int, int, const QString&)));
+
+        puller->startMonitor();
+        pusher->startMonitor();
+        QVERIFY(puller->isMonitored());
+
+        context->start();
+        puller->bindTo(address);
+        pusher->connectTo(address);
+
+        for (int i = 0; i < 100 && (spyAccepted.isEmpty() || spyConnected.isEmpty()); ++i)
+            QTest::qWait(10);
+        QCOMPARE(spyAccepted.size(), 1);
+        QCOMPARE(spyConnected.size(), 1);
+        QCOMPARE(spyConnected.first().at(0).toString(), address);
+        QVERIFY(!spyMonitorEvent.isEmpty());
+
+        pusher->close();
+        for (int i = 0; i < 100 && spyDisconnected.isEmpty(); ++i)
+            QTest::qWait(10);
+        QCOMPARE(spyDisconnected.size(), 1);
+
+        puller->stopMonitor();
+        QVERIFY(!puller->isMonitored());
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testDispatchStall()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        puller->bindTo("inproc://dispatchstall");
+        pusher->connectTo("inproc://dispatchstall");
+
+        QSignalSpy spyStall(context.data(), SIGNAL(dispatchStall(nzmqt::ZMQSocket*, qint64)));
+        int received = 0;
+        QObject::connect(puller, &ZMQSocket::messageReceived, puller, [&received](const QList<QByteArray>& message) {
+            ++received;
+            if (message.first() == "slow")
+                QThread::msleep(50);
+        });
+
+        QCOMPARE(context->stallThreshold(), qint64(0));
+        context->setStallThreshold(20 * 1000 * 1000);
+        context->start();
+
+        pusher->sendMessage("fast");
+        pusher->sendMessage("slow");
+        pusher->sendMessage("fast");
+        for (int i = 0; i < 100 && received < 3; ++i)
+            QTest::qWait(10);
+        QCOMPARE(received, 3);
+
+        QCOMPARE(spyStall.size(), 1);
+        QCOMPARE(spyStall.first().at(0).value<ZMQSocket*>(), puller);
+        QVERIFY(spyStall.first().at(1).toLongLong() >= 50 * 1000 * 1000);
+
+        ZMQDispatchStatistics statistics = puller->dispatchStatistics();
+        QCOMPARE(statistics.dispatches, quint64(3));
+        QCOMPARE(statistics.stalls, quint64(1));
+        QVERIFY(statistics.maxNsecs >= 50 * 1000 * 1000);
+        QVERIFY(statistics.totalNsecs >= statistics.maxNsecs);
+
+        // Disabled instrumentation leaves the statistics alone.
+        context->setStallThreshold(0);
+        puller->resetDispatchStatistics();
+        pusher->sendMessage("slow");
+        for (int i = 0; i < 100 && received < 4; ++i)
+            QTest::qWait(10);
+        QCOMPARE(received, 4);
+        QCOMPARE(spyStall.size(), 1);
+        QCOMPARE(puller->dispatchStatistics().dispatches, quint64(0));
+
+        // A socket deleted by its slot is not accounted for, even if the slot stalls.
+        context->setStallThreshold(20 * 1000 * 1000);
+        ZMQSocket* oneShot = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        oneShot->bindTo("inproc://dispatchstall-oneshot");
+        pusher->connectTo("inproc://dispatchstall-oneshot");
+        bool deleted = false;
+        QObject::connect(oneShot, &ZMQSocket::messageReceived, oneShot, [&deleted, oneShot](const QList<QByteArray>&) {
+            QThread::msleep(50);
+            deleted = true;
+            delete oneShot;
+        });
+        pusher->disconnectFrom("inproc://dispatchstall");
+        pusher->sendMessage("last");
+        for (int i = 0; i < 100 && !deleted; ++i)
+            QTest::qWait(10);
+        QVERIFY(deleted);
+        QCOMPARE(spyStall.size(), 1);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testTrace()
+{
+#ifndef NZMQT_TRACE
+    QSKIP("nzmqt is built without NZMQT_TRACE");
+#else
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* sender = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        ZMQSocket* receiver = context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+        receiver->bindTo("inproc://trace");
+        sender->connectTo("inproc://trace");
+
+        QSignalSpy spyMessageReceived(receiver, SIGNAL(messageReceived(const QList<QByteArray>&)));
+        context->start();
+
+        ZMQTrace::clear();
+        QVERIFY(ZMQTrace::threadEvents().isEmpty());
+
+        sender->sendMessage("traced");
+        for (int i = 0; i < 100 && spyMessageReceived.isEmpty(); ++i)
+            QTest::qWait(10);
+        QCOMPARE(spyMessageReceived.size(), 1);
+
+        // All of it happens within the test's thread.
+        QStringList names;
+        qint64 previousNsecs = 0;
+        for (const ZMQTrace::Event& event : ZMQTrace::threadEvents())
+        {
+            QVERIFY(event.nsecs >= previousNsecs);
+            previousNsecs = event.nsecs;
+            names << QString("%1:%2").arg(event.name).arg(event.phase);
+        }
+        QVERIFY(names.contains("send:i"));
+        QVERIFY(names.contains("dequeue:i"));
+        QVERIFY(names.indexOf("dispatch:B") < names.indexOf("dispatch:E"));
+        QVERIFY(names.indexOf("send:i") < names.indexOf("dispatch:B"));
+
+        const QString fileName = QDir(QDir::tempPath()).filePath("nzmqt-test.trace.json");
+        QVERIFY(ZMQTrace::writeChromeTrace(fileName));
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray json = file.readAll();
+        QVERIFY(json.startsWith("{\"traceEvents\":["));
+        QVERIFY(json.contains("\"name\":\"dispatch\",\"ph\":\"B\""));
+        file.remove();
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+#endif
+}
+
+void NzmqtTest::testSocketChurn()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+
+        QList<ZMQSocket*> senders;
+        QList<ZMQSocket*> receivers;
+        for (int i = 0; i < 20; ++i)
+        {
+            const QString address = QString("inproc://churn-%1").arg(i);
+            receivers += context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+            receivers.last()->bindTo(address);
+            senders += context->createSocket(ZMQSocket::TYP_PAIR, context.data());
+            senders.last()->connectTo(address);
+        }
+
+        // Closing sockets in any order must leave the remaining ones serviced.
+        for (int i = 19; i >= 0; --i)
+        {
+            if (0 == i % 3 || 19 == i)
+            {
+                delete receivers.takeAt(i);
+                delete senders.takeAt(i);
+            }
+        }
+
+        int received = 0;
+        for (ZMQSocket* receiver : receivers)
+            QObject::connect(receiver, &ZMQSocket::messageReceived, receiver, [&received](const QList<QByteArray>&) { ++received; });
+
+        context->start();
+        for (ZMQSocket* sender : senders)
+            QVERIFY(sender->sendMessage("ping"));
+
+        for (int i = 0; i < 100 && received < receivers.size(); ++i)
+            QTest::qWait(10);
+        QCOMPARE(received, receivers.size());
+
+        // Slots may close and create sockets while poll() walks the poll items.
+        PollingZMQContext pollingContext;
+        QList<ZMQSocket*> slotReceivers;
+        QList<ZMQSocket*> slotSenders;
+        for (int i = 0; i < 8; ++i)
+        {
+            const QString address = QString("inproc://churn-slot-%1").arg(i);
+            slotReceivers += pollingContext.createSocket(ZMQSocket::TYP_PAIR, &pollingContext);
+            slotReceivers.last()->bindTo(address);
+            slotSenders += pollingContext.createSocket(ZMQSocket::TYP_PAIR, &pollingContext);
+            slotSenders.last()->connectTo(address);
+        }
+
+        int delivered = 0;
+        QList<ZMQSocket*> created;
+        for (ZMQSocket* receiver : slotReceivers)
+        {
+            QObject::connect(receiver, &ZMQSocket::messageReceived, receiver, [&](const QList<QByteArray>&) {
+                ++delivered;
+                if (1 == delivered)
+                {
+                    // Closes a socket with a pending message not dispatched yet, whose
+                    // poll item is replaced by the last one, and appends new ones.
+                    delete slotReceivers.takeLast();
+                    for (int i = 0; i < 2; ++i)
+                        created += pollingContext.createSocket(ZMQSocket::TYP_PAIR, &pollingContext);
+                }
+                else if (2 == delivered)
+                {
+                    // Closes the socket dispatched before.
+                    delete slotReceivers.takeFirst();
+                }
+            });
+        }
+
+        for (ZMQSocket* sender : slotSenders)
+            QVERIFY(sender->sendMessage("ping"));
+        pollingContext.poll();
+        QCOMPARE(delivered, 7);
+        QCOMPARE(slotReceivers.size(), 6);
+
+        // The sockets created from within the slot are serviced.
+        int createdReceived = 0;
+        QObject::connect(created[0], &ZMQSocket::messageReceived, created[0], [&createdReceived](const QList<QByteArray>&) { ++createdReceived; });
+        created[0]->bindTo("inproc://churn-slot-created");
+        created[1]->connectTo("inproc://churn-slot-created");
+        QVERIFY(created[1]->sendMessage("pong"));
+        pollingContext.poll();
+        QCOMPARE(createdReceived, 1);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testTraceFrame()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* source = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        ZMQSocket* stageIn = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        ZMQSocket* stageOut = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        ZMQSocket* sink = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        for (ZMQSocket* socket : QList<ZMQSocket*>() << source << stageIn << stageOut << sink)
+            socket->setTraceFrameEnabled(true);
+        stageIn->bindTo("inproc://traceframe-stage");
+        source->connectTo("inproc://traceframe-stage");
+        sink->bindTo("inproc://traceframe-sink");
+        stageOut->connectTo("inproc://traceframe-sink");
+
+        // The stage forwards messages from within its slot, so the trace is continued.
+        QList<QByteArray> stageMessage;
+        QObject::connect(stageIn, &ZMQSocket::messageReceived, [&](const QList<QByteArray>& message) {
+            stageMessage = message;
+            QVERIFY(ZMQTraceFrame::current().isValid());
+            stageOut->sendMessage(message);
+        });
+        QSignalSpy spySinkReceived(sink, SIGNAL(messageReceived(const QList<QByteArray>&)));
+        context->start();
+
+        QVERIFY(!ZMQTraceFrame::current().isValid());
+        QVERIFY(source->sendMessage(QList<QByteArray>() << "work" << "item"));
+        for (int i = 0; i < 100 && spySinkReceived.isEmpty(); ++i)
+            QTest::qWait(10);
+        QCOMPARE(spySinkReceived.size(), 1);
+
+        // Slots never see the trace frame.
+        QCOMPARE(stageMessage, QList<QByteArray>() << "work" << "item");
+        QCOMPARE(spySinkReceived.first().at(0).value< QList<QByteArray> >(), QList<QByteArray>() << "work" << "item");
+
+        const ZMQTraceFrame stageFrame = stageIn->receivedTraceFrame();
+        const ZMQTraceFrame sinkFrame = sink->receivedTraceFrame();
+        QVERIFY(sinkFrame.isValid());
+        QCOMPARE(sinkFrame.traceId(), stageFrame.traceId());
+
+        const QVector<ZMQTraceFrame::Stamp> stamps = sinkFrame.stamps();
+        QCOMPARE(stamps.size(), 4);
+        QCOMPARE(stamps[0].kind, ZMQTraceFrame::STAMP_SENT);
+        QCOMPARE(stamps[1].kind, ZMQTraceFrame::STAMP_RECEIVED);
+        QCOMPARE(stamps[2].kind, ZMQTraceFrame::STAMP_SENT);
+        QCOMPARE(stamps[3].kind, ZMQTraceFrame::STAMP_RECEIVED);
+        QCOMPARE(sinkFrame.hopLatencies().size(), 3);
+        QVERIFY(sinkFrame.totalLatency() >= 0);
+
+        const ZMQTraceFrame decoded = ZMQTraceFrame::fromByteArray(sinkFrame.toByteArray());
+        QCOMPARE(decoded.traceId(), sinkFrame.traceId());
+        QCOMPARE(decoded.stamps().size(), 4);
+        QVERIFY(!ZMQTraceFrame::isTraceFrame("item"));
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testSocketProfiles()
+{
+    using namespace nzmqt;
+    try {
+        auto intOption = [](ZMQSocket* socket, ZMQSocket::Option option) {
+            int value = 0;
+            size_t size = sizeof(value);
+            socket->getOption(option, &value, &size);
+            return value;
+        };
+
+        // Later profiles override earlier ones.
+        ZMQSocketProfile composed = ZMQSocketProfile::manyIdlePeers()
+                + ZMQSocketProfile().setValue(ZMQSocket::OPT_SNDHWM, 42);
+        QCOMPARE(composed.name(), QString("many-idle-peers"));
+        QCOMPARE(composed.value(ZMQSocket::OPT_SNDHWM), qint64(42));
+        QCOMPARE(composed.value(ZMQSocket::OPT_BACKLOG), qint64(1024));
+        QVERIFY(ZMQSocketProfile::preset("no-such-preset").isEmpty());
+
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        context->setSocketProfile(ZMQSocketProfile::lowLatency());
+        context->setEndpointProfile("inproc://profiles-bulk", ZMQSocketProfile::bulkThroughput());
+
+        ZMQSocket* plain = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        QCOMPARE(intOption(plain, ZMQSocket::OPT_SNDHWM), 100);
+        QCOMPARE(intOption(plain, ZMQSocket::OPT_LINGER), 0);
+
+        // The endpoint profile is applied on top right before binding.
+        ZMQSocket* bulk = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        bulk->bindTo("inproc://profiles-bulk-1");
+        QCOMPARE(intOption(bulk, ZMQSocket::OPT_RCVHWM), 100000);
+        QCOMPARE(intOption(bulk, ZMQSocket::OPT_LINGER), 0);
+
+        const QString fileName = QDir(QDir::tempPath()).filePath("nzmqt-test-profiles.ini");
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write("[default]\n"
+                   "base = quiet\n"
+                   "linger = 250\n"
+                   "\n"
+                   "[quiet]\n"
+                   "base = many-idle-peers\n"
+                   "sndhwm = 7\n"
+                   "endpoints = \"inproc://profiles-quiet\"\n");
+        file.close();
+
+        QScopedPointer<ZMQContext> loadedContext(nzmqt::createDefaultContext());
+        QVERIFY(loadedContext->loadSocketProfiles(fileName));
+        QCOMPARE(loadedContext->socketProfile().value(ZMQSocket::OPT_SNDHWM), qint64(7));
+        QCOMPARE(loadedContext->socketProfile().value(ZMQSocket::OPT_LINGER), qint64(250));
+        QCOMPARE(loadedContext->socketProfile().value(ZMQSocket::OPT_BACKLOG), qint64(1024));
+        QCOMPARE(loadedContext->endpointProfile("inproc://profiles-quiet-1").name(), QString("quiet"));
+        QVERIFY(loadedContext->endpointProfile("inproc://other").isEmpty());
+
+        ZMQSocket* loaded = loadedContext->createSocket(ZMQSocket::TYP_PUSH, loadedContext.data());
+        QCOMPARE(intOption(loaded, ZMQSocket::OPT_SNDHWM), 7);
+        QCOMPARE(intOption(loaded, ZMQSocket::OPT_LINGER), 250);
+
+        // Unknown keys reject the whole file.
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write("[broken]\nsndhwm = 1\nno_such_option = 1\n");
+        file.close();
+        QVERIFY(!loadedContext->loadSocketProfiles(fileName));
+        QCOMPARE(loadedContext->socketProfile().value(ZMQSocket::OPT_SNDHWM), qint64(7));
+        QFile::remove(fileName);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testContextOptions()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext(nullptr, 2));
+        QCOMPARE(context->ioThreads(), 2);
+        context->setOption(ZMQContext::OPT_MAX_SOCKETS, 8);
+        QCOMPARE(context->option(ZMQContext::OPT_MAX_SOCKETS), 8);
+        QVERIFY(context->socketLimit() == -1 || context->socketLimit() >= 8);
+
+        // A socket keeps the I/O threads it is restricted to, as affinity bit mask.
+        ZMQSocket* socket = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        QCOMPARE(socket->ioThreads(), QList<int>());
+        socket->setIoThreads(QList<int>() << 1);
+        QCOMPARE(socket->ioThreads(), QList<int>() << 1);
+        socket->bindTo("inproc://context-options");
+
+        // Indexes beyond the 64 bits of the mask are refused.
+        bool invalid = false;
+        try {
+            socket->setIoThreads(QList<int>() << 64);
+        }
+        catch (const ZMQException& ex)
+        {
+            invalid = (EINVAL == ex.num());
+        }
+        QVERIFY(invalid);
+        QCOMPARE(socket->ioThreads(), QList<int>() << 1);
+
+        // The limit of sockets is enforced by 0MQ.
+        bool refused = false;
+        try {
+            for (int i = 0; i < 8; ++i)
+                context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        }
+        catch (const ZMQException&)
+        {
+            refused = true;
+        }
+        QVERIFY(refused);
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testBusyPolling()
+{
+#if defined(Q_OS_WIN)
+    QSKIP("The ipc transport is not supported on Windows");
+#endif
+    using namespace nzmqt;
+    // The peers belong to different contexts, which rules out inproc.
+    const QString address = "ipc://" + QDir(QDir::tempPath()).filePath("nzmqt-test-busy-polling.ipc");
+    try {
+        QScopedPointer<BusyPollingZMQContext> context(new BusyPollingZMQContext());
+        context->setSpinBudget(100000);
+        ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        puller->bindTo(address);
+
+        // The pusher belongs to another context, since the polling thread uses all sockets
+        // of its context.
+        QScopedPointer<ZMQContext> senderContext(nzmqt::createDefaultContext());
+        ZMQSocket* pusher = senderContext->createSocket(ZMQSocket::TYP_PUSH, senderContext.data());
+        pusher->connectTo(address);
+
+        // The handler is called from within the polling thread, so results are checked
+        // once it has been stopped.
+        QAtomicInt handled;
+        QThread* handlerThread = nullptr;
+        ZMQSocket* handlerSocket = nullptr;
+        QList<QByteArray> handlerMessage;
+        context->setMessageHandler([&](ZMQSocket* socket, const QList<QByteArray>& message) {
+            handlerSocket = socket;
+            handlerMessage = message;
+            handlerThread = QThread::currentThread();
+            handled.fetchAndAddOrdered(1);
+        });
+        context->start();
+        QVERIFY(!context->isStopped());
+
+        for (int i = 0; i < 10; ++i)
+            QVERIFY(pusher->sendMessage(QList<QByteArray>() << "busy" << "poll"));
+        for (int i = 0; i < 100 && handled.load() < 10; ++i)
+            QTest::qWait(10);
+        context->stop();
+        QVERIFY(context->isStopped());
+        QCOMPARE(handled.load(), 10);
+        QVERIFY(handlerSocket == puller);
+        QCOMPARE(handlerMessage, QList<QByteArray>() << "busy" << "poll");
+        QVERIFY(handlerThread && handlerThread != QThread::currentThread());
+
+        // Without a handler the signal is emitted.
+        context->setMessageHandler(BusyPollingZMQContext::MessageHandler());
+        QAtomicInt emitted;
+        QObject::connect(puller, &ZMQSocket::messageReceived, puller, [&](const QList<QByteArray>&) {
+            emitted.fetchAndAddOrdered(1);
+        }, Qt::DirectConnection);
+        QVERIFY(pusher->sendMessage("signal"));
+        context->start();
+        for (int i = 0; i < 100 && emitted.load() < 1; ++i)
+            QTest::qWait(10);
+        QCOMPARE(emitted.load(), 1);
+
+        // Creating and closing sockets wakes the blocking polling thread up instead of
+        // waiting up to NZMQT_BUSYPOLLINGZMQCONTEXT_BLOCKTIMEOUT each time.
+        context->setSpinBudget(0);
+        QElapsedTimer churnTimer;
+        churnTimer.start();
+        for (int i = 0; i < 100; ++i)
+            delete context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        QVERIFY2(churnTimer.elapsed() < 50 * NZMQT_BUSYPOLLINGZMQCONTEXT_BLOCKTIMEOUT,
+                 qPrintable(QString("%1 ms").arg(churnTimer.elapsed())));
+        context->stop();
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testMessageHandler()
+{
+    using namespace nzmqt;
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+        ZMQSocket* puller = context->createSocket(ZMQSocket::TYP_PULL, context.data());
+        puller->bindTo("inproc://message-handler");
+        ZMQSocket* pusher = context->createSocket(ZMQSocket::TYP_PUSH, context.data());
+        pusher->connectTo("inproc://message-handler");
+
+        QList< QList<QByteArray> > handled;
+        puller->setMessageHandler([&handled](const QList<QByteArray>& message) { handled << message; });
+        QVERIFY(puller->hasMessageHandler());
+        QSignalSpy spyReceived(puller, SIGNAL(messageReceived(const QList<QByteArray>&)));
+        context->start();
+
+        // The handler replaces the signal.
+        QVERIFY(pusher->sendMessage(QList<QByteArray>() << "handled" << "message"));
+        for (int i = 0; i < 100 && handled.isEmpty(); ++i)
+            QTest::qWait(10);
+        QCOMPARE(handled.size(), 1);
+        QCOMPARE(handled.first(), QList<QByteArray>() << "handled" << "message");
+        QVERIFY(spyReceived.isEmpty());
+
+        puller->setMessageHandler(ZMQSocket::MessageHandler());
+        QVERIFY(!puller->hasMessageHandler());
+        QVERIFY(pusher->sendMessage("signalled"));
+        for (int i = 0; i < 100 && spyReceived.isEmpty(); ++i)
+            QTest::qWait(10);
+        QCOMPARE(spyReceived.size(), 1);
+        QCOMPARE(handled.size(), 1);
+
+        // A handler cuts off the signal's receivers, which is warned about.
+        puller->setObjectName("puller");
+        QTest::ignoreMessage(QtWarningMsg, "Message handler of socket 'puller' replaces the receivers of messageReceived()");
+        puller->setMessageHandler([&handled](const QList<QByteArray>& message) { handled << message; });
+        QVERIFY(puller->hasMessageHandler());
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
+void NzmqtTest::testTypedSockets()
+{
+    using namespace nzmqt;
+
+    // Misuse, e.g. 'ZMQPushSocket::receive()', does not compile.
+    static_assert(!ZMQSocketTraits<ZMQSocket::TYP_PUSH>::canReceive, "PUSH sockets cannot receive.");
+    static_assert(!ZMQSocketTraits<ZMQSocket::TYP_SUB>::canSend, "SUB sockets cannot send.");
+    static_assert(!ZMQSocketTraits<ZMQSocket::TYP_PUB>::canSubscribe, "PUB sockets cannot subscribe.");
+    static_assert(!ZMQSocketTraits<ZMQSocket::TYP_XSUB>::canSubscribe, "XSUB sockets send subscription messages.");
+
+    try {
+        QScopedPointer<ZMQContext> context(nzmqt::createDefaultContext());
+
+        ZMQPullSocket puller(context.data(), context.data());
+        puller.bindTo("inproc://typed-pushpull");
+        ZMQPushSocket pusher(context.data(), context.data());
+        pusher.connectTo("inproc://typed-pushpull");
+
+        QByteArray frame;
+        QVERIFY(!puller.receive(&frame));
+        QVERIFY(pusher.send("single"));
+        QVERIFY(pusher.send(QList<QByteArray>() << "first" << "dropped"));
+        QVERIFY(pusher.send("last"));
+        QVERIFY(puller.receive(&frame, ZMQSocket::ReceiveFlags()));
+        QCOMPARE(frame, QByteArray("single"));
+        QVERIFY(puller.receive(&frame, ZMQSocket::ReceiveFlags()));
+        QCOMPARE(frame, QByteArray("first"));
+        QCOMPARE(puller.receive(ZMQSocket::ReceiveFlags()), QList<QByteArray>() << "last");
+
+        // The router learns and addresses its peers by identity.
+        ZMQRouterSocket router(context.data(), context.data());
+        router.bindTo("inproc://typed-routerdealer");
+        ZMQDealerSocket dealer(context.data(), context.data());
+        dealer.socket()->setIdentity("dealer");
+        dealer.connectTo("inproc://typed-routerdealer");
+
+        QVERIFY(dealer.send(QList<QByteArray>() << "request"));
+        QByteArray identity;
+        QCOMPARE(router.receiveFrom(&identity, ZMQSocket::ReceiveFlags()), QList<QByteArray>() << "request");
+        QCOMPARE(identity, QByteArray("dealer"));
+        QVERIFY(router.sendTo(identity, QList<QByteArray>() << "reply"));
+        QCOMPARE(dealer.receive(ZMQSocket::ReceiveFlags()), QList<QByteArray>() << "reply");
+
+        // An empty message would leave the identity frame pending.
+        bool refused = false;
+        try {
+            router.sendTo(identity, QList<QByteArray>());
+        }
+        catch (const ZMQException& ex)
+        {
+            refused = (EINVAL == ex.num());
+        }
+        QVERIFY(refused);
+        QVERIFY(router.sendTo(identity, QList<QByteArray>() << "after"));
+        QCOMPARE(dealer.receive(ZMQSocket::ReceiveFlags()), QList<QByteArray>() << "after");
+
+        // XSUB sockets subscribe by sending subscription messages upstream.
+        ZMQXPubSocket xpublisher(context.data(), context.data());
+        xpublisher.bindTo("inproc://typed-xpubxsub");
+        ZMQXSubSocket xsubscriber(context.data(), context.data());
+        xsubscriber.connectTo("inproc://typed-xpubxsub");
+        QVERIFY(xsubscriber.sendSubscription("topic"));
+        QCOMPARE(xpublisher.receive(ZMQSocket::ReceiveFlags()), QList<QByteArray>() << QByteArray("\x01topic"));
+        QVERIFY(xsubscriber.sendSubscription("topic", false));
+        QCOMPARE(xpublisher.receive(ZMQSocket::ReceiveFlags()), QList<QByteArray>() << QByteArray("\x00topic", 6));
+
+        // Wrapped sockets keep working through the handle.
+        ZMQSubSocket subscriber(context->createSocket(ZMQSocket::TYP_SUB, context.data()));
+        subscriber.subscribeTo("topic");
+        QCOMPARE(subscriber.socket()->parent(), static_cast<QObject*>(context.data()));
+    }
+    catch (std::exception& ex)
+    {
+        QFAIL(ex.what());
+    }
+}
+
 }
 
 QTEST_MAIN(test::NzmqtTest)